@@ -0,0 +1,79 @@
+// Opt-in memory profiling: allocations and bytes per pipeline stage, heap and RSS peaks, and peak gauges.
+//
+// Allocation counting needs the CMake option PROFILE_MEMORY (cmake -DPROFILE_MEMORY=ON), which makes mylib_basics
+// interpose malloc/free (glibc). Not only operator new: the points of a pcl cloud are allocated by Eigen's
+// aligned allocator, which calls malloc directly. Each allocation is counted for the current stage of the calling
+// thread, set by a MemoryStage scope. parallelFor and ThreadPool pass the stage of the caller on to their threads.
+// Without the option, nothing is hooked: the counters stay zero and isMemoryProfilingEnabled() is false.
+// The peak RSS (from /proc) and the gauges work in both builds.
+
+#ifndef MY_MEMORY_PROFILER_H
+#define MY_MEMORY_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace my_basics
+{
+
+const int MAX_MEMORY_STAGES = 32;
+
+struct MemoryStageStats
+{
+    uint64_t num_allocs, bytes; // cumulative, since the start or the last resetMemoryStats()
+};
+
+// Whether malloc and the rest of its family are hooked (built with PROFILE_MEMORY)
+bool isMemoryProfilingEnabled();
+
+// Index of a stage by its name, registering it on the first call. Stage 0 is "other".
+// Returns 0 when all MAX_MEMORY_STAGES are used.
+int getMemoryStage(const std::string &name);
+std::string getMemoryStageName(int stage);
+int getNumMemoryStages();
+
+MemoryStageStats getMemoryStageStats(int stage);
+int64_t getHeapBytes();     // live bytes allocated by malloc
+int64_t getPeakHeapBytes(); // since the start or the last resetMemoryStats()
+int64_t getPeakRssBytes();  // VmHWM of the process. 0 if unknown.
+void resetMemoryStats();    // the counters of all stages, and the heap peak to the current heap
+
+// One line per stage with allocations: "stage: allocs, MB"
+std::string getMemoryReport();
+
+// Attribute the allocations of this thread to a stage, until the end of the scope.
+class MemoryStage
+{
+public:
+    MemoryStage(int stage);
+    ~MemoryStage();
+    static int current(); // stage of this thread
+
+private:
+    int prev_;
+};
+
+// Current and peak value of a quantity sampled by the caller, e.g. the bytes of the queued clouds.
+class PeakGauge
+{
+public:
+    PeakGauge() : value_(0), peak_(0) {}
+    void set(int64_t value)
+    {
+        value_ = value;
+        int64_t peak = peak_.load();
+        while (value > peak && !peak_.compare_exchange_weak(peak, value))
+            ;
+    }
+    int64_t get() const { return value_; }
+    int64_t getPeak() const { return peak_; }
+    void resetPeak() { peak_ = value_.load(); }
+
+private:
+    std::atomic<int64_t> value_, peak_;
+};
+
+} // namespace my_basics
+
+#endif
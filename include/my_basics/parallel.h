@@ -0,0 +1,51 @@
+// Simple helpers for splitting a loop over several std::threads.
+
+#ifndef MY_PARALLEL_H
+#define MY_PARALLEL_H
+
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace my_basics
+{
+
+// Number of threads to use when the caller passes num_threads<=0. (std::thread::hardware_concurrency)
+int getNumThreads(int num_threads = 0);
+
+// Split [begin, end) into contiguous chunks, and call func(chunk_begin, chunk_end, thread_idx)
+// on each chunk in its own thread. Returns after all chunks are done.
+// Small ranges (or num_threads==1) run in the calling thread.
+void parallelFor(int begin, int end, const std::function<void(int, int, int)> &func,
+                 int num_threads = 0, int min_chunk_size = 1);
+
+// A fixed set of worker threads running queued tasks, for work that arrives over time
+// (e.g. one task per new view). The destructor finishes all queued tasks.
+class ThreadPool
+{
+public:
+    ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+    void push(const std::function<void()> &task);
+    void waitAll(); // block until every pushed task has finished
+    int getNumThreads() const { return workers_.size(); }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mtx_;
+    std::condition_variable cv_task_, cv_done_;
+    int num_unfinished_;
+    bool stop_;
+};
+
+} // namespace my_basics
+
+#endif
@@ -0,0 +1,55 @@
+/*
+PoseInterpolator: a buffer of stamped poses (e.g. the camera pose published at a high rate while the arm moves),
+queried at any stamp in between, e.g. the stamp of a cloud.
+
+The translation is interpolated linearly, and the rotation by slerp, between the two poses around the stamp.
+Poses older than buffer_seconds (relative to the newest pose) are dropped.
+A stamp between two poses farther apart than max_gap is not interpolated: the motion between them is unknown.
+*/
+
+#ifndef MY_POSE_INTERPOLATOR_H
+#define MY_POSE_INTERPOLATOR_H
+
+#include <deque>
+#include <utility>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdDeque>
+
+namespace my_basics
+{
+
+class PoseInterpolator
+{
+public:
+    enum Result
+    {
+        OK,
+        TOO_OLD, // before the oldest pose: will never be known
+        TOO_NEW, // after the newest pose: wait for more poses
+        GAP      // between two poses too far apart
+    };
+
+    PoseInterpolator(double buffer_seconds = 2.0, double max_gap = 0.1);
+
+    // Poses are expected in the order of stamps. An older one is inserted in place.
+    void push(double stamp, const Eigen::Matrix4f &T);
+    Result interpolate(double stamp, Eigen::Matrix4f &T) const;
+
+    int size() const { return poses_.size(); }
+    double getOldestStamp() const { return poses_.front().first; } // size() must be > 0
+    double getNewestStamp() const { return poses_.back().first; }
+
+private:
+    typedef std::pair<double, Eigen::Matrix4f> StampedPose;
+    double buffer_seconds_, max_gap_;
+    std::deque<StampedPose, Eigen::aligned_allocator<StampedPose>> poses_;
+};
+
+// Pose at ratio t in [0, 1] between T0 and T1
+Eigen::Matrix4f interpolatePose(const Eigen::Matrix4f &T0, const Eigen::Matrix4f &T1, float t);
+
+} // namespace my_basics
+
+#endif
@@ -0,0 +1,147 @@
+/*
+StampSync: pair two streams of stamped messages by time stamp, e.g. the camera poses from node1 ("first")
+and the clouds from the depth camera ("second").
+
+Each first is matched to the second with the nearest stamp, if it is within the tolerance.
+The match is decided once a second not older than the first has arrived: seconds come in order,
+so the later ones can only be farther.
+A first is dropped when a second newer than (its stamp + tolerance) arrives without any match for it.
+Seconds are dropped when they are too old to match any first (the firsts come in order too),
+or when they are skipped by a match. E.g. the seconds that came while no first was queued are dropped
+when a first arrives, if they are older than (its stamp - tolerance).
+
+Both queues are bounded. When a queue is full, the oldest message is dropped (DROP_OLDEST),
+or the new one is rejected (DROP_NEWEST) unless an old one can't be matched any more.
+All dropped messages are counted.
+*/
+
+#ifndef MY_STAMP_SYNC_H
+#define MY_STAMP_SYNC_H
+
+#include <deque>
+#include <utility>
+#include <cmath>
+#include <limits>
+
+namespace my_basics
+{
+
+enum QueueFullPolicy
+{
+    DROP_OLDEST,
+    DROP_NEWEST
+};
+
+template <class A, class B>
+class StampSync
+{
+public:
+    StampSync(double tolerance = 0.05, int max_size_first = 10, int max_size_second = 3,
+              QueueFullPolicy policy = DROP_OLDEST)
+        : tolerance_(tolerance), max_size_first_(max_size_first), max_size_second_(max_size_second),
+          policy_(policy), last_stamp_first_(-std::numeric_limits<double>::max()),
+          num_dropped_first_(0), num_dropped_second_(0) {}
+
+    // Return false if the message is dropped at once.
+    bool pushFirst(double stamp, const A &a)
+    {
+        if (!makeRoom(firsts_, max_size_first_, num_dropped_first_))
+            return false;
+        firsts_.push_back(std::make_pair(stamp, a));
+        last_stamp_first_ = std::max(last_stamp_first_, stamp);
+        dropOldSeconds(); // those that came while no first was queued
+        return true;
+    }
+    bool pushSecond(double stamp, const B &b)
+    {
+        if (!isUseful(stamp))
+        {
+            num_dropped_second_++;
+            return false;
+        }
+        dropOldSeconds(); // make room for the new one first
+        if (!makeRoom(seconds_, max_size_second_, num_dropped_second_))
+            return false;
+        seconds_.push_back(std::make_pair(stamp, b));
+        return true;
+    }
+
+    // Whether a second with this stamp could still be matched, e.g. to skip converting a cloud that would be dropped.
+    bool isUseful(double stamp) const { return stamp >= getMinStampOfFirsts() - tolerance_; }
+
+    // Pop the oldest decided match. Return false if there is none yet.
+    bool pop(A &a, B &b, double &stamp_a, double &stamp_b)
+    {
+        while (!firsts_.empty())
+        {
+            double ta = firsts_.front().first;
+            int best = -1;
+            double best_diff = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < seconds_.size(); i++)
+                if (std::abs(seconds_[i].first - ta) < best_diff)
+                    best = i, best_diff = std::abs(seconds_[i].first - ta);
+
+            if (best >= 0 && best_diff <= tolerance_)
+            {
+                if (seconds_.back().first < ta) // a closer second may still come
+                    return false;
+                stamp_a = ta, a = firsts_.front().second;
+                stamp_b = seconds_[best].first, b = seconds_[best].second;
+                firsts_.pop_front();
+                num_dropped_second_ += best; // the older ones are skipped
+                seconds_.erase(seconds_.begin(), seconds_.begin() + best + 1);
+                dropOldSeconds();
+                return true;
+            }
+            if (seconds_.empty() || seconds_.back().first <= ta + tolerance_)
+                return false; // wait for more seconds
+            firsts_.pop_front(); // no second can match it any more
+            num_dropped_first_++;
+            dropOldSeconds();
+        }
+        return false;
+    }
+
+    int getNumFirsts() const { return firsts_.size(); }
+    int getNumSeconds() const { return seconds_.size(); }
+    const std::deque<std::pair<double, B>> &getSeconds() const { return seconds_; } // oldest first
+    int getNumDroppedFirst() const { return num_dropped_first_; }
+    int getNumDroppedSecond() const { return num_dropped_second_; }
+
+private:
+    // Lower bound of the stamps of the firsts in the queue or to come
+    double getMinStampOfFirsts() const { return firsts_.empty() ? last_stamp_first_ : firsts_.front().first; }
+
+    void dropOldSeconds()
+    {
+        while (!seconds_.empty() && !isUseful(seconds_.front().first))
+        {
+            seconds_.pop_front();
+            num_dropped_second_++;
+        }
+    }
+
+    template <class T>
+    bool makeRoom(std::deque<std::pair<double, T>> &queue, int max_size, int &num_dropped)
+    {
+        if ((int)queue.size() < max_size)
+            return true;
+        num_dropped++;
+        if (policy_ == DROP_NEWEST)
+            return false;
+        queue.pop_front();
+        return true;
+    }
+
+    double tolerance_;
+    int max_size_first_, max_size_second_;
+    QueueFullPolicy policy_;
+    std::deque<std::pair<double, A>> firsts_;
+    std::deque<std::pair<double, B>> seconds_;
+    double last_stamp_first_;
+    int num_dropped_first_, num_dropped_second_;
+};
+
+} // namespace my_basics
+
+#endif
@@ -0,0 +1,88 @@
+// Trace points of the views across the nodes, written as a Chrome trace (chrome://tracing, or ui.perfetto.dev).
+//
+// A view is identified by its trace ID = (scan, view): node1 puts it into each T4x4 pose, node2 gives it to the
+// frame paired with the pose, and shm CloudSlots carry it. A PointCloud2 has no spare header field, so a cloud is
+// identified by its stamp, which node2 copies from its input to all outputs: each event also records the stamp
+// of its cloud (in microseconds, like pcl), and src_python/merge_traces.py links the stamps to the trace IDs
+// when it merges the files of all nodes into one timeline. src_python/lib_trace.py writes the same format.
+//
+// Times are wall clock seconds since the epoch, so the files of the nodes on one machine share a time axis.
+
+#ifndef MY_TRACE_H
+#define MY_TRACE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace my_basics
+{
+
+// scan and view start from 1. 0 means unknown.
+inline uint64_t makeTraceId(uint32_t scan, uint32_t view) { return ((uint64_t)scan << 32) | view; }
+inline uint32_t getTraceScan(uint64_t trace_id) { return trace_id >> 32; }
+inline uint32_t getTraceView(uint64_t trace_id) { return trace_id & 0xffffffff; }
+
+class TraceRecorder
+{
+public:
+    // A disabled recorder records nothing, so the trace points can stay in the code.
+    // At most max_events are kept: later events are dropped.
+    TraceRecorder(const std::string &process_name, bool enabled = true, size_t max_events = 1000000);
+
+    bool isEnabled() const { return enabled_; }
+    static double now(); // wall clock, seconds since the epoch
+
+    // A span of the current thread. stamp_us: stamp of the view's cloud (0 if none).
+    void record(const std::string &name, double t_begin, double t_end, uint64_t trace_id, int64_t stamp_us = 0);
+
+    // Write all events so far as a Chrome trace JSON. Return false if the file can't be written.
+    bool write(const std::string &filename) const;
+
+    size_t getNumEvents() const;
+
+private:
+    struct Event
+    {
+        std::string name;
+        double t_begin, t_end;
+        uint64_t trace_id;
+        int64_t stamp_us;
+        int tid;
+    };
+    std::string process_name_;
+    bool enabled_;
+    size_t max_events_;
+    mutable std::mutex mtx_;
+    std::vector<Event> events_;
+    std::map<std::thread::id, int> tids_; // small numbers for the threads, in order of their first event
+    bool warned_full_;
+};
+
+// Record a span from the constructor to the end of the scope
+class TraceScope
+{
+public:
+    TraceScope(TraceRecorder &recorder, const std::string &name, uint64_t trace_id, int64_t stamp_us = 0)
+        : recorder_(recorder), name_(name), trace_id_(trace_id), stamp_us_(stamp_us),
+          t_begin_(recorder.isEnabled() ? TraceRecorder::now() : 0) {}
+    ~TraceScope()
+    {
+        if (recorder_.isEnabled())
+            recorder_.record(name_, t_begin_, TraceRecorder::now(), trace_id_, stamp_us_);
+    }
+
+private:
+    TraceRecorder &recorder_;
+    std::string name_;
+    uint64_t trace_id_;
+    int64_t stamp_us_;
+    double t_begin_;
+};
+
+} // namespace my_basics
+
+#endif
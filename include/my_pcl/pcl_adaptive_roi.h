@@ -0,0 +1,67 @@
+/*
+AdaptiveCropBox: shrink the crop box of the views to the object, once a few views have segmented it.
+
+The box of the object is the union of the boxes of the segmented views, each without the outlier_ratio
+extreme points of each side (the edge of the table, noise). After min_views views, a crop box shrinks to the
+object's box plus a margin, so that the later views observe the object inside it while their filtering and
+segmentation process a fraction of the points. The bottom of a crop box is kept: the plane removal needs the table.
+
+cropByBoxInFrame crops a cloud of the camera frame by a box of another frame (e.g. the chessboard),
+so that the crop can be done first, on the raw cloud.
+*/
+
+#ifndef PCL_ADAPTIVE_ROI_H
+#define PCL_ADAPTIVE_ROI_H
+
+#include <my_pcl/common_headers.h>
+#include <Eigen/Core>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+struct CropBox
+{
+    float x_min, x_max, y_min, y_max, z_min, z_max;
+};
+
+class AdaptiveCropBox
+{
+public:
+    // Views with fewer than min_points points are not added.
+    AdaptiveCropBox(float margin = 0.03, int min_views = 2, float outlier_ratio = 0.01, int min_points = 100);
+
+    // The segmented object of a view, in the frame of the crop boxes
+    void addView(const PointCloud<PointXYZRGB> &cloud_object);
+
+    // Shrink the box (except z_min) to the object's box plus the margin, once min_views views are added.
+    // The box never grows. Return whether it is shrunk.
+    bool shrinkBox(CropBox &box) const;
+
+    void clear(); // e.g. for the next scan
+
+    int getNumViews() const { return num_views_; }
+    bool isReady() const { return num_views_ >= min_views_; }
+
+private:
+    float margin_, outlier_ratio_;
+    int min_views_, min_points_;
+    int num_views_;
+    Eigen::Vector3f min_pt_, max_pt_; // of the object
+};
+
+// The points of the cloud that are inside the box, in the box's frame. T_box_to_cloud: pose of the cloud's frame
+// in the box's frame. The points are not moved, and the header is kept.
+PointCloud<PointXYZRGB>::Ptr cropByBoxInFrame(const PointCloud<PointXYZRGB> &cloud,
+                                              const Eigen::Matrix4f &T_box_to_cloud, const CropBox &box);
+
+// Volume of a box, in m^3
+inline float getBoxVolume(const CropBox &box)
+{
+    return (box.x_max - box.x_min) * (box.y_max - box.y_min) * (box.z_max - box.z_min);
+}
+
+} // namespace my_pcl
+
+#endif
@@ -21,11 +21,13 @@ using namespace pcl;
 vector<PointCloud<PointXYZRGB>::Ptr> extractSubCloudsByIndices(
     const PointCloud<PointXYZRGB>::Ptr cloud, const vector<PointIndices> &clusters_indices);
 
-// Remove planes
+// Remove planes.
+// If horizontal_first, the first plane is detected by detectHorizontalPlane (e.g. the table in the chessboard frame),
+// and by RANSAC only if that fit is poor.
 int removePlanes(PointCloud<PointXYZRGB>::Ptr &cloud,
     float plane_distance_threshold = 0.01, int plane_max_iterations = 100,
     int stop_criteria_num_planes = -1, float stop_criteria_rest_points_ratio = 0.3,
-    bool print_res=false);
+    bool print_res=false, bool horizontal_first=false);
 
 // Do clustering using pcl::EuclideanClusterExtraction. Return the indices of each cluster.
 vector<PointIndices> divideIntoClusters(const PointCloud<PointXYZRGB>::Ptr cloud,
@@ -0,0 +1,103 @@
+/*
+Scan session archive: one append-only file holding all views of a scan.
+
+File layout (little endian, every block starts at a multiple of 64 bytes):
+    [ScanArchiveHeader]
+    [ScanArchiveFrame] * max_frames      (frame index, fixed size entries)
+    [points of frame 1: cloud_src][points of frame 1: cloud_segmented]
+    [points of frame 2: ...] ...
+Points are stored as raw pcl::PointXYZRGB (32 bytes each).
+
+The writer appends the points of a frame, then its index entry, and at last increases num_frames.
+So a crash leaves a valid archive of the frames committed before it.
+The reader mmaps the file and returns pointers into it. No parsing, and frame i is accessed in O(1).
+*/
+
+#ifndef PCL_ARCHIVE_H
+#define PCL_ARCHIVE_H
+
+#include <my_pcl/common_headers.h>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+struct ScanArchiveHeader
+{
+    char magic[8]; // "SCANARC1"
+    uint32_t version;
+    uint32_t max_frames;
+    uint32_t num_frames; // committed frames
+    uint32_t point_size; // sizeof(PointXYZRGB)
+    uint64_t index_offset;
+    uint64_t data_offset;
+    char padding[24];
+};
+
+struct ScanArchiveFrame
+{
+    float T_baxter_to_depthcam[16]; // row major
+    uint64_t stamp;                 // pcl header stamp of cloud_src (microseconds)
+    uint64_t src_offset;
+    uint32_t src_width, src_height;
+    uint64_t segmented_offset;
+    uint32_t segmented_size;
+    uint32_t frame_idx; // starts from 1, same as the suffix of the old "src_01.pcd"
+    char padding[24];
+};
+
+class ScanArchiveWriter
+{
+public:
+    // Create a new archive. An existing file of the same name is truncated.
+    ScanArchiveWriter(const string &filename, int max_frames = 256);
+    ~ScanArchiveWriter();
+    bool isOpen() const { return fd_ != -1; }
+
+    // Append one view. Return false if the archive is full or writing fails.
+    bool appendFrame(const vector<vector<float>> &T_baxter_to_depthcam,
+                     const PointCloud<PointXYZRGB>::Ptr cloud_src,
+                     const PointCloud<PointXYZRGB>::Ptr cloud_segmented);
+
+    int getNumFrames() const { return header_.num_frames; }
+
+private:
+    ScanArchiveWriter(const ScanArchiveWriter &);
+    ScanArchiveWriter &operator=(const ScanArchiveWriter &);
+    bool writeAt(uint64_t offset, const void *data, size_t size);
+
+    int fd_;
+    ScanArchiveHeader header_;
+    uint64_t end_offset_; // where the next points will be appended
+};
+
+class ScanArchiveReader
+{
+public:
+    ScanArchiveReader(const string &filename);
+    ~ScanArchiveReader();
+    bool isOpen() const { return base_ != NULL; }
+
+    int getNumFrames() const;
+    // i starts from 0.
+    const ScanArchiveFrame &getFrame(int i) const;
+    const PointXYZRGB *getCloudSrcPoints(int i) const;
+    const PointXYZRGB *getCloudSegmentedPoints(int i) const;
+
+    // Copy frame i out into PCL clouds (and a 4x4 pose in node2's format).
+    void readFrame(int i, vector<vector<float>> &T_baxter_to_depthcam,
+                   PointCloud<PointXYZRGB>::Ptr &cloud_src,
+                   PointCloud<PointXYZRGB>::Ptr &cloud_segmented) const;
+
+private:
+    ScanArchiveReader(const ScanArchiveReader &);
+    ScanArchiveReader &operator=(const ScanArchiveReader &);
+
+    size_t map_size_;
+    unsigned char *base_;
+};
+
+} // namespace my_pcl
+
+#endif
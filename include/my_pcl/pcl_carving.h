@@ -0,0 +1,84 @@
+/*
+FreeSpaceCarving: remove the points that another view saw through, by the camera pose of each view.
+
+A view seeing a surface at depth d along a ray has seen the space in front of it as free.
+So a point p of the merged cloud is spurious (e.g. a flying pixel, or a view with a wrong pose)
+if some view, looking along the ray through p, saw the surface more than "margin" behind p.
+
+addView:  the points of a view are projected into a depth buffer of the view's camera, keeping the nearest depth
+          per pixel. The buffer is a pinhole image of "pixel_angle" radians per pixel, just large enough
+          for the points, so the camera intrinsics are not needed.
+carve:    each point is projected into every buffer (in parallel over the points): O(points x views).
+          A view votes "free" if the nearest depth of the pixel and its 8 neighbors is behind the point
+          by more than margin. Points with at least min_votes votes are removed.
+Pixels without any point give no vote: the views only carve where they saw something.
+
+A depth buffer is in the coordinates of its camera, so a correction of a view's pose (e.g. by the multi-view
+refinement, which moves the view's points and its camera together) only changes where the buffer is:
+carve(cloud, corrections) carves a corrected cloud by the corrected poses, without the views' clouds.
+*/
+
+#ifndef PCL_CARVING_H
+#define PCL_CARVING_H
+
+#include <my_pcl/common_headers.h>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+class FreeSpaceCarving
+{
+public:
+    FreeSpaceCarving(float pixel_angle = 0.003, float margin = 0.005, int min_votes = 1, int max_buffer_size = 2000);
+
+    // cloud: in the common frame. T_world_to_camera: pose of the view's camera in the same frame
+    // (z forward, like a depth camera's optical frame).
+    void addView(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_world_to_camera);
+
+    // Number of views that saw through p
+    int countFreeVotes(const Eigen::Vector3f &p) const;
+
+    // Points of cloud with less than min_votes votes
+    PointCloud<PointXYZRGB>::Ptr carve(const PointCloud<PointXYZRGB> &cloud, int num_threads = 0) const;
+
+    // The same, with the pose of view i corrected to corrections[i] * T_world_to_camera.
+    // One correction per view, e.g. MultiViewRegistration::getCorrection.
+    typedef vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> Corrections;
+    PointCloud<PointXYZRGB>::Ptr carve(const PointCloud<PointXYZRGB> &cloud, const Corrections &corrections,
+                                       int num_threads = 0) const;
+
+    int getNumViews() const { return buffers_.size(); }
+
+private:
+    struct CameraPose
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        Eigen::Matrix3f R_camera_to_world;
+        Eigen::Vector3f t_camera_to_world;
+    };
+    typedef vector<CameraPose, Eigen::aligned_allocator<CameraPose>> CameraPoses;
+    struct DepthBuffer
+    {
+        int u0, v0, width, height; // pixel (u, v) is depth[(v - v0) * width + (u - u0)]
+        vector<float> depth;       // +inf where no point
+    };
+    // Camera coordinates and pixel of p. Return false if behind the camera.
+    bool project(const CameraPose &pose, const Eigen::Vector3f &p, float &z, int &u, int &v) const;
+    int countFreeVotes(const Eigen::Vector3f &p, const CameraPoses &poses) const;
+    PointCloud<PointXYZRGB>::Ptr carveByPoses(const PointCloud<PointXYZRGB> &cloud, const CameraPoses &poses,
+                                              int num_threads) const;
+
+    float pixel_angle_, margin_;
+    int min_votes_, max_buffer_size_;
+    vector<DepthBuffer> buffers_;
+    CameraPoses poses_; // of each buffer
+};
+
+} // namespace my_pcl
+
+#endif
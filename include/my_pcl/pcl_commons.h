@@ -17,6 +17,10 @@ using namespace pcl;
 void printCloudSize(PointCloud<PointXYZRGB>::Ptr cloud);
 void printCloudSize(PointCloud<PointXYZ>::Ptr cloud);
 
+// -- Bytes held by the points of a cloud (its capacity), e.g. for memory profiling
+template <class PointT>
+size_t getCloudBytes(const PointCloud<PointT> &cloud) { return cloud.points.capacity() * sizeof(PointT); }
+
 // -- Set point color and pos
 void setPointColor(PointXYZRGB &point, uint8_t r, uint8_t g, uint8_t b);
 void setCloudColor(PointCloud<PointXYZRGB>::Ptr cloud,  uint8_t r, uint8_t g, uint8_t b);
@@ -0,0 +1,78 @@
+/*
+CompactCloud: a quantized structure-of-arrays point container for the object ROI.
+
+A point is stored as int16 x, y, z (fixed point, "resolution" meters per unit, relative to "origin")
+plus a packed 0x00RRGGBB color: 10 bytes, instead of 32 bytes of PointXYZRGB.
+With the default resolution of 0.1 mm, the range is +-3.27 m around the origin, which is far more
+than the crop box around the chessboard.
+
+Conversion:
+    fromPCL / toPCL. Invalid points, and points out of range, are dropped by fromPCL.
+Kernels working on the quantized data directly:
+    cropBox:            PassThrough on all 3 axes, by integer comparison
+    voxelGrid:          same result as VoxelGrid (centroid of xyz and rgb of each voxel)
+    transform:          rigid transform, and requantize (optionally around a new origin)
+    euclideanClusters:  same result as EuclideanClusterExtraction, with a hash grid instead of a kdtree
+*/
+
+#ifndef PCL_COMPACT_H
+#define PCL_COMPACT_H
+
+#include <my_pcl/common_headers.h>
+#include <stdint.h>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+class CompactCloud
+{
+public:
+    CompactCloud(float resolution = 0.0001, float origin_x = 0, float origin_y = 0, float origin_z = 0);
+
+    // -- Conversion
+    // Replace the content by cloud. Return the number of points dropped (NaN or out of range).
+    int fromPCL(const PointCloud<PointXYZRGB> &cloud);
+    PointCloud<PointXYZRGB>::Ptr toPCL() const;
+    void getPoint(int i, PointXYZRGB &p) const;
+
+    // -- Kernels
+    // Keep the points inside [min, max] of each axis (in meters, in the cloud's frame).
+    void cropBox(float x_min, float x_max, float y_min, float y_max, float z_min, float z_max);
+
+    // Down-sampling. Each voxel is replaced by the centroid of its points.
+    void voxelGrid(float x_grid_size, float y_grid_size, float z_grid_size);
+
+    // p = T * p. The result is quantized around the same origin,
+    // or around a new one (given in the destination frame). Return the number of points dropped.
+    int transform(const float T[4][4]);
+    int transform(const vector<vector<float>> &T);
+    int transform(const float T[4][4], float new_origin_x, float new_origin_y, float new_origin_z);
+
+    // Indices of each cluster, sorted by size in descending order.
+    vector<PointIndices> euclideanClusters(double cluster_tolerance = 0.02,
+                                           int min_cluster_size = 100, int max_cluster_size = 20000) const;
+
+    // -- Access
+    size_t size() const { return x_.size(); }
+    bool empty() const { return x_.empty(); }
+    void clear();
+    void reserve(size_t n);
+    size_t getMemoryBytes() const; // bytes of the point data
+    float getResolution() const { return resolution_; }
+
+private:
+    int transformRowMajor(const float *T, float new_origin_x, float new_origin_y, float new_origin_z);
+    bool quantize(float v, float origin, int16_t &q) const;
+    void pushBackQuantized(int16_t x, int16_t y, int16_t z, uint32_t rgb);
+
+    float resolution_;
+    float origin_x_, origin_y_, origin_z_;
+    vector<int16_t> x_, y_, z_;
+    vector<uint32_t> rgb_;
+};
+
+} // namespace my_pcl
+
+#endif
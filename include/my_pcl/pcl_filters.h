@@ -2,8 +2,8 @@
 This script provides filtering functions including:
     PassThrough
     StatisticalOutlierRemoval
-    VoxelGrid
-    detectPlane
+    VoxelGrid (fixed leaf size, or searched for a point budget)
+    detectPlane (RANSAC), detectHorizontalPlane (z histogram + least squares)
     extractSubCloudByIndices
 
 Data types:
@@ -58,6 +58,17 @@ PointCloud<PointXYZRGB>::Ptr
 filtByVoxelGrid(const PointCloud<PointXYZRGB>::Ptr cloud,
                 float x_grid_size = 0.01, float y_grid_size = 0.01, float z_grid_size = 0.01);
 
+// -- VoxelGrid with a point budget:
+// Search the (cubic) leaf size so that the output has at most max_num_points points, and as close to it as
+// the search allows. The search counts occupied voxels (the same grid as VoxelGrid) without filtering.
+// leaf_size: in: initial guess (e.g. the one of the last frame, <=0 for none). out: the leaf size used.
+// If even max_leaf_size gives too many points, max_leaf_size is used.
+// The search stops after max_search_seconds, with the finest leaf size found within the budget
+// (or an extrapolated one if none is found yet, which may exceed the budget).
+PointCloud<PointXYZRGB>::Ptr
+filtByVoxelGridToBudget(const PointCloud<PointXYZRGB>::Ptr cloud, int max_num_points, float &leaf_size,
+                        float min_leaf_size = 0.001, float max_leaf_size = 0.05, double max_search_seconds = 0.01);
+
 // -- Detect one plane in the point cloud. Return its params and indices.
 // coefficients: ax+by+cz+d=0; Access them by: coefficients->values[0~3].
 // inliers: the indices of points belong to the plane. Access them by: inliers->indices[i].
@@ -75,6 +86,18 @@ bool detectPlane(
     printPlaneCoef(coefficients);
   }*/
 
+// -- Detect a near-horizontal plane (e.g. the table, in the chessboard frame) without random sampling:
+// the peak of the z histogram gives its height, then z = a*x + b*y + c is fitted by least squares
+// to the points within distance_threshold of it, in two passes. O(N).
+// Return false if the fit is poor, i.e. the normal tilts more than max_tilt_angle (radians) from the z axis,
+// the inliers are fewer than min_inlier_ratio of the cloud, or their RMS distance to the plane is larger than
+// distance_threshold / 2. The caller can then fall back to detectPlane.
+// The outputs are in the same format as detectPlane.
+bool detectHorizontalPlane(
+    const PointCloud<PointXYZRGB>::Ptr cloud,
+    ModelCoefficients::Ptr &coefficients, PointIndices::Ptr &inliers,
+    float distance_threshold = 0.01, float max_tilt_angle = 0.15, float min_inlier_ratio = 0.1);
+
 void printPlaneCoef(const pcl::ModelCoefficients::Ptr);
 
 // -- Extract sub point cloud by inliers (or its revert)
@@ -18,6 +18,13 @@ PointCloud<PointXYZRGB>::Ptr read_point_cloud(string filename);
 void write_point_cloud(string filename, PointCloud<PointXYZRGB>::Ptr cloud);
 void write_point_cloud(string filename, PointCloud<PointXYZ>::Ptr cloud);
 
+// -- Fast pcd loader, used by read_point_cloud.
+// mmap the file; parse "ascii" bodies by several threads, and copy "binary" bodies by memcpy.
+// Return false for the formats it does not support (e.g. binary_compressed, or x, y, z that are missing or not
+// float32), so the caller can use PCL.
+// Fields other than x, y, z, rgb/rgba are skipped.
+bool readPCDFast(const string &filename, PointCloud<PointXYZRGB> &cloud, int num_threads = 0);
+
 
 } // namespace my_pcl
 
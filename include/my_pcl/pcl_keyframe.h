@@ -0,0 +1,59 @@
+/*
+CoverageKeyframeSelector: choose the views that observe new parts of the object, before any expensive processing.
+
+A coarse occupancy map (a dense grid of voxels) covers the object's box, e.g. the crop box above the table.
+For a candidate view, every sample_stride-th point of its cloud is moved into the box's frame by the view's pose,
+and the distinct voxels it hits that are not observed yet are counted.
+A view with at least min_new_voxels new voxels is a keyframe, and its voxels are marked as observed.
+
+The count ignores occlusion within the coarse voxels and the points skipped by the stride,
+so it is an estimate of the coverage gain, at the cost of a transform and a lookup per sampled point.
+*/
+
+#ifndef PCL_KEYFRAME_H
+#define PCL_KEYFRAME_H
+
+#include <my_pcl/common_headers.h>
+#include <Eigen/Core>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+class CoverageKeyframeSelector
+{
+public:
+    CoverageKeyframeSelector(float x_min, float x_max, float y_min, float y_max, float z_min, float z_max,
+                             float voxel_size = 0.01, int min_new_voxels = 20, int sample_stride = 4);
+
+    // T_box_to_cloud: pose of the cloud's frame in the box's frame.
+    // Return the number of observed voxels that are new.
+    int countNewVoxels(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_box_to_cloud,
+                       vector<int> *new_voxels = NULL) const;
+
+    // Whether the view is a keyframe. If so, its voxels are marked as observed.
+    bool select(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_box_to_cloud);
+
+    void clear(); // e.g. for the next scan
+
+    int getNumObserved() const { return num_observed_; }
+    int getNumVoxels() const { return observed_.size(); }
+    int getNumSelected() const { return num_selected_; }
+    int getNumRejected() const { return num_rejected_; }
+    int getLastNewVoxels() const { return last_new_voxels_; } // of the last call of select
+
+private:
+    float x_min_, y_min_, z_min_;
+    float voxel_size_;
+    int nx_, ny_, nz_;
+    int min_new_voxels_, sample_stride_;
+
+    vector<bool> observed_;
+    int num_observed_;
+    int num_selected_, num_rejected_, last_new_voxels_;
+};
+
+} // namespace my_pcl
+
+#endif
@@ -0,0 +1,73 @@
+/*
+LodOctree: level-of-detail version of a cloud, for visualization.
+
+The octree is sparse and hashed. Level 0 is the coarsest, and the cells of the last level have size leaf_size.
+Each node is drawn as one point: the centroid and mean color of the points inside it.
+
+update:    give the current cloud (e.g. the whole model). Nodes that are new, or whose point moved
+           (more than a fraction of the cell size) or changed color, are marked as changed.
+           The points are binned into the finest level only, and each coarser level is summed from the one below,
+           so the cost is O(points + nodes), not O(points x levels). The cloud replaces the content, so each
+           update still reads all its points: a relay of a growing model costs O(model size) per message.
+getUpdate: return at most point_budget points of the changed nodes, coarse levels first.
+           What is not sent is kept for the next call, so the full resolution arrives after a few calls.
+           When nothing changed, the finest nodes are re-sent in turn (for displays with a decay time).
+
+So the cost of each publish only depends on point_budget, not on the size of the model (but see update).
+*/
+
+#ifndef PCL_LOD_OCTREE_H
+#define PCL_LOD_OCTREE_H
+
+#include <my_pcl/common_headers.h>
+#include <stdint.h>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+class LodOctree
+{
+public:
+    // num_levels: level 0 has cells of size leaf_size * 2^(num_levels-1).
+    // move_ratio: a node is changed when its point moves more than move_ratio * cell size.
+    LodOctree(float leaf_size = 0.002, int num_levels = 6, float move_ratio = 0.2);
+
+    // Replace the content by cloud. Return the number of changed nodes.
+    int update(const PointCloud<PointXYZRGB> &cloud);
+
+    // Points of changed nodes, coarse to fine, at most point_budget.
+    // If refresh_when_idle, unchanged finest nodes fill the budget when there are no changes left.
+    // Return the number of points. Zero means there is nothing to send.
+    int getUpdate(int point_budget, PointCloud<PointXYZRGB> &out, bool refresh_when_idle = false);
+
+    int getNumPendingNodes() const; // changed but not sent yet
+    int getNumNodes(int level) const { return levels_[level].size(); }
+    int getNumLevels() const { return levels_.size(); }
+    void clear();
+
+private:
+    struct Node
+    {
+        double sx, sy, sz;
+        uint64_t sr, sg, sb;
+        int count;
+        bool sent;
+        float sent_x, sent_y, sent_z; // what the viewer has
+        uint32_t sent_rgb;
+        bool changed;
+    };
+    typedef unordered_map<uint64_t, Node> Level;
+
+    void getNodePoint(const Node &node, PointXYZRGB &p) const;
+
+    float leaf_size_, move_ratio_;
+    vector<Level> levels_;
+    vector<uint64_t> refresh_keys_; // finest nodes, in the order of refreshing
+    size_t refresh_cursor_;
+};
+
+} // namespace my_pcl
+
+#endif
@@ -0,0 +1,37 @@
+/*
+Metrics for comparing the outputs of the pipeline with golden ones (see test/pcl_test_regression.cpp).
+
+compareClouds:  distance from each point of a cloud to its nearest point of the other one, in both directions.
+                Nearest neighbors are found in a voxel hash of the other cloud (cell = max_distance),
+                in parallel over the points. Distances beyond max_distance are clamped to it.
+                    chamfer:   mean of the two directed mean distances
+                    hausdorff: max of the two directed max distances
+                    p95:       max of the two directed 95th percentiles (robust to a few outliers)
+computePoseError: rotation angle (degrees) and translation (meters) of T_a^-1 * T_b.
+*/
+
+#ifndef PCL_METRICS_H
+#define PCL_METRICS_H
+
+#include <my_pcl/common_headers.h>
+#include <Eigen/Core>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+struct CloudDistance
+{
+    double chamfer, hausdorff, p95; // meters
+    int size_a, size_b;
+};
+
+CloudDistance compareClouds(const PointCloud<PointXYZRGB> &a, const PointCloud<PointXYZRGB> &b,
+                            float max_distance = 0.05, int num_threads = 0);
+
+void computePoseError(const Eigen::Matrix4f &T_a, const Eigen::Matrix4f &T_b, double &rot_degrees, double &trans);
+
+} // namespace my_pcl
+
+#endif
@@ -0,0 +1,80 @@
+/*
+NextBestViewPlanner: choose the next camera pose of the scan by the unknown space it would observe.
+
+A voxel grid covers the object's box (e.g. the crop box above the table). Each voxel is UNKNOWN, FREE or OCCUPIED.
+    integrateView:  for each point of a view (every sample_stride-th), the voxels on the ray from the camera
+                    to the point become FREE, and the voxel of the point becomes OCCUPIED.
+                    Rays are clipped to the box, so points out of the box (e.g. the table) still free the space.
+    computeGains:   for each candidate camera pose, rays are cast through every pixel_step-th pixel of the camera
+                    (in parallel over the candidates). The gain is the number of distinct UNKNOWN voxels
+                    the rays pass before they hit an OCCUPIED voxel or leave the box.
+
+The grid is traversed voxel by voxel (3D DDA), in the camera's optical frame convention of VirtualDepthCamera
+(z forward, x right, y down).
+*/
+
+#ifndef PCL_NEXT_BEST_VIEW_H
+#define PCL_NEXT_BEST_VIEW_H
+
+#include <my_pcl/common_headers.h>
+#include <my_pcl/pcl_virtual_camera.h>
+#include <stdint.h>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+class NextBestViewPlanner
+{
+public:
+    enum VoxelState
+    {
+        UNKNOWN = 0,
+        FREE = 1,
+        OCCUPIED = 2
+    };
+
+    NextBestViewPlanner(float x_min, float x_max, float y_min, float y_max, float z_min, float z_max,
+                        float voxel_size = 0.01);
+
+    // T_box_to_cloud: pose of the camera that took the cloud, in the box's frame.
+    void integrateView(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_box_to_cloud,
+                       int sample_stride = 1);
+
+    // Gain of each candidate camera pose (in the box's frame)
+    vector<int> computeGains(const vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &candidates,
+                             const CameraIntrinsics &intrinsics, int pixel_step = 8, int num_threads = 0) const;
+    int computeGain(const Eigen::Matrix4f &T_box_to_camera, const CameraIntrinsics &intrinsics,
+                    int pixel_step = 8) const;
+
+    void clear(); // e.g. for the next scan
+
+    int getNumVoxels() const { return states_.size(); }
+    int getNumUnknown() const { return num_unknown_; }
+    int getNumOccupied() const { return num_occupied_; }
+    int getNumViews() const { return num_views_; }
+    float getKnownRatio() const { return 1.0f - (float)num_unknown_ / states_.size(); }
+    VoxelState getState(int ix, int iy, int iz) const { return (VoxelState)states_[index(ix, iy, iz)]; }
+
+private:
+    int index(int ix, int iy, int iz) const { return (ix * ny_ + iy) * nz_ + iz; }
+
+    // Visit the voxels on the segment from p0 to p1 (clipped to the box), in order.
+    // The visitor returns false to stop. Return false if stopped.
+    template <class Visitor>
+    bool traverse(const Eigen::Vector3f &p0, const Eigen::Vector3f &p1, Visitor visit) const;
+
+    Eigen::Vector3f min_, max_;
+    float voxel_size_;
+    int nx_, ny_, nz_;
+    vector<uint8_t> states_;
+    int num_unknown_, num_occupied_, num_views_;
+};
+
+} // namespace my_pcl
+
+#endif
@@ -0,0 +1,54 @@
+/*
+Functions for estimating surface normals and curvature:
+    computeNormalsIntegralImage: for organized clouds (e.g. raw depth camera cloud). O(N).
+    computeNormalsPCA: for unorganized clouds. PCA of k nearest neighbors or neighbors in a radius.
+                       Runs on several threads (pcl::NormalEstimationOMP).
+    orientNormalsTowardsCamera: flip normals so that they point to the camera that saw the points.
+The output normal cloud has the same size and order as the input cloud. Curvature is stored in Normal::curvature.
+*/
+
+#ifndef PCL_NORMALS_H
+#define PCL_NORMALS_H
+
+#include <my_pcl/common_headers.h>
+#include <my_pcl/pcl_spatial_index.h>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+// -- Organized cloud: integral image with covariance matrix method.
+// max_depth_change_factor: depth jumps larger than this (meters, scaled by depth) are treated as edges.
+// normal_smoothing_size: size of the smoothing window, in pixels.
+PointCloud<Normal>::Ptr
+computeNormalsIntegralImage(const PointCloud<PointXYZRGB>::Ptr cloud,
+                            float max_depth_change_factor = 0.02, float normal_smoothing_size = 10.0);
+
+// -- Unorganized cloud: use k_search>0 for k nearest neighbors, or k_search<=0 and radius_search>0 for a radius.
+// num_threads<=0 uses all cores.
+PointCloud<Normal>::Ptr
+computeNormalsPCA(const PointCloud<PointXYZRGB>::Ptr cloud,
+                  int k_search = 20, double radius_search = -1, int num_threads = 0);
+
+// -- Same as above for the valid points of a frame's index, reusing its kdtree.
+// The output is in the order of index.getValidIndices() (i.e. of index.extractValid()).
+PointCloud<Normal>::Ptr
+computeNormalsPCA(FrameSpatialIndex &index, int k_search = 20, double radius_search = -1, int num_threads = 0);
+
+// -- Flip each normal to point to the viewpoint (vx, vy, vz).
+void orientNormalsTowardsViewpoint(const PointCloud<PointXYZRGB>::Ptr cloud, PointCloud<Normal>::Ptr normals,
+                                   float vx, float vy, float vz);
+
+// -- Same as above, with the camera position given by a 4x4 pose T_frame_to_depthcam,
+// where frame is the frame of the cloud.
+void orientNormalsTowardsCamera(const PointCloud<PointXYZRGB>::Ptr cloud, PointCloud<Normal>::Ptr normals,
+                                const vector<vector<float>> &T_frame_to_depthcam);
+
+// -- Put points and normals into one cloud, e.g. for publishing.
+PointCloud<PointXYZRGBNormal>::Ptr
+combinePointsAndNormals(const PointCloud<PointXYZRGB>::Ptr cloud, const PointCloud<Normal>::Ptr normals);
+
+} // namespace my_pcl
+
+#endif
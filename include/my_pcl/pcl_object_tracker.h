@@ -0,0 +1,56 @@
+/*
+ObjectTracker: associate the clusters of each view with the objects on the table, so that each object
+accumulates its own views.
+
+An object is described by the union of the bounding boxes of its clusters (a view sees a part of it,
+so its box grows with the views) and the centroid of its clusters in its last view.
+A cluster matches an object if their boxes overlap by at least min_box_overlap of the smaller box,
+or if their centroids are within max_centroid_distance. It goes to the object of the largest overlap,
+then of the nearest centroid. Several clusters of a view may match one object (e.g. split by an occlusion).
+A cluster that matches no object starts a new one, up to max_objects.
+
+All clouds are in a common frame, e.g. the chessboard frame.
+*/
+
+#ifndef PCL_OBJECT_TRACKER_H
+#define PCL_OBJECT_TRACKER_H
+
+#include <my_pcl/common_headers.h>
+#include <Eigen/Core>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+struct TrackedObject
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    int id;                          // from 0, in order of creation
+    Eigen::Vector3f min_pt, max_pt;  // union of the boxes of its clusters
+    Eigen::Vector3f centroid;        // of its clusters in its last view
+    int num_views;
+};
+
+class ObjectTracker
+{
+public:
+    ObjectTracker(float max_centroid_distance = 0.05, float min_box_overlap = 0.5, int max_objects = 10);
+
+    // The clusters of one view. Return the object ID of each cluster, or -1 (no match, and max_objects objects).
+    vector<int> addView(const vector<PointCloud<PointXYZRGB>::Ptr> &clusters);
+
+    int getNumObjects() const { return objects_.size(); }
+    const TrackedObject &getObject(int id) const { return objects_[id]; }
+
+    void clear(); // e.g. for the next scan
+
+private:
+    float max_centroid_distance_, min_box_overlap_;
+    int max_objects_;
+    vector<TrackedObject, Eigen::aligned_allocator<TrackedObject>> objects_;
+};
+
+} // namespace my_pcl
+
+#endif
@@ -0,0 +1,96 @@
+/*
+Multi-view refinement of the segmented views of a scan.
+
+Each view is already placed in a common frame (the chessboard frame) by the arm pose.
+The remaining error comes from the arm and the calibration, so it is small but different for each view.
+
+MultiViewRegistration:
+    addView: as soon as a view arrives, pairwise ICP between it and its overlapping previous views
+             is queued on a thread pool. So the alignment work is done while the arm is moving.
+    refine:  wait for the ICP jobs, then solve a small pose graph over all views:
+                 nodes: a correction X_k for each view (initially identity, i.e. the arm pose)
+                 edges: X_i^-1 * X_j = T_ij, where T_ij is ICP's transform from view j to view i
+             View 0 is fixed. Other views have a weak prior towards their arm pose.
+The full resolution views are kept as CompactCloud (10 bytes per point) until they are merged.
+*/
+
+#ifndef PCL_REGISTRATION_H
+#define PCL_REGISTRATION_H
+
+#include <my_pcl/common_headers.h>
+#include <my_pcl/pcl_compact.h>
+#include <my_basics/parallel.h>
+
+#include <mutex>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+// Result of one pairwise ICP
+struct ViewAlignment
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    int i, j;
+    Eigen::Matrix4d T_ij; // transform points of view j onto view i
+    double fitness;       // mean squared distance of the correspondences
+    bool converged;
+};
+
+class MultiViewRegistration
+{
+public:
+    // voxel_size: downsample views before ICP.
+    // max_neighbors: align a new view with this many previous views, chosen by closest camera position.
+    //                <=0 to align with all previous views.
+    // max_fitness: pairwise results with a larger mean squared distance are not used.
+    MultiViewRegistration(float voxel_size = 0.005, float max_correspondence_distance = 0.02,
+                          int icp_max_iterations = 50, int max_neighbors = 3,
+                          double max_fitness = 1e-4, int num_threads = 0);
+    ~MultiViewRegistration(); // waits for the queued ICP jobs
+
+    // Add a view in the common frame. camera_pos is the camera center in the same frame.
+    // Return the index of this view.
+    int addView(const PointCloud<PointXYZRGB>::Ptr cloud, const Eigen::Vector3f &camera_pos);
+
+    // Wait for all pairwise alignments, and solve the pose graph by Gauss-Newton.
+    // Return the number of pairwise edges used.
+    int refine(int num_iterations = 10, double prior_weight = 0.01);
+
+    int getNumViews() const { return views_.size(); }
+    Eigen::Matrix4f getCorrection(int i) const { return corrections_[i].cast<float>(); }
+
+    // Views moved by their corrections and merged. voxel_size<=0 to keep all points.
+    PointCloud<PointXYZRGB>::Ptr getMergedCloud(float voxel_size = 0.001) const;
+
+    void clear();
+
+private:
+    MultiViewRegistration(const MultiViewRegistration &);
+    MultiViewRegistration &operator=(const MultiViewRegistration &);
+
+    // Job on the thread pool: align view j (source) to view i (target)
+    void alignPair(int i, int j, PointCloud<PointXYZRGB>::Ptr target, PointCloud<PointXYZRGB>::Ptr source);
+
+    float voxel_size_, max_correspondence_distance_;
+    int icp_max_iterations_, max_neighbors_;
+    double max_fitness_;
+
+    vector<CompactCloud> views_;
+    vector<PointCloud<PointXYZRGB>::Ptr> views_down_;
+    vector<Eigen::Vector3f> camera_pos_;
+    vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> corrections_;
+
+    std::mutex mtx_alignments_;
+    vector<ViewAlignment, Eigen::aligned_allocator<ViewAlignment>> alignments_;
+
+    my_basics::ThreadPool pool_;
+};
+
+} // namespace my_pcl
+
+#endif
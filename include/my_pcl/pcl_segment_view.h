@@ -0,0 +1,95 @@
+/*
+Filtering and segmentation of one view: the steps of node2 between the raw cloud and the segmented object.
+node2 and the offline tools (pcl_test_regression, pcl_tune_params) call these, so they run the same code.
+
+    filtViewByVoxelGrid:   voxel grid by a fixed grid size, or by a point budget (filtByVoxelGridToBudget).
+                           The fixed grid runs on PointXYZRGB, or on the quantized CompactCloud.
+    cropViewInChessFrame:  rotate a cloud of Baxter's frame to the chessboard frame, and crop it by a box.
+                           On PointXYZRGB, or on the quantized CompactCloud.
+    segmentView:           remove the table among the points near z=0 (z histogram or RANSAC),
+                           then cluster: keep the largest cluster, or all clusters for a multi-object scan.
+                           On the cloud (PCL, or CompactCloud's clustering), or on a FrameSpatialIndex
+                           shared by the stages.
+
+ViewSegmentationParams has node2's param names. Its defaults are the values of launch/main_3d_scanner.launch.
+setViewSegmentationParam / readViewSegmentationParams set them by name, e.g. from a "name value" file.
+*/
+
+#ifndef PCL_SEGMENT_VIEW_H
+#define PCL_SEGMENT_VIEW_H
+
+#include <my_pcl/common_headers.h>
+#include <my_pcl/pcl_adaptive_roi.h>
+#include <my_pcl/pcl_spatial_index.h>
+
+#include <boost/shared_ptr.hpp>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+struct ViewSegmentationParams
+{
+    // Voxel grid
+    float x_grid_size = 0.002, y_grid_size = 0.002, z_grid_size = 0.002;
+    int voxel_point_budget = 0; // <= 0: use x/y/z_grid_size
+    float voxel_min_grid_size = 0.002, voxel_max_grid_size = 0.02;
+    double voxel_search_seconds = 0.02;
+
+    // Crop
+    bool flag_do_range_filt = true;
+    bool flag_use_compact_cloud = false; // voxel grid, crop and clustering (without the spatial index)
+    float compact_cloud_resolution = 0.0001;
+
+    // Plane removal
+    float plane_distance_threshold_0 = 0.05, plane_distance_threshold = 0.02;
+    int plane_max_iterations = 100, num_planes = 1;
+    float ratio_of_rest_points = -1; // disabled
+    bool flag_detect_table_by_histogram = false;
+
+    // Clustering
+    bool flag_do_clustering = false;
+    double cluster_tolerance = 0.02;
+    int min_cluster_size = 1000, max_cluster_size = 10000;
+    bool flag_multi_object = false; // keep all clusters
+
+    bool flag_use_spatial_index = false;
+    float spatial_index_voxel_size = 0.02;
+};
+
+struct SegmentedView
+{
+    PointCloud<PointXYZRGB>::Ptr cloud_segmented;
+    vector<PointCloud<PointXYZRGB>::Ptr> cloud_objects; // each cluster, with flag_multi_object
+    boost::shared_ptr<FrameSpatialIndex> index;         // with flag_use_spatial_index. Its valid points are the result
+    int num_table_points;                               // removed by the plane removal
+};
+
+// point_budget, grid_size: the state of the budget search, kept by the caller between views (see
+// filtByVoxelGridToBudget). point_budget <= 0 is set to voxel_point_budget. With a fixed grid, grid_size is set to it.
+PointCloud<PointXYZRGB>::Ptr filtViewByVoxelGrid(const PointCloud<PointXYZRGB>::Ptr cloud,
+                                                 const ViewSegmentationParams &params,
+                                                 int &point_budget, float &grid_size);
+
+// T_chess_to_baxter: transforms points of Baxter's frame to the chessboard frame. box: in the chessboard frame.
+// Without flag_do_range_filt, only rotate.
+PointCloud<PointXYZRGB>::Ptr cropViewInChessFrame(const PointCloud<PointXYZRGB> &cloud_in_baxter_frame,
+                                                  const float T_chess_to_baxter[4][4], const CropBox &box,
+                                                  const ViewSegmentationParams &params);
+
+// cloud: in the chessboard frame, so the table is near z=0.
+void segmentView(const PointCloud<PointXYZRGB>::Ptr cloud, const ViewSegmentationParams &params, SegmentedView &res);
+
+// Return false if there is no such param.
+bool setViewSegmentationParam(ViewSegmentationParams &params, const string &name, double value);
+
+// Lines of "name value"; "#" starts a comment. Return false if the file can't be read or has an unknown name.
+bool readViewSegmentationParams(const string &filename, ViewSegmentationParams &params);
+
+// All params, as (name, value)
+vector<pair<string, double>> getViewSegmentationParams(const ViewSegmentationParams &params);
+
+} // namespace my_pcl
+
+#endif
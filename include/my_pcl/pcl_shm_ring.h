@@ -0,0 +1,107 @@
+/*
+A POSIX shared-memory ring buffer for passing point clouds between processes on the same machine.
+
+One writer (node2) copies each cloud once into a slot of a shm_open/mmap region,
+and publishes a small CloudSlot message (slot index + sequence number) on a ROS topic.
+Any number of local readers map the same region and read the points in place.
+
+Consistency is checked by a per-slot sequence number (a seqlock):
+    odd seq  : the writer is writing this slot.
+    even seq : the slot is stable, and holds the cloud of this seq.
+A reader compares the slot's seq with the one in the descriptor before and after using the data.
+If they differ, the writer has reused the slot and the data must be dropped.
+The writer never waits for readers. A slow reader loses old clouds instead of blocking node2.
+*/
+
+#ifndef PCL_SHM_RING_H
+#define PCL_SHM_RING_H
+
+#include <my_pcl/common_headers.h>
+#include <atomic>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+// What a reader needs to locate a cloud. This is what is sent through the ROS topic.
+struct CloudShmSlotDesc
+{
+    uint32_t slot = 0;
+    uint64_t seq = 0; // Even number. The seq of the slot after the write finished.
+    uint32_t width = 0, height = 0;
+    uint64_t stamp = 0; // pcl header stamp (microseconds)
+};
+
+// Memory layout of the shared region: [ShmRingHeader][ShmSlotHeader+points]*num_slots
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t slot_capacity; // max number of points per slot
+    uint64_t point_size;    // sizeof(PointXYZRGB), to reject readers built with another layout
+    uint64_t slot_stride;   // bytes between two slots
+    std::atomic<uint64_t> write_count;
+};
+
+struct ShmSlotHeader
+{
+    std::atomic<uint64_t> seq;
+    uint32_t width, height;
+    uint64_t stamp;
+};
+
+class CloudShmRingWriter
+{
+public:
+    // Create (or re-create) the shared memory named shm_name, e.g. "/scan3d_cloud_segmented".
+    CloudShmRingWriter(const string &shm_name, int num_slots = 8, int slot_capacity = 1 << 20);
+    ~CloudShmRingWriter(); // unmap and unlink
+    bool isOpen() const { return base_ != NULL; }
+
+    // Copy the cloud into the next slot, and fill in the descriptor to publish.
+    // Return false if the cloud is larger than a slot.
+    bool write(const PointCloud<PointXYZRGB> &cloud, CloudShmSlotDesc &desc);
+
+private:
+    CloudShmRingWriter(const CloudShmRingWriter &);
+    CloudShmRingWriter &operator=(const CloudShmRingWriter &);
+
+    string shm_name_;
+    size_t map_size_;
+    unsigned char *base_;
+};
+
+class CloudShmRingReader
+{
+public:
+    // Map an existing ring created by CloudShmRingWriter. Read only.
+    CloudShmRingReader(const string &shm_name);
+    ~CloudShmRingReader();
+    bool isOpen() const { return base_ != NULL; }
+
+    // Zero copy: return a pointer to the points inside the shared memory, or NULL if the slot
+    // has already been overwritten. After using the points, call validate() with the same desc.
+    const PointXYZRGB *acquire(const CloudShmSlotDesc &desc) const;
+
+    // Return true if the slot still holds the cloud of desc.
+    // If false, anything read from acquire() may be corrupted and should be discarded.
+    bool validate(const CloudShmSlotDesc &desc) const;
+
+    // Copy the slot out into a new cloud. Return false if it was overwritten.
+    bool read(const CloudShmSlotDesc &desc, PointCloud<PointXYZRGB>::Ptr &cloud) const;
+
+private:
+    CloudShmRingReader(const CloudShmRingReader &);
+    CloudShmRingReader &operator=(const CloudShmRingReader &);
+
+    const ShmSlotHeader *getSlot(uint32_t slot) const;
+
+    size_t map_size_;
+    unsigned char *base_;
+};
+
+} // namespace my_pcl
+
+#endif
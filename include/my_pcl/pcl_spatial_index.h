@@ -0,0 +1,87 @@
+/*
+FrameSpatialIndex: neighbor search structures of one frame, built once (after cropping)
+and passed to every stage that needs neighbors.
+
+    voxel hash: built at construction. Radius search, and clustering.
+    kdtree:     built at the first call of getKdTree, over the valid points only. kNN search
+                (statistical outlier removal, normals).
+
+Points are removed by removePoints/keepOnly (e.g. the table after plane removal).
+They are only marked as invalid: the voxel hash skips them (and is compacted when most of its entries
+are invalid), and the kdtree is rebuilt at the next call of getKdTree.
+All indices are indices of the original cloud.
+*/
+
+#ifndef PCL_SPATIAL_INDEX_H
+#define PCL_SPATIAL_INDEX_H
+
+#include <my_pcl/common_headers.h>
+#include <pcl/search/kdtree.h>
+#include <stdint.h>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+class FrameSpatialIndex
+{
+public:
+    // The cloud must not be modified while the index is in use.
+    FrameSpatialIndex(const PointCloud<PointXYZRGB>::Ptr cloud, float voxel_size = 0.02);
+
+    const PointCloud<PointXYZRGB>::Ptr getCloud() const { return cloud_; }
+
+    // -- Invalidation
+    void removePoints(const vector<int> &indices);
+    void keepOnly(const vector<int> &indices); // remove all the others
+    bool isValid(int i) const { return valid_[i]; }
+    int getNumValid() const { return num_valid_; }
+    IndicesConstPtr getValidIndices(); // in ascending order
+    PointCloud<PointXYZRGB>::Ptr extractValid();
+
+    // -- Neighbors
+    // Valid points within radius of point i (including i), by the voxel hash.
+    void radiusSearch(int i, float radius, vector<int> &neighbors) const;
+    // Kdtree over the valid points. Its search results are indices of the original cloud.
+    search::KdTree<PointXYZRGB>::Ptr getKdTree();
+    int getNumKdTreeBuilds() const { return num_kdtree_builds_; }
+
+private:
+    void buildVoxels();
+    void onPointsRemoved(int num_removed);
+
+    PointCloud<PointXYZRGB>::Ptr cloud_;
+    float voxel_size_;
+    unordered_map<uint64_t, vector<int>> voxels_;
+    int num_stale_; // invalid entries left in voxels_
+
+    vector<bool> valid_;
+    int num_valid_;
+    IndicesPtr valid_indices_;              // NULL when out of date
+    search::KdTree<PointXYZRGB>::Ptr tree_; // NULL when out of date
+    int num_kdtree_builds_;
+};
+
+// -- Stages using the index. The removed points are also removed from the index.
+
+// Statistical outlier removal (same rule as pcl::StatisticalOutlierRemoval) on the valid points,
+// with the shared kdtree. Return the number of removed points.
+int filtByStatisticalOutlierRemoval(FrameSpatialIndex &index, float mean_k = 50, float std_dev = 1.0,
+                                    int num_threads = 0);
+
+// Euclidean clustering of the valid points by the voxel hash. Same result as pcl::EuclideanClusterExtraction:
+// clusters sorted by size in descending order, and indices in each cluster sorted.
+vector<PointIndices> divideIntoClusters(const FrameSpatialIndex &index, double cluster_tolerance = 0.02,
+                                        int min_cluster_size = 100, int max_cluster_size = 20000);
+
+// Remove planes among the valid points in candidate_indices (e.g. the points near the table height).
+// Stop criteria and horizontal_first are the same as removePlanes. Return the number of removed planes.
+int removePlanes(FrameSpatialIndex &index, const vector<int> &candidate_indices,
+                 float plane_distance_threshold = 0.01, int plane_max_iterations = 100,
+                 int stop_criteria_num_planes = -1, float stop_criteria_rest_points_ratio = 0.3,
+                 bool horizontal_first = false);
+
+} // namespace my_pcl
+
+#endif
@@ -0,0 +1,136 @@
+/*
+A virtual depth camera, for running the pipeline without the Baxter and the RealSense.
+
+VirtualScene: shapes in the world frame.
+    Rectangles, chessboards, boxes and meshes are stored as triangles in a BVH; spheres are analytic.
+    sampleSurface gives a ground truth cloud of the shapes.
+VirtualDepthCamera: ray casts an organized cloud (one ray per pixel, rows split over threads),
+    in the camera's optical frame like a real depth camera (z forward, x right, y down).
+    Depth noise is gaussian with sigma = sigma_const + sigma_quadratic * z^2, and pixels can drop out at random.
+*/
+
+#ifndef PCL_VIRTUAL_CAMERA_H
+#define PCL_VIRTUAL_CAMERA_H
+
+#include <my_pcl/common_headers.h>
+#include <stdint.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+namespace my_pcl
+{
+
+using namespace pcl;
+
+struct CameraIntrinsics
+{
+    int width = 640, height = 480;
+    float fx = 615, fy = 615, cx = 320, cy = 240; // RealSense D435 color at 640x480
+    float min_depth = 0.2, max_depth = 3.0;
+};
+
+struct DepthNoise
+{
+    float sigma_const = 0.0005, sigma_quadratic = 0.002; // meters, meters^-1
+    float dropout_ratio = 0.0;                           // ratio of pixels without depth
+    unsigned int seed = 0;
+};
+
+class VirtualScene
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    VirtualScene();
+
+    // -- Add shapes. T is the pose of the shape in the world frame. Return the id of the shape.
+    // Rectangle in the local xy plane, centered at the origin.
+    int addRectangle(const Eigen::Matrix4f &T, float size_x, float size_y, uint8_t r, uint8_t g, uint8_t b);
+    // Black and white squares in the local xy plane, centered at the origin.
+    int addChessboard(const Eigen::Matrix4f &T, int rows, int cols, float square_size);
+    // Box centered at the origin.
+    int addBox(const Eigen::Matrix4f &T, float size_x, float size_y, float size_z, uint8_t r, uint8_t g, uint8_t b);
+    int addSphere(const Eigen::Vector3f &center, float radius, uint8_t r, uint8_t g, uint8_t b);
+    int addMesh(const Eigen::Matrix4f &T, const vector<Eigen::Vector3f> &vertices,
+                const vector<Eigen::Vector3i> &triangles, uint8_t r, uint8_t g, uint8_t b);
+    // Return -1 if the file cannot be read.
+    int addMeshFromPLY(const Eigen::Matrix4f &T, const string &filename, uint8_t r, uint8_t g, uint8_t b);
+
+    // Build the BVH. Must be called after adding shapes and before casting rays.
+    void build();
+
+    // Closest hit along origin + t * dir (dir is normalized), with t in (0, max_t).
+    bool intersect(const Eigen::Vector3f &origin, const Eigen::Vector3f &dir, float max_t,
+                   float &t, uint32_t &rgb, int &shape_id) const;
+
+    // Points on the surfaces with about "spacing" meters between them. shape_ids empty: all shapes.
+    PointCloud<PointXYZRGB>::Ptr sampleSurface(float spacing, const vector<int> &shape_ids = vector<int>(),
+                                               unsigned int seed = 0) const;
+
+    int getNumShapes() const { return shapes_.size(); }
+
+private:
+    enum ShapeType
+    {
+        PLAIN,
+        CHESSBOARD,
+        SPHERE
+    };
+    struct Shape
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        ShapeType type;
+        uint32_t rgb;
+        Eigen::Matrix4f T_shape_to_world; // chessboard: to get the local coordinates of a hit
+        int rows, cols;
+        float square_size;
+        Eigen::Vector3f center; // sphere
+        float radius;
+    };
+    struct Triangle
+    {
+        Eigen::Vector3f v0, v1, v2;
+        int shape_id;
+    };
+    struct BVHNode
+    {
+        Eigen::Vector3f box_min, box_max;
+        int left, right;     // children, -1 for a leaf
+        int first, count;    // triangles of a leaf
+    };
+
+    int addShape(const Shape &shape);
+    void addTriangle(const Eigen::Matrix4f &T, const Eigen::Vector3f &v0, const Eigen::Vector3f &v1,
+                     const Eigen::Vector3f &v2, int shape_id);
+    int buildNode(int first, int count);
+    uint32_t getColor(int shape_id, const Eigen::Vector3f &p) const;
+
+    vector<Shape, Eigen::aligned_allocator<Shape>> shapes_;
+    vector<Triangle> triangles_;
+    vector<BVHNode> bvh_;
+    bool is_built_;
+};
+
+class VirtualDepthCamera
+{
+public:
+    VirtualDepthCamera(const CameraIntrinsics &intrinsics = CameraIntrinsics(), const DepthNoise &noise = DepthNoise());
+
+    // Organized cloud (width x height) in the camera frame. Pixels without a hit are NaN.
+    // T_world_to_cam: pose of the camera in the world frame. frame_idx changes the noise of each frame.
+    PointCloud<PointXYZRGB>::Ptr render(const VirtualScene &scene, const Eigen::Matrix4f &T_world_to_cam,
+                                        int frame_idx = 0, int num_threads = 0) const;
+
+    // Pose of a camera at "position" looking at "target", with the image's up side towards "up".
+    static Eigen::Matrix4f lookAt(const Eigen::Vector3f &position, const Eigen::Vector3f &target,
+                                  const Eigen::Vector3f &up = Eigen::Vector3f(0, 0, 1));
+
+private:
+    CameraIntrinsics intrinsics_;
+    DepthNoise noise_;
+};
+
+} // namespace my_pcl
+
+#endif
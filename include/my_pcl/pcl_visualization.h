@@ -8,6 +8,10 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
+#include <thread>
+#include <mutex>
+#include <atomic>
+
 namespace my_pcl
 {
 
@@ -29,6 +33,42 @@ void setViewerPose(boost::shared_ptr<visualization::PCLVisualizer> viewer,
 void setViewerPose(boost::shared_ptr<visualization::PCLVisualizer> viewer,
     double x, double y, double z, double ea_x, double ea_y, double ea_z);
 
+// -- Viewer whose rendering is decoupled from the arrival of clouds.
+// setCloud can be called from any thread (e.g. a ROS spinner thread): it downsamples the cloud to
+// point_budget points into a new back buffer, and swaps it with the pending buffer. It never waits for rendering.
+// The render thread owns the PCLVisualizer, and draws the newest pending cloud. Older ones are skipped.
+class AsyncCloudViewer
+{
+public:
+    AsyncCloudViewer(const string &viewer_name = "viewer_name", const string &cloud_name = "cloud_name",
+                     int point_budget = 300000, double coord_unit = 1.0);
+    ~AsyncCloudViewer(); // stop()
+
+    void start(); // open the window in the render thread
+    void stop();
+    bool isRunning() const { return running_; } // false after the window is closed
+
+    void setCloud(const PointCloud<PointXYZRGB>::ConstPtr cloud);
+
+    int getNumReceived() const { return num_received_; }
+    int getNumRendered() const { return num_rendered_; }
+
+private:
+    AsyncCloudViewer(const AsyncCloudViewer &);
+    AsyncCloudViewer &operator=(const AsyncCloudViewer &);
+    void renderLoop();
+
+    string viewer_name_, cloud_name_;
+    int point_budget_;
+    double coord_unit_;
+
+    std::mutex mtx_pending_; // only held to swap a pointer
+    PointCloud<PointXYZRGB>::Ptr pending_;
+
+    std::thread render_thread_;
+    std::atomic<bool> running_, stop_requested_;
+    std::atomic<int> num_received_, num_rendered_;
+};
 
 } // namespace my_pcl
 
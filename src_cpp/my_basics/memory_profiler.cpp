@@ -0,0 +1,230 @@
+#include "my_basics/memory_profiler.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef PROFILE_MEMORY
+#include <malloc.h>
+#endif
+
+namespace my_basics
+{
+
+// Zero-initialized before any code runs, so malloc can be counted from the start of the process.
+static std::atomic<uint64_t> stage_num_allocs[MAX_MEMORY_STAGES];
+static std::atomic<uint64_t> stage_bytes[MAX_MEMORY_STAGES];
+static std::atomic<int64_t> heap_bytes, peak_heap_bytes;
+static __thread int current_stage __attribute__((tls_model("initial-exec"))) = 0;
+
+static std::mutex mtx_stage_names;
+static std::vector<std::string> &stageNames()
+{
+    static std::vector<std::string> names(1, "other");
+    return names;
+}
+
+bool isMemoryProfilingEnabled()
+{
+#ifdef PROFILE_MEMORY
+    return true;
+#else
+    return false;
+#endif
+}
+
+int getMemoryStage(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mtx_stage_names);
+    std::vector<std::string> &names = stageNames();
+    for (size_t i = 0; i < names.size(); i++)
+        if (names[i] == name)
+            return i;
+    if ((int)names.size() >= MAX_MEMORY_STAGES)
+        return 0;
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+std::string getMemoryStageName(int stage)
+{
+    std::lock_guard<std::mutex> lock(mtx_stage_names);
+    return stageNames()[stage];
+}
+
+int getNumMemoryStages()
+{
+    std::lock_guard<std::mutex> lock(mtx_stage_names);
+    return stageNames().size();
+}
+
+MemoryStageStats getMemoryStageStats(int stage)
+{
+    MemoryStageStats stats;
+    stats.num_allocs = stage_num_allocs[stage].load(std::memory_order_relaxed);
+    stats.bytes = stage_bytes[stage].load(std::memory_order_relaxed);
+    return stats;
+}
+
+int64_t getHeapBytes() { return heap_bytes.load(std::memory_order_relaxed); }
+int64_t getPeakHeapBytes() { return peak_heap_bytes.load(std::memory_order_relaxed); }
+
+int64_t getPeakRssBytes()
+{
+    std::ifstream fin("/proc/self/status");
+    std::string line;
+    while (std::getline(fin, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::atoll(line.c_str() + 6) * 1024; // in kB
+    return 0;
+}
+
+void resetMemoryStats()
+{
+    for (int i = 0; i < MAX_MEMORY_STAGES; i++)
+        stage_num_allocs[i] = 0, stage_bytes[i] = 0;
+    peak_heap_bytes = heap_bytes.load();
+}
+
+std::string getMemoryReport()
+{
+    std::ostringstream oss;
+    char buf[128];
+    for (int i = 0; i < getNumMemoryStages(); i++)
+    {
+        MemoryStageStats stats = getMemoryStageStats(i);
+        if (stats.num_allocs == 0)
+            continue;
+        snprintf(buf, sizeof(buf), "%-24s %10llu allocs, %10.2f MB\n", getMemoryStageName(i).c_str(),
+                 (unsigned long long)stats.num_allocs, stats.bytes / 1e6);
+        oss << buf;
+    }
+    snprintf(buf, sizeof(buf), "heap %.2f MB (peak %.2f MB), peak RSS %.2f MB\n",
+             getHeapBytes() / 1e6, getPeakHeapBytes() / 1e6, getPeakRssBytes() / 1e6);
+    oss << buf;
+    return oss.str();
+}
+
+MemoryStage::MemoryStage(int stage) : prev_(current_stage)
+{
+    current_stage = (stage >= 0 && stage < MAX_MEMORY_STAGES) ? stage : 0;
+}
+
+MemoryStage::~MemoryStage() { current_stage = prev_; }
+
+int MemoryStage::current() { return current_stage; }
+
+#ifdef PROFILE_MEMORY
+// Called from inside malloc: must not allocate.
+static inline void countAlloc(void *p)
+{
+    size_t n = malloc_usable_size(p);
+    stage_num_allocs[current_stage].fetch_add(1, std::memory_order_relaxed);
+    stage_bytes[current_stage].fetch_add(n, std::memory_order_relaxed);
+    int64_t heap = heap_bytes.fetch_add(n, std::memory_order_relaxed) + n;
+    int64_t peak = peak_heap_bytes.load(std::memory_order_relaxed);
+    while (heap > peak && !peak_heap_bytes.compare_exchange_weak(peak, heap, std::memory_order_relaxed))
+        ;
+}
+
+static inline void countFree(void *p)
+{
+    heap_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+}
+#endif
+
+} // namespace my_basics
+
+#ifdef PROFILE_MEMORY
+// -- Interpose the malloc family of glibc. operator new calls malloc, so it is counted too.
+// All the allocating functions are hooked, since free can't tell a block that was not counted.
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t num, size_t size);
+    void *__libc_realloc(void *p, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void *__libc_valloc(size_t size);
+    void *__libc_pvalloc(size_t size);
+    void __libc_free(void *p);
+
+    void *malloc(size_t size)
+    {
+        void *p = __libc_malloc(size);
+        if (p)
+            my_basics::countAlloc(p);
+        return p;
+    }
+
+    void *calloc(size_t num, size_t size)
+    {
+        void *p = __libc_calloc(num, size);
+        if (p)
+            my_basics::countAlloc(p);
+        return p;
+    }
+
+    void *realloc(void *p, size_t size)
+    {
+        if (p)
+            my_basics::countFree(p);
+        void *q = __libc_realloc(p, size);
+        if (q)
+            my_basics::countAlloc(q);
+        else if (p && size) // failed: p is still allocated
+            my_basics::countAlloc(p);
+        return q;
+    }
+
+    void *memalign(size_t alignment, size_t size)
+    {
+        void *p = __libc_memalign(alignment, size);
+        if (p)
+            my_basics::countAlloc(p);
+        return p;
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size) { return memalign(alignment, size); }
+
+    void *valloc(size_t size)
+    {
+        void *p = __libc_valloc(size);
+        if (p)
+            my_basics::countAlloc(p);
+        return p;
+    }
+
+    void *pvalloc(size_t size)
+    {
+        void *p = __libc_pvalloc(size);
+        if (p)
+            my_basics::countAlloc(p);
+        return p;
+    }
+
+    int posix_memalign(void **res, size_t alignment, size_t size)
+    {
+        // A power of two multiple of sizeof(void *), as glibc requires. memalign would round it up instead.
+        if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+            return EINVAL;
+        void *p = memalign(alignment, size);
+        if (!p)
+            return ENOMEM;
+        *res = p;
+        return 0;
+    }
+
+    void free(void *p)
+    {
+        if (!p)
+            return;
+        my_basics::countFree(p);
+        __libc_free(p);
+    }
+}
+#endif
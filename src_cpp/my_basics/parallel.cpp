@@ -0,0 +1,115 @@
+#include "my_basics/parallel.h"
+#include "my_basics/memory_profiler.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace my_basics
+{
+
+int getNumThreads(int num_threads)
+{
+    if (num_threads > 0)
+        return num_threads;
+    int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+void parallelFor(int begin, int end, const std::function<void(int, int, int)> &func,
+                 int num_threads, int min_chunk_size)
+{
+    int total = end - begin;
+    if (total <= 0)
+        return;
+    num_threads = std::min(getNumThreads(num_threads), std::max(1, total / std::max(1, min_chunk_size)));
+    if (num_threads == 1)
+    {
+        func(begin, end, 0);
+        return;
+    }
+
+    // The calling thread takes the last chunk.
+    const int stage = MemoryStage::current();
+    std::vector<std::thread> threads;
+    int chunk = (total + num_threads - 1) / num_threads;
+    for (int t = 0; t < num_threads - 1; t++)
+    {
+        int b = begin + t * chunk, e = std::min(end, b + chunk);
+        if (b >= e)
+            break;
+        threads.push_back(std::thread([&func, b, e, t, stage]() {
+            MemoryStage memory_stage(stage); // the allocations belong to the caller's stage
+            func(b, e, t);
+        }));
+    }
+    int b = begin + (num_threads - 1) * chunk;
+    if (b < end)
+        func(b, end, num_threads - 1);
+    for (std::thread &th : threads)
+        th.join();
+}
+
+// ------------------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(int num_threads) : num_unfinished_(0), stop_(false)
+{
+    num_threads = my_basics::getNumThreads(num_threads);
+    for (int i = 0; i < num_threads; i++)
+        workers_.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_task_.notify_all();
+    for (std::thread &th : workers_)
+        th.join();
+}
+
+void ThreadPool::push(const std::function<void()> &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        const int stage = MemoryStage::current(); // the allocations of the task belong to the pusher's stage
+        tasks_.push_back([task, stage]() {
+            MemoryStage memory_stage(stage);
+            task();
+        });
+        num_unfinished_++;
+    }
+    cv_task_.notify_one();
+}
+
+void ThreadPool::waitAll()
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_done_.wait(lock, [this] { return num_unfinished_ == 0; });
+}
+
+void ThreadPool::workerLoop()
+{
+    while (1)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_task_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) // stop_ and nothing left to do
+                return;
+            task = tasks_.front();
+            tasks_.pop_front();
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            num_unfinished_--;
+        }
+        cv_done_.notify_all();
+    }
+}
+
+} // namespace my_basics
@@ -0,0 +1,60 @@
+#include "my_basics/pose_interpolator.h"
+
+#include <algorithm>
+
+namespace my_basics
+{
+
+PoseInterpolator::PoseInterpolator(double buffer_seconds, double max_gap)
+    : buffer_seconds_(buffer_seconds), max_gap_(max_gap) {}
+
+void PoseInterpolator::push(double stamp, const Eigen::Matrix4f &T)
+{
+    if (poses_.empty() || stamp > poses_.back().first)
+        poses_.push_back(StampedPose(stamp, T));
+    else
+    {
+        auto it = std::lower_bound(poses_.begin(), poses_.end(), stamp,
+                                   [](const StampedPose &p, double s) { return p.first < s; });
+        if (it != poses_.end() && it->first == stamp)
+            it->second = T;
+        else
+            poses_.insert(it, StampedPose(stamp, T));
+    }
+    while (poses_.front().first < poses_.back().first - buffer_seconds_)
+        poses_.pop_front();
+}
+
+PoseInterpolator::Result PoseInterpolator::interpolate(double stamp, Eigen::Matrix4f &T) const
+{
+    if (poses_.empty() || stamp > poses_.back().first)
+        return TOO_NEW;
+    if (stamp < poses_.front().first)
+        return TOO_OLD;
+
+    // The first pose not older than stamp
+    auto it = std::lower_bound(poses_.begin(), poses_.end(), stamp,
+                               [](const StampedPose &p, double s) { return p.first < s; });
+    if (it->first == stamp)
+    {
+        T = it->second;
+        return OK;
+    }
+    const StampedPose &p0 = *(it - 1), &p1 = *it;
+    if (p1.first - p0.first > max_gap_)
+        return GAP;
+    T = interpolatePose(p0.second, p1.second, (stamp - p0.first) / (p1.first - p0.first));
+    return OK;
+}
+
+Eigen::Matrix4f interpolatePose(const Eigen::Matrix4f &T0, const Eigen::Matrix4f &T1, float t)
+{
+    Eigen::Quaternionf q0(Eigen::Matrix3f(T0.block<3, 3>(0, 0)));
+    Eigen::Quaternionf q1(Eigen::Matrix3f(T1.block<3, 3>(0, 0)));
+    Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+    T.block<3, 3>(0, 0) = q0.normalized().slerp(t, q1.normalized()).toRotationMatrix();
+    T.block<3, 1>(0, 3) = (1 - t) * T0.block<3, 1>(0, 3) + t * T1.block<3, 1>(0, 3);
+    return T;
+}
+
+} // namespace my_basics
@@ -0,0 +1,72 @@
+#include "my_basics/trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+
+namespace my_basics
+{
+
+TraceRecorder::TraceRecorder(const std::string &process_name, bool enabled, size_t max_events)
+    : process_name_(process_name), enabled_(enabled), max_events_(max_events), warned_full_(false)
+{
+}
+
+double TraceRecorder::now()
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecorder::record(const std::string &name, double t_begin, double t_end, uint64_t trace_id,
+                           int64_t stamp_us)
+{
+    if (!enabled_)
+        return;
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (events_.size() >= max_events_)
+    {
+        if (!warned_full_)
+            std::cout << "my WARNING: TraceRecorder of " << process_name_ << " is full. Later events are dropped."
+                      << std::endl;
+        warned_full_ = true;
+        return;
+    }
+    std::map<std::thread::id, int>::iterator it = tids_.find(std::this_thread::get_id());
+    if (it == tids_.end())
+        it = tids_.insert(std::make_pair(std::this_thread::get_id(), (int)tids_.size())).first;
+    Event e = {name, t_begin, t_end, trace_id, stamp_us, it->second};
+    events_.push_back(e);
+}
+
+size_t TraceRecorder::getNumEvents() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return events_.size();
+}
+
+bool TraceRecorder::write(const std::string &filename) const
+{
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (!fp)
+    {
+        std::cout << "my WARNING: can't write the trace to " << filename << std::endl;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    const int pid = getpid();
+    fprintf(fp, "{\"traceEvents\": [\n");
+    fprintf(fp, "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": %d, \"args\": {\"name\": \"%s\"}}",
+            pid, process_name_.c_str());
+    // Complete events. ts and dur are in microseconds.
+    for (const Event &e : events_)
+        fprintf(fp, ",\n{\"ph\": \"X\", \"cat\": \"view\", \"name\": \"%s\", \"pid\": %d, \"tid\": %d, "
+                    "\"ts\": %.1f, \"dur\": %.1f, "
+                    "\"args\": {\"scan\": %u, \"view\": %u, \"stamp_us\": %lld}}",
+                e.name.c_str(), pid, e.tid, e.t_begin * 1e6, (e.t_end - e.t_begin) * 1e6,
+                getTraceScan(e.trace_id), getTraceView(e.trace_id), (long long)e.stamp_us);
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
+
+} // namespace my_basics
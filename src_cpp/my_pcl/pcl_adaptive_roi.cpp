@@ -0,0 +1,91 @@
+#include "my_pcl/pcl_adaptive_roi.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace my_pcl
+{
+
+AdaptiveCropBox::AdaptiveCropBox(float margin, int min_views, float outlier_ratio, int min_points)
+    : margin_(margin), outlier_ratio_(outlier_ratio), min_views_(max(min_views, 1)), min_points_(max(min_points, 1))
+{
+    assert(margin >= 0 && outlier_ratio >= 0 && outlier_ratio < 0.5);
+    clear();
+}
+
+void AdaptiveCropBox::clear()
+{
+    num_views_ = 0;
+    min_pt_.setConstant(std::numeric_limits<float>::max());
+    max_pt_.setConstant(-std::numeric_limits<float>::max());
+}
+
+void AdaptiveCropBox::addView(const PointCloud<PointXYZRGB> &cloud_object)
+{
+    vector<float> coords[3];
+    for (int d = 0; d < 3; d++)
+        coords[d].reserve(cloud_object.points.size());
+    for (const PointXYZRGB &p : cloud_object.points)
+    {
+        if (!pcl::isFinite(p))
+            continue;
+        coords[0].push_back(p.x), coords[1].push_back(p.y), coords[2].push_back(p.z);
+    }
+    const int n = coords[0].size();
+    if (n < min_points_)
+        return;
+
+    // Robust extent of each axis: the outlier_ratio quantile from each side
+    const int k_low = (int)(outlier_ratio_ * (n - 1)), k_up = n - 1 - k_low;
+    for (int d = 0; d < 3; d++)
+    {
+        vector<float> &c = coords[d];
+        std::nth_element(c.begin(), c.begin() + k_low, c.end());
+        min_pt_[d] = min(min_pt_[d], c[k_low]);
+        std::nth_element(c.begin() + k_low, c.begin() + k_up, c.end());
+        max_pt_[d] = max(max_pt_[d], c[k_up]);
+    }
+    num_views_++;
+}
+
+bool AdaptiveCropBox::shrinkBox(CropBox &box) const
+{
+    if (!isReady())
+        return false;
+    box.x_min = max(box.x_min, min_pt_.x() - margin_);
+    box.x_max = min(box.x_max, max_pt_.x() + margin_);
+    box.y_min = max(box.y_min, min_pt_.y() - margin_);
+    box.y_max = min(box.y_max, max_pt_.y() + margin_);
+    box.z_max = min(box.z_max, max_pt_.z() + margin_);
+    // The object is outside the box (e.g. the box of another stream): keep an empty box rather than an inverted one
+    box.x_max = max(box.x_max, box.x_min);
+    box.y_max = max(box.y_max, box.y_min);
+    box.z_max = max(box.z_max, box.z_min);
+    return true;
+}
+
+PointCloud<PointXYZRGB>::Ptr cropByBoxInFrame(const PointCloud<PointXYZRGB> &cloud,
+                                              const Eigen::Matrix4f &T_box_to_cloud, const CropBox &box)
+{
+    const Eigen::Matrix3f R = T_box_to_cloud.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = T_box_to_cloud.block<3, 1>(0, 3);
+    PointCloud<PointXYZRGB>::Ptr cloud_cropped(new PointCloud<PointXYZRGB>);
+    cloud_cropped->header = cloud.header;
+    cloud_cropped->points.reserve(cloud.points.size());
+    for (const PointXYZRGB &p : cloud.points)
+    {
+        if (!pcl::isFinite(p))
+            continue;
+        Eigen::Vector3f q = R * Eigen::Vector3f(p.x, p.y, p.z) + t;
+        if (q.x() >= box.x_min && q.x() <= box.x_max && q.y() >= box.y_min && q.y() <= box.y_max &&
+            q.z() >= box.z_min && q.z() <= box.z_max)
+            cloud_cropped->points.push_back(p);
+    }
+    cloud_cropped->width = cloud_cropped->points.size();
+    cloud_cropped->height = 1;
+    cloud_cropped->is_dense = true;
+    return cloud_cropped;
+}
+
+} // namespace my_pcl
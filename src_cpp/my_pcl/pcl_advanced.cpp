@@ -30,7 +30,7 @@ vector<PointCloud<PointXYZRGB>::Ptr> extractSubCloudsByIndices(
 int removePlanes(PointCloud<PointXYZRGB>::Ptr &cloud,
     float plane_distance_threshold, int plane_max_iterations,
     int stop_criteria_num_planes, float stop_criteria_rest_points_ratio,
-    bool print_res)
+    bool print_res, bool horizontal_first)
 {
     assert(stop_criteria_num_planes>=0 || stop_criteria_rest_points_ratio>=0);
     int total_points = (int)cloud->points.size();
@@ -45,8 +45,11 @@ int removePlanes(PointCloud<PointXYZRGB>::Ptr &cloud,
         // -- detectPlane
         ModelCoefficients::Ptr coefficients;
         PointIndices::Ptr inliers;
-        bool res = detectPlane(cloud, coefficients, inliers,
-            plane_distance_threshold, plane_max_iterations);
+        bool res = horizontal_first && cnt_planes == 1 &&
+                   detectHorizontalPlane(cloud, coefficients, inliers, plane_distance_threshold);
+        if (!res)
+            res = detectPlane(cloud, coefficients, inliers,
+                plane_distance_threshold, plane_max_iterations);
         if (res==false){
             cnt_planes--;
             cout<<"my WARNING: removePlanes' iteration fails to reach the desired times."<<endl;
@@ -0,0 +1,240 @@
+#include "my_pcl/pcl_archive.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // pwrite, close
+
+namespace my_pcl
+{
+
+static const char SCAN_ARCHIVE_MAGIC[8] = {'S', 'C', 'A', 'N', 'A', 'R', 'C', '1'};
+static const uint32_t SCAN_ARCHIVE_VERSION = 1;
+static const uint64_t ARCHIVE_ALIGN = 64;
+
+static_assert(sizeof(ScanArchiveHeader) % ARCHIVE_ALIGN == 0, "archive header must keep 64-byte alignment");
+static_assert(sizeof(ScanArchiveFrame) % ARCHIVE_ALIGN == 0, "archive index entry must keep 64-byte alignment");
+
+static uint64_t alignUp(uint64_t n) { return (n + ARCHIVE_ALIGN - 1) / ARCHIVE_ALIGN * ARCHIVE_ALIGN; }
+
+// ------------------------------------------------------------------------------------
+
+ScanArchiveWriter::ScanArchiveWriter(const string &filename, int max_frames)
+    : fd_(-1), end_offset_(0)
+{
+    assert(max_frames > 0);
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, SCAN_ARCHIVE_MAGIC, sizeof(header_.magic));
+    header_.version = SCAN_ARCHIVE_VERSION;
+    header_.max_frames = max_frames;
+    header_.num_frames = 0;
+    header_.point_size = sizeof(PointXYZRGB);
+    header_.index_offset = sizeof(ScanArchiveHeader);
+    header_.data_offset = alignUp(header_.index_offset + max_frames * sizeof(ScanArchiveFrame));
+    end_offset_ = header_.data_offset;
+
+    fd_ = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd_ == -1)
+    {
+        cout << "my ERROR: fail to create archive " << filename << ": " << strerror(errno) << endl;
+        return;
+    }
+    // Header + an empty frame index
+    vector<char> zeros(header_.data_offset - header_.index_offset, 0);
+    if (!writeAt(0, &header_, sizeof(header_)) ||
+        !writeAt(header_.index_offset, zeros.data(), zeros.size()))
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+ScanArchiveWriter::~ScanArchiveWriter()
+{
+    if (fd_ != -1)
+        close(fd_);
+}
+
+bool ScanArchiveWriter::writeAt(uint64_t offset, const void *data, size_t size)
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd_, p, size, offset);
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+                continue;
+            cout << "my ERROR: fail to write archive: " << strerror(errno) << endl;
+            return false;
+        }
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool ScanArchiveWriter::appendFrame(const vector<vector<float>> &T_baxter_to_depthcam,
+                                    const PointCloud<PointXYZRGB>::Ptr cloud_src,
+                                    const PointCloud<PointXYZRGB>::Ptr cloud_segmented)
+{
+    assert(T_baxter_to_depthcam.size() == 4 && T_baxter_to_depthcam[0].size() == 4);
+    if (fd_ == -1)
+        return false;
+    if (header_.num_frames >= header_.max_frames)
+    {
+        cout << "my WARNING: scan archive is full (" << header_.max_frames << " frames)" << endl;
+        return false;
+    }
+
+    // -- Fill in the index entry
+    ScanArchiveFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            frame.T_baxter_to_depthcam[i * 4 + j] = T_baxter_to_depthcam[i][j];
+    frame.stamp = cloud_src->header.stamp;
+    frame.frame_idx = header_.num_frames + 1;
+
+    bool is_organized = cloud_src->points.size() == (size_t)cloud_src->width * cloud_src->height;
+    frame.src_width = is_organized ? cloud_src->width : cloud_src->points.size();
+    frame.src_height = is_organized ? cloud_src->height : 1;
+    frame.src_offset = end_offset_;
+    frame.segmented_offset = alignUp(frame.src_offset + cloud_src->points.size() * sizeof(PointXYZRGB));
+    frame.segmented_size = cloud_segmented->points.size();
+    uint64_t new_end = alignUp(frame.segmented_offset + cloud_segmented->points.size() * sizeof(PointXYZRGB));
+
+    // -- Data first, then index entry, then the frame count that commits them
+    if (!writeAt(frame.src_offset, cloud_src->points.data(), cloud_src->points.size() * sizeof(PointXYZRGB)) ||
+        !writeAt(frame.segmented_offset, cloud_segmented->points.data(),
+                 cloud_segmented->points.size() * sizeof(PointXYZRGB)))
+        return false;
+    if (new_end > frame.segmented_offset + cloud_segmented->points.size() * sizeof(PointXYZRGB))
+    { // pad the file to the aligned end, so the reader can map it whole
+        char zero = 0;
+        if (!writeAt(new_end - 1, &zero, 1))
+            return false;
+    }
+    uint64_t entry_offset = header_.index_offset + header_.num_frames * sizeof(ScanArchiveFrame);
+    if (!writeAt(entry_offset, &frame, sizeof(frame)))
+        return false;
+    header_.num_frames++;
+    if (!writeAt(0, &header_, sizeof(header_)))
+        return false;
+    end_offset_ = new_end;
+    return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+ScanArchiveReader::ScanArchiveReader(const string &filename)
+    : map_size_(0), base_(NULL)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        cout << "my ERROR: fail to open archive " << filename << ": " << strerror(errno) << endl;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(ScanArchiveHeader))
+    {
+        cout << "my ERROR: " << filename << " is not a scan archive" << endl;
+        close(fd);
+        return;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        cout << "my ERROR: fail to mmap archive " << filename << ": " << strerror(errno) << endl;
+        return;
+    }
+
+    // -- Check header, that the frame index and every committed frame lie inside the file
+    const ScanArchiveHeader *header = static_cast<const ScanArchiveHeader *>(p);
+    bool is_valid = memcmp(header->magic, SCAN_ARCHIVE_MAGIC, sizeof(header->magic)) == 0 &&
+                    header->version == SCAN_ARCHIVE_VERSION &&
+                    header->point_size == sizeof(PointXYZRGB) &&
+                    header->num_frames <= header->max_frames &&
+                    header->data_offset <= (uint64_t)st.st_size &&
+                    header->index_offset <= (uint64_t)st.st_size &&
+                    (uint64_t)header->max_frames * sizeof(ScanArchiveFrame) <= (uint64_t)st.st_size - header->index_offset;
+    for (uint32_t i = 0; is_valid && i < header->num_frames; i++)
+    {
+        const ScanArchiveFrame *frame = reinterpret_cast<const ScanArchiveFrame *>(
+            static_cast<const unsigned char *>(p) + header->index_offset) + i;
+        is_valid = frame->src_offset + (uint64_t)frame->src_width * frame->src_height * sizeof(PointXYZRGB) <= (uint64_t)st.st_size &&
+                   frame->segmented_offset + (uint64_t)frame->segmented_size * sizeof(PointXYZRGB) <= (uint64_t)st.st_size;
+    }
+    if (!is_valid)
+    {
+        cout << "my ERROR: " << filename << " is not a valid scan archive" << endl;
+        munmap(p, st.st_size);
+        return;
+    }
+    map_size_ = st.st_size;
+    base_ = static_cast<unsigned char *>(p);
+}
+
+ScanArchiveReader::~ScanArchiveReader()
+{
+    if (base_ != NULL)
+        munmap(base_, map_size_);
+}
+
+int ScanArchiveReader::getNumFrames() const
+{
+    if (base_ == NULL)
+        return 0;
+    return reinterpret_cast<const ScanArchiveHeader *>(base_)->num_frames;
+}
+
+const ScanArchiveFrame &ScanArchiveReader::getFrame(int i) const
+{
+    assert(i >= 0 && i < getNumFrames());
+    const ScanArchiveHeader *header = reinterpret_cast<const ScanArchiveHeader *>(base_);
+    return reinterpret_cast<const ScanArchiveFrame *>(base_ + header->index_offset)[i];
+}
+
+const PointXYZRGB *ScanArchiveReader::getCloudSrcPoints(int i) const
+{
+    return reinterpret_cast<const PointXYZRGB *>(base_ + getFrame(i).src_offset);
+}
+
+const PointXYZRGB *ScanArchiveReader::getCloudSegmentedPoints(int i) const
+{
+    return reinterpret_cast<const PointXYZRGB *>(base_ + getFrame(i).segmented_offset);
+}
+
+void ScanArchiveReader::readFrame(int i, vector<vector<float>> &T_baxter_to_depthcam,
+                                  PointCloud<PointXYZRGB>::Ptr &cloud_src,
+                                  PointCloud<PointXYZRGB>::Ptr &cloud_segmented) const
+{
+    const ScanArchiveFrame &frame = getFrame(i);
+
+    T_baxter_to_depthcam.assign(4, vector<float>(4, 0));
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            T_baxter_to_depthcam[r][c] = frame.T_baxter_to_depthcam[r * 4 + c];
+
+    const PointXYZRGB *src = getCloudSrcPoints(i);
+    cloud_src.reset(new PointCloud<PointXYZRGB>);
+    cloud_src->points.assign(src, src + frame.src_width * frame.src_height);
+    cloud_src->width = frame.src_width;
+    cloud_src->height = frame.src_height;
+    cloud_src->header.stamp = frame.stamp;
+    cloud_src->is_dense = false;
+
+    const PointXYZRGB *seg = getCloudSegmentedPoints(i);
+    cloud_segmented.reset(new PointCloud<PointXYZRGB>);
+    cloud_segmented->points.assign(seg, seg + frame.segmented_size);
+    cloud_segmented->width = frame.segmented_size;
+    cloud_segmented->height = 1;
+    cloud_segmented->header.stamp = frame.stamp;
+}
+
+} // namespace my_pcl
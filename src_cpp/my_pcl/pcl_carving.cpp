@@ -0,0 +1,148 @@
+#include "my_pcl/pcl_carving.h"
+#include "my_basics/parallel.h"
+
+#include <cmath>
+#include <limits>
+
+namespace my_pcl
+{
+
+FreeSpaceCarving::FreeSpaceCarving(float pixel_angle, float margin, int min_votes, int max_buffer_size)
+    : pixel_angle_(pixel_angle), margin_(margin), min_votes_(min_votes), max_buffer_size_(max_buffer_size)
+{
+    assert(pixel_angle > 0 && min_votes >= 1);
+}
+
+bool FreeSpaceCarving::project(const CameraPose &pose, const Eigen::Vector3f &p, float &z, int &u, int &v) const
+{
+    Eigen::Vector3f q = pose.R_camera_to_world * p + pose.t_camera_to_world;
+    z = q.z();
+    if (z <= 1e-6f)
+        return false;
+    u = std::floor(q.x() / z / pixel_angle_);
+    v = std::floor(q.y() / z / pixel_angle_);
+    return true;
+}
+
+void FreeSpaceCarving::addView(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_world_to_camera)
+{
+    buffers_.push_back(DepthBuffer());
+    DepthBuffer &buffer = buffers_.back();
+    poses_.push_back(CameraPose());
+    CameraPose &pose = poses_.back();
+    pose.R_camera_to_world = T_world_to_camera.block<3, 3>(0, 0).transpose();
+    pose.t_camera_to_world = -pose.R_camera_to_world * T_world_to_camera.block<3, 1>(0, 3);
+
+    // -- Pixels of the points, and the bounds of the buffer
+    vector<int> us, vs;
+    vector<float> zs;
+    int u_min = std::numeric_limits<int>::max(), v_min = u_min, u_max = std::numeric_limits<int>::min(), v_max = u_max;
+    for (const PointXYZRGB &p : cloud.points)
+    {
+        float z;
+        int u, v;
+        if (!std::isfinite(p.x) || !project(pose, Eigen::Vector3f(p.x, p.y, p.z), z, u, v))
+            continue;
+        us.push_back(u), vs.push_back(v), zs.push_back(z);
+        u_min = min(u_min, u), u_max = max(u_max, u);
+        v_min = min(v_min, v), v_max = max(v_max, v);
+    }
+    if (zs.empty())
+    {
+        buffer.u0 = buffer.v0 = buffer.width = buffer.height = 0;
+        return;
+    }
+    buffer.u0 = u_min, buffer.v0 = v_min;
+    buffer.width = min(u_max - u_min + 1, max_buffer_size_);
+    buffer.height = min(v_max - v_min + 1, max_buffer_size_);
+    if (buffer.width < u_max - u_min + 1 || buffer.height < v_max - v_min + 1)
+        cout << "my WARNING: FreeSpaceCarving: the view is wider than the depth buffer. Increase pixel_angle." << endl;
+
+    // -- Nearest depth of each pixel
+    buffer.depth.assign(buffer.width * buffer.height, std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < zs.size(); i++)
+    {
+        int du = us[i] - buffer.u0, dv = vs[i] - buffer.v0;
+        if (du >= buffer.width || dv >= buffer.height)
+            continue;
+        float &d = buffer.depth[dv * buffer.width + du];
+        d = min(d, zs[i]);
+    }
+}
+
+int FreeSpaceCarving::countFreeVotes(const Eigen::Vector3f &p) const
+{
+    return countFreeVotes(p, poses_);
+}
+
+int FreeSpaceCarving::countFreeVotes(const Eigen::Vector3f &p, const CameraPoses &poses) const
+{
+    int votes = 0;
+    for (size_t k = 0; k < buffers_.size(); k++)
+    {
+        const DepthBuffer &buffer = buffers_[k];
+        float z;
+        int u, v;
+        if (!project(poses[k], p, z, u, v))
+            continue;
+        int du = u - buffer.u0, dv = v - buffer.v0;
+        if (du < 0 || du >= buffer.width || dv < 0 || dv >= buffer.height ||
+            !std::isfinite(buffer.depth[dv * buffer.width + du]))
+            continue; // no observation along this ray
+
+        // The nearest surface around the ray, so that edges of the surfaces don't vote
+        float nearest = std::numeric_limits<float>::infinity();
+        for (int y = max(dv - 1, 0); y <= min(dv + 1, buffer.height - 1); y++)
+            for (int x = max(du - 1, 0); x <= min(du + 1, buffer.width - 1); x++)
+                nearest = min(nearest, buffer.depth[y * buffer.width + x]);
+        votes += nearest > z + margin_;
+    }
+    return votes;
+}
+
+PointCloud<PointXYZRGB>::Ptr FreeSpaceCarving::carve(const PointCloud<PointXYZRGB> &cloud, int num_threads) const
+{
+    return carveByPoses(cloud, poses_, num_threads);
+}
+
+PointCloud<PointXYZRGB>::Ptr FreeSpaceCarving::carve(const PointCloud<PointXYZRGB> &cloud,
+                                                     const Corrections &corrections, int num_threads) const
+{
+    assert(corrections.size() == poses_.size());
+    // The camera moves by the correction X: world to camera is T^-1 * X^-1
+    CameraPoses poses(poses_.size());
+    for (size_t k = 0; k < poses_.size(); k++)
+    {
+        const Eigen::Matrix3f R_x = corrections[k].block<3, 3>(0, 0);
+        const Eigen::Vector3f t_x = corrections[k].block<3, 1>(0, 3);
+        poses[k].R_camera_to_world = poses_[k].R_camera_to_world * R_x.transpose();
+        poses[k].t_camera_to_world = poses_[k].t_camera_to_world - poses[k].R_camera_to_world * t_x;
+    }
+    return carveByPoses(cloud, poses, num_threads);
+}
+
+PointCloud<PointXYZRGB>::Ptr FreeSpaceCarving::carveByPoses(const PointCloud<PointXYZRGB> &cloud,
+                                                            const CameraPoses &poses, int num_threads) const
+{
+    int N = cloud.points.size();
+    vector<char> keep(N, 0);
+    my_basics::parallelFor(0, N, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++)
+        {
+            const PointXYZRGB &p = cloud.points[i];
+            keep[i] = std::isfinite(p.x) && countFreeVotes(Eigen::Vector3f(p.x, p.y, p.z), poses) < min_votes_;
+        }
+    }, num_threads, 1024);
+
+    PointCloud<PointXYZRGB>::Ptr res(new PointCloud<PointXYZRGB>);
+    res->header = cloud.header;
+    for (int i = 0; i < N; i++)
+        if (keep[i])
+            res->points.push_back(cloud.points[i]);
+    res->width = res->points.size();
+    res->height = 1;
+    res->is_dense = true;
+    return res;
+}
+
+} // namespace my_pcl
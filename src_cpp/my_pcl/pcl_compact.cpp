@@ -0,0 +1,288 @@
+#include "my_pcl/pcl_compact.h"
+
+#include <cmath>
+
+namespace my_pcl
+{
+
+static const int QUANT_MAX = 32767; // -32768 is not used, so the range is symmetric
+
+// Key of a 3D cell. Each coordinate must be within +-2^20.
+static inline uint64_t cellKey(int64_t cx, int64_t cy, int64_t cz)
+{
+    const int64_t offset = 1 << 20;
+    return ((uint64_t)(cx + offset) << 42) | ((uint64_t)(cy + offset) << 21) | (uint64_t)(cz + offset);
+}
+
+CompactCloud::CompactCloud(float resolution, float origin_x, float origin_y, float origin_z)
+    : resolution_(resolution), origin_x_(origin_x), origin_y_(origin_y), origin_z_(origin_z)
+{
+    assert(resolution > 0);
+}
+
+bool CompactCloud::quantize(float v, float origin, int16_t &q) const
+{
+    float u = std::round((v - origin) / resolution_);
+    if (!(u >= -QUANT_MAX && u <= QUANT_MAX)) // also false for NaN
+        return false;
+    q = (int16_t)u;
+    return true;
+}
+
+void CompactCloud::pushBackQuantized(int16_t x, int16_t y, int16_t z, uint32_t rgb)
+{
+    x_.push_back(x);
+    y_.push_back(y);
+    z_.push_back(z);
+    rgb_.push_back(rgb);
+}
+
+void CompactCloud::clear()
+{
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    rgb_.clear();
+}
+
+void CompactCloud::reserve(size_t n)
+{
+    x_.reserve(n);
+    y_.reserve(n);
+    z_.reserve(n);
+    rgb_.reserve(n);
+}
+
+size_t CompactCloud::getMemoryBytes() const
+{
+    return size() * (3 * sizeof(int16_t) + sizeof(uint32_t));
+}
+
+// ------------------------------------- Conversion -------------------------------------
+
+int CompactCloud::fromPCL(const PointCloud<PointXYZRGB> &cloud)
+{
+    clear();
+    reserve(cloud.points.size());
+    int num_dropped = 0;
+    for (const PointXYZRGB &p : cloud.points)
+    {
+        int16_t qx, qy, qz;
+        if (quantize(p.x, origin_x_, qx) && quantize(p.y, origin_y_, qy) && quantize(p.z, origin_z_, qz))
+            pushBackQuantized(qx, qy, qz, p.rgba & 0x00ffffff);
+        else
+            num_dropped++;
+    }
+    return num_dropped;
+}
+
+void CompactCloud::getPoint(int i, PointXYZRGB &p) const
+{
+    p.x = origin_x_ + x_[i] * resolution_;
+    p.y = origin_y_ + y_[i] * resolution_;
+    p.z = origin_z_ + z_[i] * resolution_;
+    p.rgba = rgb_[i] | 0xff000000;
+}
+
+PointCloud<PointXYZRGB>::Ptr CompactCloud::toPCL() const
+{
+    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
+    cloud->points.resize(size());
+    for (size_t i = 0; i < size(); i++)
+        getPoint(i, cloud->points[i]);
+    cloud->width = cloud->points.size();
+    cloud->height = 1;
+    cloud->is_dense = true;
+    return cloud;
+}
+
+// ------------------------------------- Kernels -------------------------------------
+
+void CompactCloud::cropBox(float x_min, float x_max, float y_min, float y_max, float z_min, float z_max)
+{
+    // Bounds in quantized units. Rounding inwards keeps exactly the points whose decoded value is inside.
+    int bx0 = std::ceil((x_min - origin_x_) / resolution_), bx1 = std::floor((x_max - origin_x_) / resolution_);
+    int by0 = std::ceil((y_min - origin_y_) / resolution_), by1 = std::floor((y_max - origin_y_) / resolution_);
+    int bz0 = std::ceil((z_min - origin_z_) / resolution_), bz1 = std::floor((z_max - origin_z_) / resolution_);
+
+    size_t n = 0;
+    for (size_t i = 0; i < size(); i++)
+    {
+        if (x_[i] < bx0 || x_[i] > bx1 || y_[i] < by0 || y_[i] > by1 || z_[i] < bz0 || z_[i] > bz1)
+            continue;
+        x_[n] = x_[i];
+        y_[n] = y_[i];
+        z_[n] = z_[i];
+        rgb_[n] = rgb_[i];
+        n++;
+    }
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    rgb_.resize(n);
+}
+
+void CompactCloud::voxelGrid(float x_grid_size, float y_grid_size, float z_grid_size)
+{
+    // Voxels are aligned with the frame (not the origin), the same as pcl::VoxelGrid.
+    size_t N = size();
+    vector<pair<uint64_t, int>> keys(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        int64_t cx = std::floor((origin_x_ + (double)x_[i] * resolution_) / x_grid_size);
+        int64_t cy = std::floor((origin_y_ + (double)y_[i] * resolution_) / y_grid_size);
+        int64_t cz = std::floor((origin_z_ + (double)z_[i] * resolution_) / z_grid_size);
+        keys[i] = make_pair(cellKey(cx, cy, cz), (int)i);
+    }
+    sort(keys.begin(), keys.end());
+
+    CompactCloud res(resolution_, origin_x_, origin_y_, origin_z_);
+    for (size_t start = 0; start < N;)
+    {
+        size_t end = start;
+        int64_t sx = 0, sy = 0, sz = 0, sr = 0, sg = 0, sb = 0;
+        for (; end < N && keys[end].first == keys[start].first; end++)
+        {
+            int i = keys[end].second;
+            sx += x_[i], sy += y_[i], sz += z_[i];
+            sr += (rgb_[i] >> 16) & 0xff, sg += (rgb_[i] >> 8) & 0xff, sb += rgb_[i] & 0xff;
+        }
+        double cnt = end - start;
+        uint32_t r = std::round(sr / cnt), g = std::round(sg / cnt), b = std::round(sb / cnt);
+        res.pushBackQuantized(std::round(sx / cnt), std::round(sy / cnt), std::round(sz / cnt),
+                              (r << 16) | (g << 8) | b);
+        start = end;
+    }
+    res.x_.swap(x_);
+    res.y_.swap(y_);
+    res.z_.swap(z_);
+    res.rgb_.swap(rgb_);
+}
+
+int CompactCloud::transform(const float T[4][4])
+{
+    return transformRowMajor(&T[0][0], origin_x_, origin_y_, origin_z_);
+}
+
+int CompactCloud::transform(const vector<vector<float>> &T)
+{
+    float T_row_major[16];
+    for (int cnt = 0, i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            T_row_major[cnt++] = T[i][j];
+    return transformRowMajor(T_row_major, origin_x_, origin_y_, origin_z_);
+}
+
+int CompactCloud::transform(const float T[4][4], float new_origin_x, float new_origin_y, float new_origin_z)
+{
+    return transformRowMajor(&T[0][0], new_origin_x, new_origin_y, new_origin_z);
+}
+
+int CompactCloud::transformRowMajor(const float *T, float new_origin_x, float new_origin_y, float new_origin_z)
+{
+    // p_new = R * (origin + q * res) + t - new_origin = R * q * res + (R * origin + t - new_origin)
+    // So in quantized units: q_new = R * q + c
+    float c[3];
+    const float origin[3] = {origin_x_, origin_y_, origin_z_}, new_origin[3] = {new_origin_x, new_origin_y, new_origin_z};
+    for (int r = 0; r < 3; r++)
+        c[r] = (T[r * 4 + 0] * origin[0] + T[r * 4 + 1] * origin[1] + T[r * 4 + 2] * origin[2] +
+                T[r * 4 + 3] - new_origin[r]) / resolution_;
+
+    size_t n = 0;
+    for (size_t i = 0; i < size(); i++)
+    {
+        float q[3];
+        bool inside = true;
+        for (int r = 0; r < 3; r++)
+        {
+            q[r] = std::round(T[r * 4 + 0] * x_[i] + T[r * 4 + 1] * y_[i] + T[r * 4 + 2] * z_[i] + c[r]);
+            inside = inside && q[r] >= -QUANT_MAX && q[r] <= QUANT_MAX;
+        }
+        if (!inside)
+            continue;
+        x_[n] = q[0];
+        y_[n] = q[1];
+        z_[n] = q[2];
+        rgb_[n] = rgb_[i];
+        n++;
+    }
+    int num_dropped = size() - n;
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    rgb_.resize(n);
+    origin_x_ = new_origin_x, origin_y_ = new_origin_y, origin_z_ = new_origin_z;
+    return num_dropped;
+}
+
+vector<PointIndices> CompactCloud::euclideanClusters(double cluster_tolerance,
+                                                     int min_cluster_size, int max_cluster_size) const
+{
+    // Hash grid with cell size = tolerance, so the neighbors of a point are in the 27 cells around it.
+    const double tol_q = cluster_tolerance / resolution_;
+    const int64_t tol_q2 = (int64_t)std::floor(tol_q * tol_q);
+    int N = size();
+    vector<pair<uint64_t, int>> cells(N);
+    for (int i = 0; i < N; i++)
+        cells[i] = make_pair(cellKey(std::floor(x_[i] / tol_q), std::floor(y_[i] / tol_q), std::floor(z_[i] / tol_q)), i);
+    sort(cells.begin(), cells.end());
+    unordered_map<uint64_t, pair<int, int>> cell_ranges; // key --> [begin, end) in cells
+    for (int start = 0; start < N;)
+    {
+        int end = start;
+        while (end < N && cells[end].first == cells[start].first)
+            end++;
+        cell_ranges[cells[start].first] = make_pair(start, end);
+        start = end;
+    }
+
+    vector<bool> processed(N, false);
+    vector<PointIndices> clusters;
+    vector<int> queue;
+    for (int seed = 0; seed < N; seed++)
+    {
+        if (processed[seed])
+            continue;
+        queue.clear();
+        queue.push_back(seed);
+        processed[seed] = true;
+        for (size_t k = 0; k < queue.size(); k++)
+        {
+            int i = queue[k];
+            int64_t cx = std::floor(x_[i] / tol_q), cy = std::floor(y_[i] / tol_q), cz = std::floor(z_[i] / tol_q);
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dz = -1; dz <= 1; dz++)
+                    {
+                        unordered_map<uint64_t, pair<int, int>>::const_iterator it =
+                            cell_ranges.find(cellKey(cx + dx, cy + dy, cz + dz));
+                        if (it == cell_ranges.end())
+                            continue;
+                        for (int c = it->second.first; c < it->second.second; c++)
+                        {
+                            int j = cells[c].second;
+                            if (processed[j])
+                                continue;
+                            int64_t ex = x_[j] - x_[i], ey = y_[j] - y_[i], ez = z_[j] - z_[i];
+                            if (ex * ex + ey * ey + ez * ez <= tol_q2)
+                            {
+                                processed[j] = true;
+                                queue.push_back(j);
+                            }
+                        }
+                    }
+        }
+        if ((int)queue.size() >= min_cluster_size && (int)queue.size() <= max_cluster_size)
+        {
+            PointIndices cluster;
+            cluster.indices = queue;
+            sort(cluster.indices.begin(), cluster.indices.end());
+            clusters.push_back(cluster);
+        }
+    }
+    sort(clusters.begin(), clusters.end(),
+         [](const PointIndices &a, const PointIndices &b) { return a.indices.size() > b.indices.size(); });
+    return clusters;
+}
+
+} // namespace my_pcl
@@ -11,6 +11,12 @@
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/filters/extract_indices.h> // Extract sub cloud by indices 
 
+#include <chrono>
+#include <limits>
+#include <Eigen/Dense>
+#include <cmath>
+#include <stdint.h>
+
 
 namespace my_pcl
 {
@@ -100,6 +106,105 @@ filtByVoxelGrid(const PointCloud<PointXYZRGB>::Ptr cloud,
   return cloud_filtered;
 }
 
+// Number of voxels that VoxelGrid would output (same grid: floor(p / leaf_size)).
+// Counting stops once more than max_num voxels are found, and the total is extrapolated from the points visited.
+// table: open addressing hash set of the voxel keys, reused between calls.
+static int countOccupiedVoxels(const PointCloud<PointXYZRGB> &cloud, float leaf_size, int max_num,
+                               vector<uint64_t> &table)
+{
+  const uint64_t EMPTY = ~(uint64_t)0;
+  size_t capacity = 1024;
+  while (capacity < 2 * std::min(cloud.points.size(), (size_t)max_num + 1))
+    capacity *= 2;
+  table.assign(capacity, EMPTY);
+  const size_t mask = capacity - 1;
+
+  const float inv = 1.0f / leaf_size;
+  const int64_t offset = 1 << 20; // 21 bits per axis
+  int num = 0;
+  for (size_t i = 0; i < cloud.points.size(); i++)
+  {
+    const PointXYZRGB &p = cloud.points[i];
+    if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+      continue;
+    int64_t cx = std::floor(p.x * inv) + offset, cy = std::floor(p.y * inv) + offset, cz = std::floor(p.z * inv) + offset;
+    uint64_t key = ((uint64_t)cx << 42) | ((uint64_t)cy << 21) | (uint64_t)cz;
+    for (size_t h = (key * 0x9E3779B97F4A7C15ull) >> 20 & mask;; h = (h + 1) & mask)
+    {
+      if (table[h] == key)
+        break;
+      if (table[h] == EMPTY)
+      {
+        table[h] = key;
+        num++;
+        break;
+      }
+    }
+    if (num > max_num)
+      return std::max((double)num * cloud.points.size() / (i + 1), max_num + 1.0);
+  }
+  return num;
+}
+
+PointCloud<PointXYZRGB>::Ptr
+filtByVoxelGridToBudget(const PointCloud<PointXYZRGB>::Ptr cloud, int max_num_points, float &leaf_size,
+                        float min_leaf_size, float max_leaf_size, double max_search_seconds)
+{
+  assert(max_num_points > 0 && 0 < min_leaf_size && min_leaf_size <= max_leaf_size);
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  vector<uint64_t> table;
+  const double target = 0.975 * max_num_points; // aim a bit below the budget
+  const double tolerance = 0.95;                // accept at least 95% of the budget
+
+  // The number of points of a surface scales as leaf_size^-d with d about 2.
+  // Keep a bracket: "fine" gives too many points, "coarse" is within the budget.
+  // The next guess interpolates the bracket in log-log scale, or extrapolates with d = 2.
+  float s = leaf_size > 0 ? std::min(std::max(leaf_size, min_leaf_size), max_leaf_size) : min_leaf_size;
+  float fine = -1, coarse = -1;
+  int num_fine = 0, num_coarse = 0;
+  for (int iter = 0; iter < 30; iter++)
+  {
+    int num = countOccupiedVoxels(*cloud, s, max_num_points, table);
+    if (num <= max_num_points)
+      coarse = s, num_coarse = num;
+    else
+      fine = s, num_fine = num;
+
+    if (coarse > 0 && (num_coarse >= tolerance * max_num_points || coarse <= min_leaf_size))
+      break;
+    if (fine >= max_leaf_size)
+    {
+      cout << "my WARNING: filtByVoxelGridToBudget: max_leaf_size gives more points than the budget." << endl;
+      coarse = max_leaf_size;
+      break;
+    }
+    if (std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() > max_search_seconds)
+      break;
+
+    if (fine > 0 && coarse > 0)
+    {
+      double log_ratio = std::log(coarse / fine);
+      if (log_ratio < 0.005)
+        break;
+      double d = std::log((double)num_fine / std::max(num_coarse, 1)) / log_ratio;
+      double log_s = d > 0 ? std::log(fine) + std::log(num_fine / target) / d : 0.5 * std::log(fine * coarse);
+      // Shrink the bracket by at least 10% (in log scale) per step
+      log_s = std::min(std::max(log_s, std::log(fine) + 0.1 * log_ratio), std::log(coarse) - 0.1 * log_ratio);
+      s = std::exp(log_s);
+    }
+    else
+      s = std::min(std::max(s * std::sqrt(std::max(num, 1) / target), (double)min_leaf_size), (double)max_leaf_size);
+  }
+  if (coarse < 0) // timeout before finding a leaf size within the budget
+  {
+    cout << "my WARNING: filtByVoxelGridToBudget times out before reaching the budget." << endl;
+    coarse = std::min(fine * std::sqrt(num_fine / target), (double)max_leaf_size); // best guess, unchecked
+  }
+
+  leaf_size = coarse;
+  return filtByVoxelGrid(cloud, leaf_size, leaf_size, leaf_size);
+}
+
 // ------------------------------------------------------------------------------------
 
 bool detectPlane(
@@ -116,8 +221,9 @@ bool detectPlane(
   */
   coefficients.reset(new ModelCoefficients);
   inliers.reset(new PointIndices);
-  // Create the segmentation object
-  SACSegmentation<PointXYZRGB> seg;
+  // Create the segmentation object.
+  // random=false: RANSAC samples from a fixed seed, so the same cloud gives the same plane (see pcl_test_regression).
+  SACSegmentation<PointXYZRGB> seg(false);
   // Optional
   seg.setOptimizeCoefficients(true);
   // Mandatory
@@ -143,6 +249,98 @@ bool detectPlane(
   }
   return true;
 }
+
+// Least squares fit of z = a*x + b*y + c to the points within distance_threshold of the plane
+// (a, b, c) (in vertical distance). The plane is updated. Return the number of points used.
+static int fitHorizontalPlane(const PointCloud<PointXYZRGB> &cloud, float distance_threshold, Eigen::Vector3d &abc)
+{
+  // Centered at the mean x, y of the points for a well conditioned system
+  Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+  Eigen::Vector3d rhs = Eigen::Vector3d::Zero();
+  int num = 0;
+  for (const PointXYZRGB &p : cloud.points)
+  {
+    if (!std::isfinite(p.z) || std::abs(p.z - (abc[0] * p.x + abc[1] * p.y + abc[2])) > distance_threshold)
+      continue;
+    Eigen::Vector3d v(p.x, p.y, 1);
+    A += v * v.transpose();
+    rhs += v * p.z;
+    num++;
+  }
+  if (num < 3)
+    return num;
+  Eigen::Vector3d mean(A(0, 2) / num, A(1, 2) / num, 1);
+  Eigen::Matrix2d C = A.block<2, 2>(0, 0) / num - mean.head<2>() * mean.head<2>().transpose();
+  if (C.determinant() < 1e-12) // points on a line
+    return 0;
+  Eigen::Vector2d cov_xz = rhs.head<2>() / num - mean.head<2>() * (rhs[2] / num);
+  Eigen::Vector2d ab = C.ldlt().solve(cov_xz);
+  abc << ab[0], ab[1], rhs[2] / num - ab.dot(mean.head<2>());
+  return num;
+}
+
+bool detectHorizontalPlane(
+    const PointCloud<PointXYZRGB>::Ptr cloud,
+    ModelCoefficients::Ptr &coefficients, PointIndices::Ptr &inliers,
+    float distance_threshold, float max_tilt_angle, float min_inlier_ratio)
+{
+  coefficients.reset(new ModelCoefficients);
+  inliers.reset(new PointIndices);
+  assert(distance_threshold > 0);
+
+  // -- Histogram of z, with a bin size of distance_threshold (at most 100000 bins)
+  float z_min = std::numeric_limits<float>::max(), z_max = -z_min;
+  for (const PointXYZRGB &p : cloud->points)
+    if (std::isfinite(p.z))
+      z_min = min(z_min, p.z), z_max = max(z_max, p.z);
+  if (z_min > z_max)
+    return false;
+  float bin_size = max(distance_threshold, (z_max - z_min) / 100000);
+  vector<int> hist((int)((z_max - z_min) / bin_size) + 1, 0);
+  for (const PointXYZRGB &p : cloud->points)
+    if (std::isfinite(p.z))
+      hist[(int)((p.z - z_min) / bin_size)]++;
+
+  // -- The peak of a window of 3 bins gives the height
+  int peak = 0, peak_count = -1;
+  for (int k = 0; k < (int)hist.size(); k++)
+  {
+    int count = hist[k] + (k > 0 ? hist[k - 1] : 0) + (k + 1 < (int)hist.size() ? hist[k + 1] : 0);
+    if (count > peak_count)
+      peak = k, peak_count = count;
+  }
+  Eigen::Vector3d abc(0, 0, z_min + (peak + 0.5) * bin_size);
+
+  // -- Two passes of least squares. The first one takes the whole window.
+  if (fitHorizontalPlane(*cloud, 1.5 * bin_size, abc) < 3 || fitHorizontalPlane(*cloud, distance_threshold, abc) < 3)
+    return false;
+
+  // -- Inliers by the distance to the plane, and the quality of the fit
+  double norm = std::sqrt(abc[0] * abc[0] + abc[1] * abc[1] + 1);
+  double sum_sq = 0;
+  for (size_t i = 0; i < cloud->points.size(); i++)
+  {
+    const PointXYZRGB &p = cloud->points[i];
+    double dist = std::abs(p.z - (abc[0] * p.x + abc[1] * p.y + abc[2])) / norm;
+    if (dist <= distance_threshold) // false for NaN
+    {
+      inliers->indices.push_back(i);
+      sum_sq += dist * dist;
+    }
+  }
+  int num_inliers = inliers->indices.size();
+  double tilt = std::acos(1 / norm);
+  double rms = std::sqrt(sum_sq / max(num_inliers, 1));
+  coefficients->values = {(float)(-abc[0] / norm), (float)(-abc[1] / norm), (float)(1 / norm), (float)(-abc[2] / norm)};
+  if (num_inliers < 3 || num_inliers < min_inlier_ratio * cloud->points.size() ||
+      tilt > max_tilt_angle || rms > distance_threshold / 2)
+  {
+    printf("my WARNING: detectHorizontalPlane: poor fit (%d inliers, tilt %.3f rad, rms %.4f m)\n",
+           num_inliers, tilt, rms);
+    return false;
+  }
+  return true;
+}
 void printPlaneCoef(const pcl::ModelCoefficients::Ptr coefficients)
 {
   cout << "Fitting plane ax+by+cz+d=0. The 4 parames are: " << coefficients->values[0] << ", "
@@ -1,11 +1,22 @@
-
 #include "my_pcl/pcl_io.h"
+#include "my_basics/parallel.h"
 
 #include <iostream>
 #include <memory>
 #include <string>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
 #include <pcl/common/common_headers.h>
 #include <pcl/io/pcd_io.h>
+#include <pcl/common/io.h> // copyPointCloud
+
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
 
 using namespace std;
 
@@ -14,61 +25,444 @@ using namespace std;
 namespace my_pcl
 {
 
-// -- Input / Output
+// ------------------------------------------------------------------------------------
+// -- Fast PCD loader
 
-bool read_point_cloud(string filename, PointCloud<PointXYZRGB>::Ptr &cloud)
+namespace
 {
-    cloud.reset(new PointCloud<PointXYZRGB>);
-    int load_res = io::loadPCDFile<PointXYZRGB>(filename, *cloud);
-    if (load_res == -1) // load the file
+
+// A field of the pcd header that we copy into PointXYZRGB. Other fields are skipped.
+struct PcdField
+{
+    string name;
+    int size, count;
+    char type;
+    int offset;     // byte offset inside a binary record
+    int token_idx;  // index of its first token in an ascii line
+    int dst_offset; // byte offset inside PointXYZRGB, or -1 if not used
+};
+
+struct PcdHeader
+{
+    vector<PcdField> fields;
+    int width = 0, height = 0, points = 0;
+    string data_type;
+    size_t data_start = 0; // file offset of the body
+    int point_step = 0;    // bytes per binary record
+    int tokens_per_line = 0;
+};
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Parse the header lines till "DATA xxx". Return false if the header is not understood,
+// or if x, y and z are not all float32 fields: PCL's loader converts the other types.
+bool parsePcdHeader(const char *begin, const char *end, PcdHeader &header)
+{
+    const char *p = begin;
+    vector<string> sizes, types, counts;
+    while (p < end)
     {
-        string ERROR_MESSAGE = "Couldn't read file " + filename + "\n";
-        PCL_ERROR(ERROR_MESSAGE.c_str());
-        assert(0);
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (line_end == NULL)
+            line_end = end;
+        std::istringstream ss(string(p, line_end));
+        p = line_end + 1;
+        string key, val;
+        if (!(ss >> key) || key[0] == '#')
+            continue;
+        if (key == "FIELDS")
+            while (ss >> val)
+            {
+                PcdField f;
+                f.name = val;
+                header.fields.push_back(f);
+            }
+        else if (key == "SIZE")
+            while (ss >> val)
+                sizes.push_back(val);
+        else if (key == "TYPE")
+            while (ss >> val)
+                types.push_back(val);
+        else if (key == "COUNT")
+            while (ss >> val)
+                counts.push_back(val);
+        else if (key == "WIDTH")
+            ss >> header.width;
+        else if (key == "HEIGHT")
+            ss >> header.height;
+        else if (key == "POINTS")
+            ss >> header.points;
+        else if (key == "DATA")
+        {
+            ss >> header.data_type;
+            header.data_start = min((size_t)(p - begin), (size_t)(end - begin));
+            break;
+        }
     }
-    if (DEBUG_RESULT)
+    if (header.data_type.empty() || header.fields.empty() ||
+        sizes.size() != header.fields.size() || types.size() != header.fields.size() ||
+        !(counts.empty() || counts.size() == header.fields.size()))
+        return false;
+    if (header.points == 0)
+        header.points = header.width * header.height;
+
+    // -- Field layout
+    int offset = 0, token_idx = 0;
+    for (size_t i = 0; i < header.fields.size(); i++)
     {
-        std::cout << "Loaded " << cloud->width <<"x"<< cloud->height << " data points from " 
-        << filename << std::endl;
+        PcdField &f = header.fields[i];
+        f.size = atoi(sizes[i].c_str());
+        f.type = types[i][0];
+        f.count = counts.empty() ? 1 : atoi(counts[i].c_str());
+        f.offset = offset;
+        f.token_idx = token_idx;
+        offset += f.size * f.count;
+        token_idx += f.count;
+
+        f.dst_offset = -1;
+        if (f.size == 4 && f.count == 1)
+        {
+            if (f.name == "x" && f.type == 'F')
+                f.dst_offset = offsetof(PointXYZRGB, x);
+            else if (f.name == "y" && f.type == 'F')
+                f.dst_offset = offsetof(PointXYZRGB, y);
+            else if (f.name == "z" && f.type == 'F')
+                f.dst_offset = offsetof(PointXYZRGB, z);
+            else if (f.name == "rgb" || f.name == "rgba")
+                f.dst_offset = offsetof(PointXYZRGB, rgb);
+        }
+    }
+    header.point_step = offset;
+    header.tokens_per_line = token_idx;
+
+    for (int dst_offset : {offsetof(PointXYZRGB, x), offsetof(PointXYZRGB, y), offsetof(PointXYZRGB, z)})
+    {
+        bool found = false;
+        for (const PcdField &f : header.fields)
+            found = found || f.dst_offset == dst_offset;
+        if (!found)
+            return false;
     }
     return true;
 }
 
+// 10^i for i in [-64, 64]. Enough for any coordinate or color written by PCL / Open3D.
+struct Pow10Table
+{
+    double vals[129];
+    Pow10Table()
+    {
+        for (int i = -64; i <= 64; i++)
+            vals[i + 64] = pow(10.0, i);
+    }
+};
+const Pow10Table POW10;
 
-bool read_point_cloud(string filename, PointCloud<PointXYZ>::Ptr &cloud)
+// Parse one number token. Integers (e.g. rgb written by PCL as uint32) are also returned in is_integer
+// so that the rgb bits can be restored exactly.
+inline const char *parseNumber(const char *p, const char *end, float &val, uint32_t &uval, bool &is_integer)
 {
-    cloud.reset(new PointCloud<PointXYZ>);
-    int load_res = io::loadPCDFile<PointXYZ>(filename, *cloud);
-    if (load_res == -1) // load the file
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+    if (p < end && (*p == 'n' || *p == 'N' || *p == 'i' || *p == 'I'))
+    { // nan, inf
+        bool is_nan = (*p == 'n' || *p == 'N');
+        while (p < end && !isSpace(*p) && *p != '\n')
+            p++;
+        val = is_nan ? numeric_limits<float>::quiet_NaN()
+                     : (neg ? -numeric_limits<float>::infinity() : numeric_limits<float>::infinity());
+        is_integer = false;
+        return p;
+    }
+    uint64_t mantissa = 0;
+    int exp10 = 0, num_digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
     {
-        string ERROR_MESSAGE = "Couldn't read file " + filename + "\n";
-        PCL_ERROR(ERROR_MESSAGE.c_str());
-        assert(0);
+        if (num_digits < 19)
+            mantissa = mantissa * 10 + (*p - '0'), num_digits += (mantissa > 0);
+        else
+            exp10++;
+    }
+    is_integer = !neg;
+    if (p < end && *p == '.')
+    {
+        is_integer = false;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+            if (num_digits < 19)
+                mantissa = mantissa * 10 + (*p - '0'), num_digits += (mantissa > 0), exp10--;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        is_integer = false;
+        p++;
+        bool exp_neg = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            exp_neg = (*p++ == '-');
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            e = min(e * 10 + (*p - '0'), 1000);
+        exp10 += exp_neg ? -e : e;
+    }
+    double d = (double)mantissa;
+    if (exp10 != 0)
+        d = (exp10 >= -64 && exp10 <= 64) ? d * POW10.vals[exp10 + 64] : d * pow(10.0, exp10);
+    val = (float)(neg ? -d : d);
+    uval = (uint32_t)mantissa;
+    return p;
+}
+
+// Parse the ascii lines in [p, end) into points[0...]. Return the number of points parsed.
+int parseAsciiLines(const char *p, const char *end, const PcdHeader &header, PointXYZRGB *points)
+{
+    // token index --> field index, for the fields we keep
+    vector<int> token_to_field(header.tokens_per_line, -1);
+    for (size_t i = 0; i < header.fields.size(); i++)
+        if (header.fields[i].dst_offset >= 0)
+            token_to_field[header.fields[i].token_idx] = i;
+
+    int cnt = 0;
+    while (p < end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        if (p < end && *p == '\n')
+        { // empty line
+            p++;
+            continue;
+        }
+        if (p >= end)
+            break;
+
+        PointXYZRGB &pt = points[cnt++];
+        pt.x = pt.y = pt.z = numeric_limits<float>::quiet_NaN();
+        pt.rgb = 0;
+        for (int t = 0; t < header.tokens_per_line && p < end && *p != '\n'; t++)
+        {
+            int fi = token_to_field[t];
+            if (fi < 0)
+            { // skip the token
+                while (p < end && !isSpace(*p) && *p != '\n')
+                    p++;
+            }
+            else
+            {
+                const PcdField &f = header.fields[fi];
+                float val;
+                uint32_t uval;
+                bool is_integer;
+                p = parseNumber(p, end, val, uval, is_integer);
+                char *dst = reinterpret_cast<char *>(&pt) + f.dst_offset;
+                if (f.dst_offset == (int)offsetof(PointXYZRGB, rgb) && (f.type != 'F' || is_integer))
+                    memcpy(dst, &uval, 4); // PCL writes rgb as the uint32 bits
+                else
+                    memcpy(dst, &val, 4);
+            }
+            while (p < end && isSpace(*p))
+                p++;
+        }
+        // go to next line
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+        p = (line_end == NULL) ? end : line_end + 1;
+    }
+    return cnt;
+}
+
+} // namespace
+
+bool readPCDFast(const string &filename, PointCloud<PointXYZRGB> &cloud, int num_threads)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    // -- mmap the file
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    size_t file_size = st.st_size;
+    void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, file_size, MADV_SEQUENTIAL);
+    const char *begin = static_cast<const char *>(map), *end = begin + file_size;
+
+    // -- Header
+    PcdHeader header;
+    bool res = parsePcdHeader(begin, end, header) && header.points > 0;
+    if (res && header.data_type == "ascii")
+    {
+        // Split the body into chunks at line breaks. Each thread counts its lines first,
+        // so that it knows where to write in the output array.
+        num_threads = my_basics::getNumThreads(num_threads);
+        const char *body = begin + header.data_start;
+        size_t body_size = end - body;
+        vector<const char *> chunk_begins(num_threads + 1, end);
+        chunk_begins[0] = body;
+        for (int t = 1; t < num_threads; t++)
+        {
+            const char *q = body + body_size * t / num_threads;
+            q = max(q, chunk_begins[t - 1]);
+            const char *nl = static_cast<const char *>(memchr(q, '\n', end - q));
+            chunk_begins[t] = (nl == NULL) ? end : nl + 1;
+        }
+        vector<int> chunk_num_lines(num_threads, 0);
+        my_basics::parallelFor(0, num_threads, [&](int b, int e, int) {
+            for (int t = b; t < e; t++)
+            {
+                int n = 0;
+                for (const char *q = chunk_begins[t]; q < chunk_begins[t + 1]; q++)
+                {
+                    q = static_cast<const char *>(memchr(q, '\n', chunk_begins[t + 1] - q));
+                    if (q == NULL)
+                    {
+                        n++; // last line without '\n'
+                        break;
+                    }
+                    n++;
+                }
+                chunk_num_lines[t] = n;
+            }
+        }, num_threads);
+        vector<int> chunk_starts(num_threads + 1, 0);
+        for (int t = 0; t < num_threads; t++)
+            chunk_starts[t + 1] = chunk_starts[t] + chunk_num_lines[t];
+
+        // Upper bound on points = number of lines. Empty lines are compacted below.
+        cloud.points.resize(chunk_starts[num_threads]);
+        vector<int> chunk_num_points(num_threads, 0);
+        my_basics::parallelFor(0, num_threads, [&](int b, int e, int) {
+            for (int t = b; t < e; t++)
+                chunk_num_points[t] = parseAsciiLines(chunk_begins[t], chunk_begins[t + 1], header,
+                                                      cloud.points.data() + chunk_starts[t]);
+        }, num_threads);
+        int cnt = 0;
+        for (int t = 0; t < num_threads; t++)
+        {
+            if (cnt != chunk_starts[t])
+                memmove(&cloud.points[cnt], &cloud.points[chunk_starts[t]], chunk_num_points[t] * sizeof(PointXYZRGB));
+            cnt += chunk_num_points[t];
+        }
+        cloud.points.resize(cnt);
+    }
+    else if (res && header.data_type == "binary")
+    {
+        const char *body = begin + header.data_start;
+        if (body + (size_t)header.points * header.point_step > end)
+            res = false;
+        else
+        {
+            cloud.points.resize(header.points);
+            PointXYZRGB *dst = cloud.points.data();
+            bool is_same_layout = header.point_step == sizeof(PointXYZRGB);
+            for (const PcdField &f : header.fields)
+                is_same_layout = is_same_layout && (f.dst_offset < 0 || f.dst_offset == f.offset);
+            if (is_same_layout)
+            {
+                memcpy(dst, body, (size_t)header.points * sizeof(PointXYZRGB));
+                for (int i = 0; i < header.points; i++)
+                    dst[i].data[3] = 1.0f; // the record's padding was copied into it
+            }
+            else
+            { // copy field by field
+                my_basics::parallelFor(0, header.points, [&](int b, int e, int) {
+                    for (int i = b; i < e; i++)
+                    {
+                        const char *rec = body + (size_t)i * header.point_step;
+                        dst[i].rgb = 0;
+                        for (const PcdField &f : header.fields)
+                            if (f.dst_offset >= 0)
+                                memcpy(reinterpret_cast<char *>(&dst[i]) + f.dst_offset, rec + f.offset, 4);
+                    }
+                }, num_threads, 10000);
+            }
+        }
     }
+    else
+    {
+        res = false; // e.g. binary_compressed: let PCL do it
+    }
+    munmap(map, file_size);
+    if (!res)
+        return false;
+
+    // -- Cloud info
+    if (header.width * header.height == (int)cloud.points.size())
+    {
+        cloud.width = header.width;
+        cloud.height = header.height;
+    }
+    else
+    {
+        cloud.width = cloud.points.size();
+        cloud.height = 1;
+    }
+    cloud.is_dense = false;
+
     if (DEBUG_RESULT)
     {
-        std::cout << "Loaded " << cloud->width <<"x"<< cloud->height << " data points from " 
-        << filename << std::endl;
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        printf("Fast loader: %s body, %.1f MB in %.1f ms, %.1f MB/s, %.1f Mpoints/s\n",
+               header.data_type.c_str(), file_size / 1e6, t * 1000,
+               file_size / 1e6 / t, cloud.points.size() / 1e6 / t);
     }
     return true;
 }
 
+// ------------------------------------------------------------------------------------
+// -- Input / Output
 
-PointCloud<PointXYZRGB>::Ptr read_point_cloud(string filename)
+// Try the fast loader first, and use PCL's loader for the formats it does not handle.
+static void loadPCD(const string &filename, PointCloud<PointXYZRGB> &cloud)
 {
-    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
-    int load_res = io::loadPCDFile<PointXYZRGB>(filename, *cloud);
+    if (readPCDFast(filename, cloud))
+        return;
+    int load_res = io::loadPCDFile<PointXYZRGB>(filename, cloud);
     if (load_res == -1) // load the file
     {
         string ERROR_MESSAGE = "Couldn't read file " + filename + "\n";
         PCL_ERROR(ERROR_MESSAGE.c_str());
         assert(0);
     }
+}
+
+bool read_point_cloud(string filename, PointCloud<PointXYZRGB>::Ptr &cloud)
+{
+    cloud.reset(new PointCloud<PointXYZRGB>);
+    loadPCD(filename, *cloud);
+    if (DEBUG_RESULT)
+    {
+        std::cout << "Loaded " << cloud->width <<"x"<< cloud->height << " data points from "
+        << filename << std::endl;
+    }
+    return true;
+}
+
+
+bool read_point_cloud(string filename, PointCloud<PointXYZ>::Ptr &cloud)
+{
+    PointCloud<PointXYZRGB> cloud_rgb;
+    loadPCD(filename, cloud_rgb);
+    cloud.reset(new PointCloud<PointXYZ>);
+    copyPointCloud(cloud_rgb, *cloud);
     if (DEBUG_RESULT)
     {
-        std::cout << "Loaded " << cloud->width <<"x"<< cloud->height << " data points from " 
+        std::cout << "Loaded " << cloud->width <<"x"<< cloud->height << " data points from "
         << filename << std::endl;
     }
+    return true;
+}
+
+
+PointCloud<PointXYZRGB>::Ptr read_point_cloud(string filename)
+{
+    PointCloud<PointXYZRGB>::Ptr cloud;
+    read_point_cloud(filename, cloud);
     return cloud;
 }
 
@@ -84,4 +478,4 @@ void write_point_cloud(string filename, PointCloud<PointXYZ>::Ptr cloud)
 }
 
 
-} // namespace pcl_funcs
\ No newline at end of file
+} // namespace pcl_funcs
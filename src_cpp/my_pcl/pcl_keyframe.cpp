@@ -0,0 +1,74 @@
+#include "my_pcl/pcl_keyframe.h"
+
+#include <cmath>
+
+namespace my_pcl
+{
+
+CoverageKeyframeSelector::CoverageKeyframeSelector(float x_min, float x_max, float y_min, float y_max,
+                                                   float z_min, float z_max, float voxel_size,
+                                                   int min_new_voxels, int sample_stride)
+    : x_min_(x_min), y_min_(y_min), z_min_(z_min), voxel_size_(voxel_size),
+      min_new_voxels_(min_new_voxels), sample_stride_(max(sample_stride, 1)),
+      num_observed_(0), num_selected_(0), num_rejected_(0), last_new_voxels_(0)
+{
+    assert(voxel_size > 0 && x_max > x_min && y_max > y_min && z_max > z_min);
+    nx_ = std::ceil((x_max - x_min) / voxel_size);
+    ny_ = std::ceil((y_max - y_min) / voxel_size);
+    nz_ = std::ceil((z_max - z_min) / voxel_size);
+    observed_.assign(nx_ * ny_ * nz_, false);
+}
+
+int CoverageKeyframeSelector::countNewVoxels(const PointCloud<PointXYZRGB> &cloud,
+                                             const Eigen::Matrix4f &T_box_to_cloud,
+                                             vector<int> *new_voxels) const
+{
+    const Eigen::Matrix3f R = T_box_to_cloud.block<3, 3>(0, 0);
+    const Eigen::Vector3f t = T_box_to_cloud.block<3, 1>(0, 3);
+    vector<int> found;
+    for (size_t i = 0; i < cloud.points.size(); i += sample_stride_)
+    {
+        const PointXYZRGB &p = cloud.points[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        Eigen::Vector3f q = R * Eigen::Vector3f(p.x, p.y, p.z) + t;
+        int ix = std::floor((q.x() - x_min_) / voxel_size_);
+        int iy = std::floor((q.y() - y_min_) / voxel_size_);
+        int iz = std::floor((q.z() - z_min_) / voxel_size_);
+        if (ix < 0 || ix >= nx_ || iy < 0 || iy >= ny_ || iz < 0 || iz >= nz_)
+            continue;
+        int idx = (ix * ny_ + iy) * nz_ + iz;
+        if (!observed_[idx])
+            found.push_back(idx);
+    }
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+    int num_new = found.size();
+    if (new_voxels)
+        new_voxels->swap(found);
+    return num_new;
+}
+
+bool CoverageKeyframeSelector::select(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_box_to_cloud)
+{
+    vector<int> new_voxels;
+    last_new_voxels_ = countNewVoxels(cloud, T_box_to_cloud, &new_voxels);
+    if (last_new_voxels_ < min_new_voxels_)
+    {
+        num_rejected_++;
+        return false;
+    }
+    for (int idx : new_voxels)
+        observed_[idx] = true;
+    num_observed_ += new_voxels.size();
+    num_selected_++;
+    return true;
+}
+
+void CoverageKeyframeSelector::clear()
+{
+    observed_.assign(observed_.size(), false);
+    num_observed_ = num_selected_ = num_rejected_ = last_new_voxels_ = 0;
+}
+
+} // namespace my_pcl
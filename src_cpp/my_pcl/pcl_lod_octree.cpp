@@ -0,0 +1,187 @@
+#include "my_pcl/pcl_lod_octree.h"
+
+#include <cmath>
+
+namespace my_pcl
+{
+
+// Key of a cell. Each coordinate must be within +-2^20 (+-2 km for 2 mm leaves).
+static inline uint64_t cellKey(int64_t cx, int64_t cy, int64_t cz)
+{
+    const int64_t offset = 1 << 20;
+    return ((uint64_t)(cx + offset) << 42) | ((uint64_t)(cy + offset) << 21) | (uint64_t)(cz + offset);
+}
+
+static inline void cellCoords(uint64_t key, int64_t &cx, int64_t &cy, int64_t &cz)
+{
+    const int64_t offset = 1 << 20, mask = (1 << 21) - 1;
+    cx = (int64_t)(key >> 42) - offset;
+    cy = (int64_t)((key >> 21) & mask) - offset;
+    cz = (int64_t)(key & mask) - offset;
+}
+
+static inline uint32_t packRGB(uint64_t r, uint64_t g, uint64_t b)
+{
+    return (uint32_t)((r << 16) | (g << 8) | b);
+}
+
+LodOctree::LodOctree(float leaf_size, int num_levels, float move_ratio)
+    : leaf_size_(leaf_size), move_ratio_(move_ratio), levels_(num_levels), refresh_cursor_(0)
+{
+    assert(leaf_size > 0 && num_levels >= 1);
+}
+
+void LodOctree::clear()
+{
+    for (Level &level : levels_)
+        level.clear();
+    refresh_keys_.clear();
+    refresh_cursor_ = 0;
+}
+
+void LodOctree::getNodePoint(const Node &node, PointXYZRGB &p) const
+{
+    p.x = node.sx / node.count;
+    p.y = node.sy / node.count;
+    p.z = node.sz / node.count;
+    p.rgba = 0xff000000 | packRGB(node.sr / node.count, node.sg / node.count, node.sb / node.count);
+}
+
+int LodOctree::update(const PointCloud<PointXYZRGB> &cloud)
+{
+    int num_levels = levels_.size();
+
+    // -- Accumulate the points into the finest level
+    vector<Level> new_levels(num_levels);
+    Level &finest = new_levels.back();
+    finest.reserve(levels_.back().size());
+    for (const PointXYZRGB &p : cloud.points)
+    {
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        int64_t cx = std::floor(p.x / leaf_size_), cy = std::floor(p.y / leaf_size_), cz = std::floor(p.z / leaf_size_);
+        uint32_t rgb = p.rgba;
+        Node &node = finest[cellKey(cx, cy, cz)];
+        node.sx += p.x, node.sy += p.y, node.sz += p.z;
+        node.sr += (rgb >> 16) & 0xff, node.sg += (rgb >> 8) & 0xff, node.sb += rgb & 0xff;
+        node.count++;
+    }
+
+    // -- Each coarser level from the one below: a node is the sum of its children
+    for (int level = num_levels - 2; level >= 0; level--)
+    {
+        new_levels[level].reserve(levels_[level].size());
+        for (const Level::value_type &kv : new_levels[level + 1])
+        {
+            int64_t cx, cy, cz;
+            cellCoords(kv.first, cx, cy, cz);
+            const Node &child = kv.second;
+            Node &node = new_levels[level][cellKey(cx >> 1, cy >> 1, cz >> 1)]; // arithmetic shift == floor(c / 2)
+            node.sx += child.sx, node.sy += child.sy, node.sz += child.sz;
+            node.sr += child.sr, node.sg += child.sg, node.sb += child.sb;
+            node.count += child.count;
+        }
+    }
+
+    // -- Compare with what has been sent
+    int num_changed = 0;
+    for (int level = 0; level < num_levels; level++)
+    {
+        float max_move = move_ratio_ * leaf_size_ * (1 << (num_levels - 1 - level));
+        for (Level::value_type &kv : new_levels[level])
+        {
+            Node &node = kv.second;
+            node.sent = false;
+            node.changed = true;
+            Level::const_iterator old = levels_[level].find(kv.first);
+            if (old != levels_[level].end() && old->second.sent)
+            {
+                node.sent = true;
+                node.sent_x = old->second.sent_x, node.sent_y = old->second.sent_y, node.sent_z = old->second.sent_z;
+                node.sent_rgb = old->second.sent_rgb;
+
+                PointXYZRGB p;
+                getNodePoint(node, p);
+                float dx = p.x - node.sent_x, dy = p.y - node.sent_y, dz = p.z - node.sent_z;
+                bool moved = dx * dx + dy * dy + dz * dz > max_move * max_move;
+                bool recolored = false;
+                for (int shift = 0; shift <= 16; shift += 8)
+                    recolored = recolored || std::abs((int)((p.rgba >> shift) & 0xff) - (int)((node.sent_rgb >> shift) & 0xff)) > 16;
+                node.changed = old->second.changed || moved || recolored;
+            }
+            num_changed += node.changed;
+        }
+    }
+
+    // -- The refresh order: keep the finest nodes that remain in their order, and append the new ones
+    size_t n = 0, cursor = refresh_cursor_;
+    for (size_t k = 0; k < refresh_keys_.size(); k++)
+    {
+        if (finest.count(refresh_keys_[k]))
+            refresh_keys_[n++] = refresh_keys_[k];
+        else if (k < refresh_cursor_)
+            cursor--;
+    }
+    refresh_keys_.resize(n);
+    for (const Level::value_type &kv : finest)
+        if (!levels_.back().count(kv.first))
+            refresh_keys_.push_back(kv.first);
+    refresh_cursor_ = cursor < refresh_keys_.size() ? cursor : 0;
+
+    levels_.swap(new_levels);
+    return num_changed;
+}
+
+int LodOctree::getNumPendingNodes() const
+{
+    int cnt = 0;
+    for (const Level &level : levels_)
+        for (const Level::value_type &kv : level)
+            cnt += kv.second.changed;
+    return cnt;
+}
+
+int LodOctree::getUpdate(int point_budget, PointCloud<PointXYZRGB> &out, bool refresh_when_idle)
+{
+    out.points.clear();
+    for (size_t level = 0; level < levels_.size() && (int)out.points.size() < point_budget; level++)
+    {
+        // Sorted, so that the same input gives the same output
+        vector<uint64_t> keys;
+        for (const Level::value_type &kv : levels_[level])
+            if (kv.second.changed)
+                keys.push_back(kv.first);
+        sort(keys.begin(), keys.end());
+
+        for (size_t k = 0; k < keys.size() && (int)out.points.size() < point_budget; k++)
+        {
+            Node &node = levels_[level][keys[k]];
+            PointXYZRGB p;
+            getNodePoint(node, p);
+            out.points.push_back(p);
+            node.changed = false;
+            node.sent = true;
+            node.sent_x = p.x, node.sent_y = p.y, node.sent_z = p.z;
+            node.sent_rgb = p.rgba;
+        }
+    }
+
+    if (out.points.empty() && refresh_when_idle)
+    {
+        size_t num_refresh = min((size_t)point_budget, refresh_keys_.size());
+        for (size_t k = 0; k < num_refresh; k++)
+        {
+            PointXYZRGB p;
+            getNodePoint(levels_.back()[refresh_keys_[refresh_cursor_]], p);
+            out.points.push_back(p);
+            refresh_cursor_ = (refresh_cursor_ + 1) % refresh_keys_.size();
+        }
+    }
+
+    out.width = out.points.size();
+    out.height = 1;
+    out.is_dense = true;
+    return out.points.size();
+}
+
+} // namespace my_pcl
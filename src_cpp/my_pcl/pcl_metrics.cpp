@@ -0,0 +1,99 @@
+#include "my_pcl/pcl_metrics.h"
+#include "my_basics/parallel.h"
+
+#include <cmath>
+#include <stdint.h>
+#include <Eigen/Geometry>
+
+namespace my_pcl
+{
+
+// Key of a voxel. Each coordinate must be within +-2^20.
+static inline uint64_t voxelKey(int64_t cx, int64_t cy, int64_t cz)
+{
+    const int64_t offset = 1 << 20;
+    return ((uint64_t)(cx + offset) << 42) | ((uint64_t)(cy + offset) << 21) | (uint64_t)(cz + offset);
+}
+
+// Nearest distance from each point of a to b, clamped to max_distance. Invalid points of a are skipped.
+static vector<float> directedDistances(const PointCloud<PointXYZRGB> &a, const PointCloud<PointXYZRGB> &b,
+                                       float max_distance, int num_threads)
+{
+    // -- Voxel hash of b: a neighbor within max_distance is in the 27 voxels around
+    unordered_map<uint64_t, vector<int>> voxels;
+    for (size_t j = 0; j < b.points.size(); j++)
+    {
+        const PointXYZRGB &q = b.points[j];
+        if (pcl::isFinite(q))
+            voxels[voxelKey(std::floor(q.x / max_distance), std::floor(q.y / max_distance),
+                            std::floor(q.z / max_distance))].push_back(j);
+    }
+
+    vector<int> valid;
+    for (size_t i = 0; i < a.points.size(); i++)
+        if (pcl::isFinite(a.points[i]))
+            valid.push_back(i);
+    vector<float> dists(valid.size(), max_distance);
+    my_basics::parallelFor(0, valid.size(), [&](int begin, int end, int) {
+        for (int k = begin; k < end; k++)
+        {
+            const PointXYZRGB &p = a.points[valid[k]];
+            int64_t cx = std::floor(p.x / max_distance), cy = std::floor(p.y / max_distance),
+                    cz = std::floor(p.z / max_distance);
+            float best2 = max_distance * max_distance;
+            for (int64_t dx = -1; dx <= 1; dx++)
+                for (int64_t dy = -1; dy <= 1; dy++)
+                    for (int64_t dz = -1; dz <= 1; dz++)
+                    {
+                        unordered_map<uint64_t, vector<int>>::const_iterator it =
+                            voxels.find(voxelKey(cx + dx, cy + dy, cz + dz));
+                        if (it == voxels.end())
+                            continue;
+                        for (int j : it->second)
+                        {
+                            const PointXYZRGB &q = b.points[j];
+                            float ex = q.x - p.x, ey = q.y - p.y, ez = q.z - p.z;
+                            best2 = min(best2, ex * ex + ey * ey + ez * ez);
+                        }
+                    }
+            dists[k] = std::sqrt(best2);
+        }
+    }, num_threads, 256);
+    return dists;
+}
+
+CloudDistance compareClouds(const PointCloud<PointXYZRGB> &a, const PointCloud<PointXYZRGB> &b,
+                            float max_distance, int num_threads)
+{
+    CloudDistance res;
+    res.size_a = a.points.size();
+    res.size_b = b.points.size();
+    res.chamfer = res.hausdorff = res.p95 = 0;
+    vector<float> dists[2] = {directedDistances(a, b, max_distance, num_threads),
+                              directedDistances(b, a, max_distance, num_threads)};
+    for (vector<float> &d : dists)
+    {
+        if (d.empty())
+            continue;
+        double sum = 0;
+        for (float x : d)
+            sum += x;
+        res.chamfer += sum / d.size() / 2;
+        size_t k95 = d.size() * 95 / 100;
+        nth_element(d.begin(), d.begin() + k95, d.end());
+        res.p95 = max(res.p95, (double)d[k95]);
+        res.hausdorff = max(res.hausdorff, (double)*max_element(d.begin(), d.end()));
+    }
+    if (dists[0].empty() != dists[1].empty()) // one cloud is empty
+        res.chamfer = res.hausdorff = res.p95 = max_distance;
+    return res;
+}
+
+void computePoseError(const Eigen::Matrix4f &T_a, const Eigen::Matrix4f &T_b, double &rot_degrees, double &trans)
+{
+    Eigen::Matrix4d T = T_a.cast<double>().inverse() * T_b.cast<double>();
+    rot_degrees = Eigen::AngleAxisd(Eigen::Matrix3d(T.block<3, 3>(0, 0))).angle() * 180 / M_PI;
+    trans = T.block<3, 1>(0, 3).norm();
+}
+
+} // namespace my_pcl
@@ -0,0 +1,165 @@
+#include "my_pcl/pcl_next_best_view.h"
+#include "my_basics/parallel.h"
+
+#include <cmath>
+#include <limits>
+
+namespace my_pcl
+{
+
+NextBestViewPlanner::NextBestViewPlanner(float x_min, float x_max, float y_min, float y_max,
+                                         float z_min, float z_max, float voxel_size)
+    : min_(x_min, y_min, z_min), max_(x_max, y_max, z_max), voxel_size_(voxel_size)
+{
+    assert(voxel_size > 0 && x_max > x_min && y_max > y_min && z_max > z_min);
+    nx_ = std::ceil((x_max - x_min) / voxel_size);
+    ny_ = std::ceil((y_max - y_min) / voxel_size);
+    nz_ = std::ceil((z_max - z_min) / voxel_size);
+    max_ = min_ + Eigen::Vector3f(nx_, ny_, nz_) * voxel_size; // whole voxels
+    clear();
+}
+
+void NextBestViewPlanner::clear()
+{
+    states_.assign(nx_ * ny_ * nz_, UNKNOWN);
+    num_unknown_ = states_.size();
+    num_occupied_ = 0;
+    num_views_ = 0;
+}
+
+template <class Visitor>
+bool NextBestViewPlanner::traverse(const Eigen::Vector3f &p0, const Eigen::Vector3f &p1, Visitor visit) const
+{
+    // -- Clip the segment p0 + t * d, t in [0, 1], to the box
+    const Eigen::Vector3f d = p1 - p0;
+    float t_enter = 0, t_exit = 1;
+    for (int a = 0; a < 3; a++)
+    {
+        if (std::abs(d[a]) < 1e-9f)
+        {
+            if (p0[a] < min_[a] || p0[a] >= max_[a])
+                return true;
+            continue;
+        }
+        float ta = (min_[a] - p0[a]) / d[a], tb = (max_[a] - p0[a]) / d[a];
+        if (ta > tb)
+            std::swap(ta, tb);
+        t_enter = max(t_enter, ta);
+        t_exit = min(t_exit, tb);
+        if (t_enter > t_exit)
+            return true;
+    }
+
+    // -- Walk from voxel to voxel. t_next[a]: t of the next voxel border on axis a
+    const int n[3] = {nx_, ny_, nz_};
+    const Eigen::Vector3f start = p0 + t_enter * d;
+    int cell[3], step[3];
+    float t_next[3], t_delta[3];
+    for (int a = 0; a < 3; a++)
+    {
+        cell[a] = min(max((int)std::floor((start[a] - min_[a]) / voxel_size_), 0), n[a] - 1);
+        if (d[a] == 0)
+        {
+            step[a] = 0;
+            t_delta[a] = t_next[a] = std::numeric_limits<float>::max();
+            continue;
+        }
+        step[a] = d[a] > 0 ? 1 : -1;
+        t_delta[a] = voxel_size_ / std::abs(d[a]);
+        t_next[a] = (min_[a] + (cell[a] + (d[a] > 0)) * voxel_size_ - p0[a]) / d[a];
+    }
+    while (1)
+    {
+        if (!visit(index(cell[0], cell[1], cell[2])))
+            return false;
+        int a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+        if (t_next[a] > t_exit)
+            return true;
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= n[a])
+            return true;
+        t_next[a] += t_delta[a];
+    }
+}
+
+void NextBestViewPlanner::integrateView(const PointCloud<PointXYZRGB> &cloud, const Eigen::Matrix4f &T_box_to_cloud,
+                                        int sample_stride)
+{
+    const Eigen::Matrix3f R = T_box_to_cloud.block<3, 3>(0, 0);
+    const Eigen::Vector3f origin = T_box_to_cloud.block<3, 1>(0, 3);
+    sample_stride = max(sample_stride, 1);
+    for (size_t i = 0; i < cloud.points.size(); i += sample_stride)
+    {
+        const PointXYZRGB &p = cloud.points[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            continue;
+        Eigen::Vector3f q = R * Eigen::Vector3f(p.x, p.y, p.z) + origin;
+
+        // -- The voxel of the point
+        int end_idx = -1;
+        if ((q.array() >= min_.array()).all() && (q.array() < max_.array()).all())
+        {
+            Eigen::Vector3f c = (q - min_) / voxel_size_;
+            end_idx = index(min((int)c.x(), nx_ - 1), min((int)c.y(), ny_ - 1), min((int)c.z(), nz_ - 1));
+        }
+
+        // -- Free space in front of it. A voxel seen as occupied stays occupied.
+        traverse(origin, q, [&](int idx) {
+            if (idx != end_idx && states_[idx] == UNKNOWN)
+            {
+                states_[idx] = FREE;
+                num_unknown_--;
+            }
+            return true;
+        });
+
+        if (end_idx >= 0 && states_[end_idx] != OCCUPIED)
+        {
+            num_unknown_ -= states_[end_idx] == UNKNOWN;
+            states_[end_idx] = OCCUPIED;
+            num_occupied_++;
+        }
+    }
+    num_views_++;
+}
+
+int NextBestViewPlanner::computeGain(const Eigen::Matrix4f &T_box_to_camera, const CameraIntrinsics &intrinsics,
+                                     int pixel_step) const
+{
+    const Eigen::Matrix3f R = T_box_to_camera.block<3, 3>(0, 0);
+    const Eigen::Vector3f origin = T_box_to_camera.block<3, 1>(0, 3);
+    pixel_step = max(pixel_step, 1);
+    vector<bool> counted(states_.size(), false);
+    int gain = 0;
+    for (int v = pixel_step / 2; v < intrinsics.height; v += pixel_step)
+        for (int u = pixel_step / 2; u < intrinsics.width; u += pixel_step)
+        {
+            Eigen::Vector3f dir = R * Eigen::Vector3f((u - intrinsics.cx) / intrinsics.fx,
+                                                      (v - intrinsics.cy) / intrinsics.fy, 1).normalized();
+            traverse(origin + intrinsics.min_depth * dir, origin + intrinsics.max_depth * dir, [&](int idx) {
+                if (states_[idx] == OCCUPIED)
+                    return false;
+                if (states_[idx] == UNKNOWN && !counted[idx])
+                {
+                    counted[idx] = true;
+                    gain++;
+                }
+                return true;
+            });
+        }
+    return gain;
+}
+
+vector<int> NextBestViewPlanner::computeGains(
+    const vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &candidates,
+    const CameraIntrinsics &intrinsics, int pixel_step, int num_threads) const
+{
+    vector<int> gains(candidates.size(), 0);
+    my_basics::parallelFor(0, candidates.size(), [&](int begin, int end, int) {
+        for (int k = begin; k < end; k++)
+            gains[k] = computeGain(candidates[k], intrinsics, pixel_step);
+    }, num_threads, 1);
+    return gains;
+}
+
+} // namespace my_pcl
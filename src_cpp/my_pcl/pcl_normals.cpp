@@ -0,0 +1,99 @@
+#include "my_pcl/pcl_normals.h"
+#include "my_basics/parallel.h"
+
+#include <pcl/features/integral_image_normal.h> // IntegralImageNormalEstimation
+#include <pcl/features/normal_3d_omp.h>         // NormalEstimationOMP
+#include <pcl/search/kdtree.h>
+#include <pcl/common/io.h> // concatenateFields
+
+namespace my_pcl
+{
+
+PointCloud<Normal>::Ptr
+computeNormalsIntegralImage(const PointCloud<PointXYZRGB>::Ptr cloud,
+                            float max_depth_change_factor, float normal_smoothing_size)
+{
+    assert(cloud->isOrganized());
+    PointCloud<Normal>::Ptr normals(new PointCloud<Normal>);
+    IntegralImageNormalEstimation<PointXYZRGB, Normal> ne;
+    ne.setNormalEstimationMethod(ne.COVARIANCE_MATRIX); // also gives curvature
+    ne.setMaxDepthChangeFactor(max_depth_change_factor);
+    ne.setNormalSmoothingSize(normal_smoothing_size);
+    ne.setInputCloud(cloud);
+    ne.compute(*normals); // normals point to the sensor origin (0,0,0) of the organized cloud
+    return normals;
+}
+
+PointCloud<Normal>::Ptr
+computeNormalsPCA(const PointCloud<PointXYZRGB>::Ptr cloud,
+                  int k_search, double radius_search, int num_threads)
+{
+    assert(k_search > 0 || radius_search > 0);
+    PointCloud<Normal>::Ptr normals(new PointCloud<Normal>);
+    search::KdTree<PointXYZRGB>::Ptr tree(new search::KdTree<PointXYZRGB>);
+    NormalEstimationOMP<PointXYZRGB, Normal> ne;
+    ne.setNumberOfThreads(my_basics::getNumThreads(num_threads));
+    ne.setSearchMethod(tree);
+    if (k_search > 0)
+        ne.setKSearch(k_search);
+    else
+        ne.setRadiusSearch(radius_search);
+    ne.setInputCloud(cloud);
+    ne.compute(*normals);
+    return normals;
+}
+
+PointCloud<Normal>::Ptr
+computeNormalsPCA(FrameSpatialIndex &index, int k_search, double radius_search, int num_threads)
+{
+    assert(k_search > 0 || radius_search > 0);
+    PointCloud<Normal>::Ptr normals(new PointCloud<Normal>);
+    NormalEstimationOMP<PointXYZRGB, Normal> ne;
+    ne.setNumberOfThreads(my_basics::getNumThreads(num_threads));
+    ne.setSearchMethod(index.getKdTree()); // same input cloud, so the tree is not rebuilt
+    if (k_search > 0)
+        ne.setKSearch(k_search);
+    else
+        ne.setRadiusSearch(radius_search);
+    ne.setInputCloud(index.getCloud());
+    ne.setIndices(boost::const_pointer_cast<vector<int>>(index.getValidIndices()));
+    ne.compute(*normals);
+    return normals;
+}
+
+void orientNormalsTowardsViewpoint(const PointCloud<PointXYZRGB>::Ptr cloud, PointCloud<Normal>::Ptr normals,
+                                   float vx, float vy, float vz)
+{
+    assert(cloud->points.size() == normals->points.size());
+    for (size_t i = 0; i < cloud->points.size(); i++)
+    {
+        const PointXYZRGB &p = cloud->points[i];
+        Normal &n = normals->points[i];
+        float dot = (vx - p.x) * n.normal_x + (vy - p.y) * n.normal_y + (vz - p.z) * n.normal_z;
+        if (dot < 0)
+        {
+            n.normal_x = -n.normal_x;
+            n.normal_y = -n.normal_y;
+            n.normal_z = -n.normal_z;
+        }
+    }
+}
+
+void orientNormalsTowardsCamera(const PointCloud<PointXYZRGB>::Ptr cloud, PointCloud<Normal>::Ptr normals,
+                                const vector<vector<float>> &T_frame_to_depthcam)
+{
+    assert(T_frame_to_depthcam.size() == 4 && T_frame_to_depthcam[0].size() == 4);
+    // The camera center is the translation part of the pose.
+    orientNormalsTowardsViewpoint(cloud, normals,
+                                  T_frame_to_depthcam[0][3], T_frame_to_depthcam[1][3], T_frame_to_depthcam[2][3]);
+}
+
+PointCloud<PointXYZRGBNormal>::Ptr
+combinePointsAndNormals(const PointCloud<PointXYZRGB>::Ptr cloud, const PointCloud<Normal>::Ptr normals)
+{
+    PointCloud<PointXYZRGBNormal>::Ptr res(new PointCloud<PointXYZRGBNormal>);
+    concatenateFields(*cloud, *normals, *res);
+    return res;
+}
+
+} // namespace my_pcl
@@ -0,0 +1,119 @@
+#include "my_pcl/pcl_object_tracker.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace my_pcl
+{
+
+// Boxes are padded by this (meters) on each side, so that a flat cluster (e.g. the top of a box) has a volume
+static const float BOX_PADDING = 0.005;
+
+static float getPaddedVolume(const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt)
+{
+    Eigen::Vector3f size = (max_pt - min_pt).array() + 2 * BOX_PADDING;
+    return size.x() * size.y() * size.z();
+}
+
+// Volume of the intersection over the volume of the smaller box
+static float getBoxOverlap(const Eigen::Vector3f &min_a, const Eigen::Vector3f &max_a,
+                           const Eigen::Vector3f &min_b, const Eigen::Vector3f &max_b)
+{
+    Eigen::Vector3f size = (max_a.cwiseMin(max_b) - min_a.cwiseMax(min_b)).array() + 2 * BOX_PADDING;
+    if ((size.array() <= 0).any())
+        return 0;
+    float volume = size.x() * size.y() * size.z();
+    return volume / min(getPaddedVolume(min_a, max_a), getPaddedVolume(min_b, max_b));
+}
+
+ObjectTracker::ObjectTracker(float max_centroid_distance, float min_box_overlap, int max_objects)
+    : max_centroid_distance_(max_centroid_distance), min_box_overlap_(min_box_overlap), max_objects_(max_objects)
+{
+}
+
+void ObjectTracker::clear()
+{
+    objects_.clear();
+}
+
+vector<int> ObjectTracker::addView(const vector<PointCloud<PointXYZRGB>::Ptr> &clusters)
+{
+    const int num_clusters = clusters.size();
+    vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f>> min_pts(num_clusters), max_pts(num_clusters),
+        centroids(num_clusters);
+    vector<int> num_points(num_clusters, 0);
+    for (int c = 0; c < num_clusters; c++)
+    {
+        min_pts[c].setConstant(std::numeric_limits<float>::max());
+        max_pts[c].setConstant(-std::numeric_limits<float>::max());
+        centroids[c].setZero();
+        for (const PointXYZRGB &p : clusters[c]->points)
+        {
+            if (!pcl::isFinite(p))
+                continue;
+            Eigen::Vector3f q(p.x, p.y, p.z);
+            min_pts[c] = min_pts[c].cwiseMin(q);
+            max_pts[c] = max_pts[c].cwiseMax(q);
+            centroids[c] += q;
+            num_points[c]++;
+        }
+        if (num_points[c] > 0)
+            centroids[c] /= num_points[c];
+    }
+
+    // -- Match each cluster with the existing objects: the largest overlap, then the nearest centroid
+    const int num_old_objects = objects_.size();
+    vector<int> ids(num_clusters, -1);
+    for (int c = 0; c < num_clusters; c++)
+    {
+        if (num_points[c] == 0)
+            continue;
+        float best_overlap = -1, best_distance = std::numeric_limits<float>::max();
+        for (int k = 0; k < num_old_objects; k++)
+        {
+            const TrackedObject &obj = objects_[k];
+            float overlap = getBoxOverlap(min_pts[c], max_pts[c], obj.min_pt, obj.max_pt);
+            float distance = (centroids[c] - obj.centroid).norm();
+            if (overlap < min_box_overlap_ && distance > max_centroid_distance_)
+                continue;
+            if (overlap > best_overlap || (overlap == best_overlap && distance < best_distance))
+                best_overlap = overlap, best_distance = distance, ids[c] = k;
+        }
+    }
+
+    // -- Update the matched objects, and start new ones
+    vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f>> sums(num_old_objects, Eigen::Vector3f::Zero());
+    vector<int> counts(num_old_objects, 0);
+    for (int c = 0; c < num_clusters; c++)
+    {
+        if (num_points[c] == 0)
+            continue;
+        if (ids[c] < 0)
+        {
+            if ((int)objects_.size() >= max_objects_)
+                continue;
+            TrackedObject obj;
+            obj.id = objects_.size();
+            obj.min_pt = min_pts[c], obj.max_pt = max_pts[c];
+            obj.centroid = centroids[c];
+            obj.num_views = 1;
+            objects_.push_back(obj);
+            ids[c] = obj.id;
+            continue;
+        }
+        TrackedObject &obj = objects_[ids[c]];
+        obj.min_pt = obj.min_pt.cwiseMin(min_pts[c]);
+        obj.max_pt = obj.max_pt.cwiseMax(max_pts[c]);
+        sums[ids[c]] += centroids[c] * num_points[c];
+        counts[ids[c]] += num_points[c];
+    }
+    for (int k = 0; k < num_old_objects; k++)
+        if (counts[k] > 0)
+        {
+            objects_[k].centroid = sums[k] / counts[k];
+            objects_[k].num_views++;
+        }
+    return ids;
+}
+
+} // namespace my_pcl
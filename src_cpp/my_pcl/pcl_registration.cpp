@@ -0,0 +1,215 @@
+#include "my_pcl/pcl_registration.h"
+#include "my_pcl/pcl_filters.h"
+
+#include <pcl/registration/icp.h>
+#include <pcl/common/transforms.h>
+#include <Eigen/Dense>
+
+namespace my_pcl
+{
+
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+// [rotation vector; translation] --> 4x4
+static Eigen::Matrix4d exp6(const Vector6d &v)
+{
+    Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+    Eigen::Vector3d w = v.head<3>();
+    double angle = w.norm();
+    if (angle > 1e-12)
+        T.block<3, 3>(0, 0) = Eigen::AngleAxisd(angle, w / angle).toRotationMatrix();
+    T.block<3, 1>(0, 3) = v.tail<3>();
+    return T;
+}
+
+// 4x4 --> [rotation vector; translation]
+static Vector6d log6(const Eigen::Matrix4d &T)
+{
+    Vector6d v;
+    Eigen::AngleAxisd aa(Eigen::Matrix3d(T.block<3, 3>(0, 0)));
+    v.head<3>() = aa.angle() * aa.axis();
+    v.tail<3>() = T.block<3, 1>(0, 3);
+    return v;
+}
+
+static Eigen::Matrix4d invSE3(const Eigen::Matrix4d &T)
+{
+    Eigen::Matrix4d inv = Eigen::Matrix4d::Identity();
+    inv.block<3, 3>(0, 0) = T.block<3, 3>(0, 0).transpose();
+    inv.block<3, 1>(0, 3) = -inv.block<3, 3>(0, 0) * T.block<3, 1>(0, 3);
+    return inv;
+}
+
+// Residual of edge (i, j): log(T_ij^-1 * X_i^-1 * X_j)
+static Vector6d edgeResidual(const Eigen::Matrix4d &T_ij, const Eigen::Matrix4d &X_i, const Eigen::Matrix4d &X_j)
+{
+    return log6(invSE3(T_ij) * invSE3(X_i) * X_j);
+}
+
+// ------------------------------------------------------------------------------------
+
+MultiViewRegistration::MultiViewRegistration(float voxel_size, float max_correspondence_distance,
+                                             int icp_max_iterations, int max_neighbors,
+                                             double max_fitness, int num_threads)
+    : voxel_size_(voxel_size), max_correspondence_distance_(max_correspondence_distance),
+      icp_max_iterations_(icp_max_iterations), max_neighbors_(max_neighbors),
+      max_fitness_(max_fitness), pool_(num_threads)
+{
+}
+
+MultiViewRegistration::~MultiViewRegistration()
+{
+    pool_.waitAll();
+}
+
+void MultiViewRegistration::clear()
+{
+    pool_.waitAll();
+    views_.clear();
+    views_down_.clear();
+    camera_pos_.clear();
+    corrections_.clear();
+    alignments_.clear();
+}
+
+int MultiViewRegistration::addView(const PointCloud<PointXYZRGB>::Ptr cloud, const Eigen::Vector3f &camera_pos)
+{
+    int j = views_.size();
+    views_.push_back(CompactCloud()); // 0.1 mm around the origin of the common frame
+    int num_dropped = views_.back().fromPCL(*cloud);
+    if (num_dropped > 0)
+        cout << "my WARNING: MultiViewRegistration drops " << num_dropped << " points out of range." << endl;
+    PointCloud<PointXYZRGB>::Ptr view_down; // a new cloud, since the caller may reuse its cloud
+    if (voxel_size_ > 0)
+        view_down = filtByVoxelGrid(cloud, voxel_size_, voxel_size_, voxel_size_);
+    else
+        view_down.reset(new PointCloud<PointXYZRGB>(*cloud));
+    views_down_.push_back(view_down);
+    camera_pos_.push_back(camera_pos);
+    corrections_.push_back(Eigen::Matrix4d::Identity());
+
+    // -- Choose the previous views that see the object from the nearest positions
+    vector<pair<float, int>> dists;
+    for (int i = 0; i < j; i++)
+        dists.push_back(make_pair((camera_pos_[i] - camera_pos).norm(), i));
+    sort(dists.begin(), dists.end());
+    int num_neighbors = max_neighbors_ > 0 ? min(max_neighbors_, j) : j;
+
+    // -- Queue the pairwise alignments. Clouds are passed by pointer, so the vectors above can grow meanwhile.
+    for (int k = 0; k < num_neighbors; k++)
+    {
+        int i = dists[k].second;
+        PointCloud<PointXYZRGB>::Ptr target = views_down_[i], source = views_down_[j];
+        pool_.push([this, i, j, target, source]() { alignPair(i, j, target, source); });
+    }
+    return j;
+}
+
+void MultiViewRegistration::alignPair(int i, int j, PointCloud<PointXYZRGB>::Ptr target,
+                                      PointCloud<PointXYZRGB>::Ptr source)
+{
+    ViewAlignment res;
+    res.i = i;
+    res.j = j;
+    res.converged = false;
+    res.fitness = 1e10;
+    res.T_ij.setIdentity();
+    if (source->points.size() >= 3 && target->points.size() >= 3)
+    {
+        IterativeClosestPoint<PointXYZRGB, PointXYZRGB> icp;
+        icp.setInputSource(source);
+        icp.setInputTarget(target);
+        icp.setMaxCorrespondenceDistance(max_correspondence_distance_);
+        icp.setMaximumIterations(icp_max_iterations_);
+        icp.setTransformationEpsilon(1e-8);
+        PointCloud<PointXYZRGB> aligned;
+        icp.align(aligned);
+        res.converged = icp.hasConverged();
+        res.fitness = icp.getFitnessScore(max_correspondence_distance_);
+        res.T_ij = icp.getFinalTransformation().cast<double>();
+    }
+    std::lock_guard<std::mutex> lock(mtx_alignments_);
+    alignments_.push_back(res);
+}
+
+int MultiViewRegistration::refine(int num_iterations, double prior_weight)
+{
+    pool_.waitAll();
+    int N = views_.size();
+    if (N <= 1)
+        return 0;
+
+    // -- Edges that are good enough
+    vector<ViewAlignment, Eigen::aligned_allocator<ViewAlignment>> edges;
+    for (const ViewAlignment &a : alignments_)
+        if (a.converged && a.fitness <= max_fitness_)
+            edges.push_back(a);
+    // The jobs finish in any order. Sort, so that the solution doesn't depend on the timing.
+    sort(edges.begin(), edges.end(), [](const ViewAlignment &a, const ViewAlignment &b) {
+        return a.i != b.i ? a.i < b.i : a.j < b.j;
+    });
+
+    // -- Gauss-Newton. Each view k is updated by X_k <- exp(delta_k) * X_k.
+    // Jacobians are computed numerically: the problem is tiny (6N unknowns).
+    const double eps = 1e-6;
+    const double fixed_weight = 1e6; // fix view 0
+    for (int iter = 0; iter < num_iterations; iter++)
+    {
+        Eigen::MatrixXd H = Eigen::MatrixXd::Zero(6 * N, 6 * N);
+        Eigen::VectorXd b = Eigen::VectorXd::Zero(6 * N);
+
+        for (const ViewAlignment &e : edges)
+        {
+            const Eigen::Matrix4d &X_i = corrections_[e.i], &X_j = corrections_[e.j];
+            Vector6d r = edgeResidual(e.T_ij, X_i, X_j);
+            Matrix6d J_i, J_j;
+            for (int d = 0; d < 6; d++)
+            {
+                Vector6d delta = Vector6d::Zero();
+                delta[d] = eps;
+                J_i.col(d) = (edgeResidual(e.T_ij, exp6(delta) * X_i, X_j) - r) / eps;
+                J_j.col(d) = (edgeResidual(e.T_ij, X_i, exp6(delta) * X_j) - r) / eps;
+            }
+            H.block<6, 6>(6 * e.i, 6 * e.i) += J_i.transpose() * J_i;
+            H.block<6, 6>(6 * e.j, 6 * e.j) += J_j.transpose() * J_j;
+            H.block<6, 6>(6 * e.i, 6 * e.j) += J_i.transpose() * J_j;
+            H.block<6, 6>(6 * e.j, 6 * e.i) += J_j.transpose() * J_i;
+            b.segment<6>(6 * e.i) += J_i.transpose() * r;
+            b.segment<6>(6 * e.j) += J_j.transpose() * r;
+        }
+
+        // Priors: stay near the arm pose (X_k = I). d(log(exp(delta)*X))/d(delta) ~= I.
+        for (int k = 0; k < N; k++)
+        {
+            double w = (k == 0) ? fixed_weight : prior_weight;
+            H.block<6, 6>(6 * k, 6 * k) += w * Matrix6d::Identity();
+            b.segment<6>(6 * k) += w * log6(corrections_[k]);
+        }
+
+        Eigen::VectorXd delta = H.ldlt().solve(-b);
+        for (int k = 0; k < N; k++)
+            corrections_[k] = exp6(delta.segment<6>(6 * k)) * corrections_[k];
+        if (delta.norm() < 1e-9)
+            break;
+    }
+    return edges.size();
+}
+
+PointCloud<PointXYZRGB>::Ptr MultiViewRegistration::getMergedCloud(float voxel_size) const
+{
+    PointCloud<PointXYZRGB>::Ptr merged(new PointCloud<PointXYZRGB>);
+    for (size_t k = 0; k < views_.size(); k++)
+    {
+        PointCloud<PointXYZRGB> moved;
+        transformPointCloud(*views_[k].toPCL(), moved, Eigen::Matrix4f(corrections_[k].cast<float>()));
+        *merged += moved;
+    }
+    merged->width = merged->points.size();
+    merged->height = 1;
+    if (voxel_size > 0)
+        merged = filtByVoxelGrid(merged, voxel_size, voxel_size, voxel_size);
+    return merged;
+}
+
+} // namespace my_pcl
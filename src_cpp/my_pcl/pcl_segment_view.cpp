@@ -0,0 +1,242 @@
+#include "my_pcl/pcl_segment_view.h"
+#include "my_pcl/pcl_filters.h"
+#include "my_pcl/pcl_advanced.h"
+#include "my_pcl/pcl_compact.h"
+#include "my_basics/basics.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace my_pcl
+{
+
+// All params of ViewSegmentationParams, for setting and listing them by name
+#define FOR_EACH_VIEW_SEGMENTATION_PARAM(F)                                                                  \
+    F(x_grid_size) F(y_grid_size) F(z_grid_size)                                                             \
+    F(voxel_point_budget) F(voxel_min_grid_size) F(voxel_max_grid_size) F(voxel_search_seconds)              \
+    F(flag_do_range_filt) F(flag_use_compact_cloud) F(compact_cloud_resolution)                              \
+    F(plane_distance_threshold_0) F(plane_distance_threshold) F(plane_max_iterations) F(num_planes)          \
+    F(ratio_of_rest_points) F(flag_detect_table_by_histogram)                                                \
+    F(flag_do_clustering) F(cluster_tolerance) F(min_cluster_size) F(max_cluster_size) F(flag_multi_object) \
+    F(flag_use_spatial_index) F(spatial_index_voxel_size)
+
+PointCloud<PointXYZRGB>::Ptr filtViewByVoxelGrid(const PointCloud<PointXYZRGB>::Ptr cloud,
+                                                 const ViewSegmentationParams &params,
+                                                 int &point_budget, float &grid_size)
+{
+    if (params.voxel_point_budget <= 0)
+    {
+        grid_size = params.x_grid_size;
+        if (!params.flag_use_compact_cloud)
+            return filtByVoxelGrid(cloud, params.x_grid_size, params.y_grid_size, params.z_grid_size);
+
+        // Quantized around the frame's origin. Points out of the int16 range (the far background) are dropped.
+        CompactCloud compact(params.compact_cloud_resolution);
+        compact.fromPCL(*cloud);
+        compact.voxelGrid(params.x_grid_size, params.y_grid_size, params.z_grid_size);
+        PointCloud<PointXYZRGB>::Ptr res = compact.toPCL();
+        res->header = cloud->header;
+        return res;
+    }
+    if (point_budget <= 0)
+        point_budget = params.voxel_point_budget;
+    return filtByVoxelGridToBudget(cloud, point_budget, grid_size, params.voxel_min_grid_size,
+                                   params.voxel_max_grid_size, params.voxel_search_seconds);
+}
+
+PointCloud<PointXYZRGB>::Ptr cropViewInChessFrame(const PointCloud<PointXYZRGB> &cloud_in_baxter_frame,
+                                                  const float T_chess_to_baxter[4][4], const CropBox &box,
+                                                  const ViewSegmentationParams &params)
+{
+    if (params.flag_use_compact_cloud)
+    {
+        // Quantized around the chessboard. Points far away from it are out of the int16 range and dropped at once.
+        const float(*T)[4] = T_chess_to_baxter;
+        float origin[3];
+        for (int i = 0; i < 3; i++) // -R^T * t
+            origin[i] = -(T[0][i] * T[0][3] + T[1][i] * T[1][3] + T[2][i] * T[2][3]);
+        CompactCloud compact(params.compact_cloud_resolution, origin[0], origin[1], origin[2]);
+        compact.fromPCL(cloud_in_baxter_frame);
+        compact.transform(T_chess_to_baxter, 0, 0, 0);
+        if (params.flag_do_range_filt)
+            compact.cropBox(box.x_min, box.x_max, box.y_min, box.y_max, box.z_min, box.z_max);
+        return compact.toPCL();
+    }
+
+    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
+    copyPointCloud(cloud_in_baxter_frame, *cloud);
+    for (PointXYZRGB &p : cloud->points)
+        my_basics::preTranslatePoint(T_chess_to_baxter, p.x, p.y, p.z);
+    if (params.flag_do_range_filt)
+    {
+        cloud = filtByPassThrough(cloud, "x", box.x_max, box.x_min);
+        cloud = filtByPassThrough(cloud, "y", box.y_max, box.y_min);
+        cloud = filtByPassThrough(cloud, "z", box.z_max, box.z_min);
+    }
+    return cloud;
+}
+
+// Same as segmentView, but all stages share one index of the cloud and only mark points as removed.
+static void segmentViewBySpatialIndex(const PointCloud<PointXYZRGB>::Ptr cloud, const ViewSegmentationParams &params,
+                                      SegmentedView &res)
+{
+    res.index.reset(new FrameSpatialIndex(cloud, params.spatial_index_voxel_size));
+
+    // -- Remove planes among {near plane}
+    vector<int> near_plane;
+    double th = params.plane_distance_threshold_0;
+    for (size_t i = 0; i < cloud->points.size(); i++)
+    {
+        float z = cloud->points[i].z;
+        if (z <= th && z >= -th)
+            near_plane.push_back(i);
+    }
+    int num_valid = res.index->getNumValid();
+    removePlanes(*res.index, near_plane,
+                 params.plane_distance_threshold, params.plane_max_iterations,
+                 params.num_planes, params.ratio_of_rest_points, params.flag_detect_table_by_histogram);
+    res.num_table_points = num_valid - res.index->getNumValid();
+
+    // -- Clustering: keep the largest cluster
+    if (params.flag_do_clustering)
+    {
+        vector<PointIndices> clusters_indices = divideIntoClusters(
+            *res.index, params.cluster_tolerance, params.min_cluster_size, params.max_cluster_size);
+        if (clusters_indices.empty())
+            cout << "my WARNING: no cluster is found. Keep all points." << endl;
+        else if (params.flag_multi_object) // keep all clusters
+        {
+            vector<int> indices;
+            for (const PointIndices &cluster : clusters_indices)
+            {
+                res.cloud_objects.push_back(PointCloud<PointXYZRGB>::Ptr(new PointCloud<PointXYZRGB>));
+                pcl::copyPointCloud(*cloud, cluster.indices, *res.cloud_objects.back());
+                indices.insert(indices.end(), cluster.indices.begin(), cluster.indices.end());
+            }
+            sort(indices.begin(), indices.end());
+            res.index->keepOnly(indices);
+        }
+        else
+            res.index->keepOnly(clusters_indices[0].indices);
+    }
+
+    res.cloud_segmented = res.index->extractValid();
+}
+
+void segmentView(const PointCloud<PointXYZRGB>::Ptr cloud, const ViewSegmentationParams &params, SegmentedView &res)
+{
+    res.cloud_objects.clear();
+    res.index.reset();
+    if (params.flag_use_spatial_index)
+    {
+        segmentViewBySpatialIndex(cloud, params, res);
+        return;
+    }
+
+    // -- Remove planes
+    // 1. Seprate cloud into {near plane} & {far from plane}
+    PointCloud<PointXYZRGB>::Ptr cld_near_plane(new PointCloud<PointXYZRGB>);
+    PointCloud<PointXYZRGB>::Ptr cld_far_plane(new PointCloud<PointXYZRGB>);
+    double th = params.plane_distance_threshold_0;
+    cld_near_plane->points.reserve(cloud->points.size());
+    cld_far_plane->points.reserve(cloud->points.size());
+    for (const PointXYZRGB &pt : cloud->points)
+    {
+        if (pt.z <= th && pt.z >= -th)
+            cld_near_plane->points.push_back(pt);
+        else
+            cld_far_plane->points.push_back(pt);
+    }
+    cld_near_plane->width = cld_near_plane->points.size();
+    cld_far_plane->width = cld_far_plane->points.size();
+    cld_near_plane->height = cld_far_plane->height = 1;
+
+    // 2. Remove plane in {near plane}
+    int num_near = cld_near_plane->points.size();
+    removePlanes(cld_near_plane,
+                 params.plane_distance_threshold, params.plane_max_iterations,
+                 params.num_planes, params.ratio_of_rest_points, false, params.flag_detect_table_by_histogram);
+    res.num_table_points = num_near - (int)cld_near_plane->points.size();
+
+    // 3. Combine {near plane} & {far from plane}
+    *cld_near_plane += *cld_far_plane;
+    res.cloud_segmented = cld_near_plane;
+
+    // -- Clustering: Divide the remaining point cloud into different clusters
+    if (params.flag_do_clustering)
+    {
+        // On the quantized cloud by a hash grid, if it holds all points (the indices are the same), or by a kdtree
+        vector<PointIndices> clusters_indices;
+        CompactCloud compact(params.compact_cloud_resolution);
+        if (params.flag_use_compact_cloud && compact.fromPCL(*res.cloud_segmented) == 0)
+            clusters_indices = compact.euclideanClusters(
+                params.cluster_tolerance, params.min_cluster_size, params.max_cluster_size);
+        else
+            clusters_indices = divideIntoClusters(
+                res.cloud_segmented, params.cluster_tolerance, params.min_cluster_size, params.max_cluster_size);
+
+        // -- Extract indices into cloud clusters
+        vector<PointCloud<PointXYZRGB>::Ptr> cloud_clusters =
+            extractSubCloudsByIndices(res.cloud_segmented, clusters_indices);
+        if (cloud_clusters.empty())
+            cout << "my WARNING: no cluster is found. Keep all points." << endl;
+        else if (params.flag_multi_object) // keep all clusters
+        {
+            res.cloud_objects = cloud_clusters;
+            res.cloud_segmented.reset(new PointCloud<PointXYZRGB>);
+            for (const PointCloud<PointXYZRGB>::Ptr &cloud_cluster : cloud_clusters)
+                *res.cloud_segmented += *cloud_cluster;
+        }
+        else
+            res.cloud_segmented = cloud_clusters[0];
+    }
+}
+
+bool setViewSegmentationParam(ViewSegmentationParams &params, const string &name, double value)
+{
+#define SET_PARAM(param)                                 \
+    if (name == #param)                                  \
+    {                                                    \
+        params.param = (decltype(params.param))value;    \
+        return true;                                     \
+    }
+    FOR_EACH_VIEW_SEGMENTATION_PARAM(SET_PARAM)
+#undef SET_PARAM
+    return false;
+}
+
+bool readViewSegmentationParams(const string &filename, ViewSegmentationParams &params)
+{
+    ifstream fin(filename);
+    if (!fin.is_open())
+    {
+        cout << "my WARNING: can't read the params file " << filename << endl;
+        return false;
+    }
+    string line;
+    while (getline(fin, line))
+    {
+        istringstream iss(line.substr(0, line.find('#')));
+        string name;
+        double value;
+        if (!(iss >> name))
+            continue;
+        if (!(iss >> value) || !setViewSegmentationParam(params, name, value))
+        {
+            cout << "my WARNING: unknown param, or no value: " << line << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<pair<string, double>> getViewSegmentationParams(const ViewSegmentationParams &params)
+{
+    vector<pair<string, double>> res;
+#define GET_PARAM(param) res.push_back(make_pair(string(#param), (double)params.param));
+    FOR_EACH_VIEW_SEGMENTATION_PARAM(GET_PARAM)
+#undef GET_PARAM
+    return res;
+}
+
+} // namespace my_pcl
@@ -0,0 +1,223 @@
+#include "my_pcl/pcl_shm_ring.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>    // O_CREAT, O_RDWR
+#include <sys/mman.h> // shm_open, mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // ftruncate, close
+
+namespace my_pcl
+{
+
+static const uint32_t SHM_RING_MAGIC = 0x53434e52; // "SCNR"
+static const uint32_t SHM_RING_VERSION = 1;
+static const size_t SHM_ALIGN = 64; // cache line
+
+static size_t alignUp(size_t n, size_t align) { return (n + align - 1) / align * align; }
+
+static size_t getSlotHeaderSize() { return alignUp(sizeof(ShmSlotHeader), SHM_ALIGN); }
+
+static ShmSlotHeader *getSlotHeader(unsigned char *base, uint32_t slot)
+{
+    const ShmRingHeader *hdr = reinterpret_cast<const ShmRingHeader *>(base);
+    return reinterpret_cast<ShmSlotHeader *>(
+        base + alignUp(sizeof(ShmRingHeader), SHM_ALIGN) + slot * hdr->slot_stride);
+}
+
+// ------------------------------------------------------------------------------------
+
+CloudShmRingWriter::CloudShmRingWriter(const string &shm_name, int num_slots, int slot_capacity)
+    : shm_name_(shm_name), map_size_(0), base_(NULL)
+{
+    assert(num_slots > 0 && slot_capacity > 0);
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shm ring needs lock-free 64-bit atomics");
+
+    size_t slot_stride = getSlotHeaderSize() + alignUp(slot_capacity * sizeof(PointXYZRGB), SHM_ALIGN);
+    map_size_ = alignUp(sizeof(ShmRingHeader), SHM_ALIGN) + num_slots * slot_stride;
+
+    shm_unlink(shm_name_.c_str()); // remove a stale ring left by a crashed node
+    int fd = shm_open(shm_name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd == -1)
+    {
+        cout << "my ERROR: shm_open fails for " << shm_name_ << ": " << strerror(errno) << endl;
+        return;
+    }
+    if (ftruncate(fd, map_size_) == -1)
+    {
+        cout << "my ERROR: ftruncate fails for " << shm_name_ << ": " << strerror(errno) << endl;
+        close(fd);
+        return;
+    }
+    void *p = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the memory alive
+    if (p == MAP_FAILED)
+    {
+        cout << "my ERROR: mmap fails for " << shm_name_ << ": " << strerror(errno) << endl;
+        return;
+    }
+    base_ = static_cast<unsigned char *>(p);
+
+    // -- Init headers. Magic is written last, so a reader never sees a half-initialized ring.
+    ShmRingHeader *hdr = reinterpret_cast<ShmRingHeader *>(base_);
+    hdr->version = SHM_RING_VERSION;
+    hdr->num_slots = num_slots;
+    hdr->slot_capacity = slot_capacity;
+    hdr->point_size = sizeof(PointXYZRGB);
+    hdr->slot_stride = slot_stride;
+    new (&hdr->write_count) std::atomic<uint64_t>(0);
+    for (int i = 0; i < num_slots; i++)
+    {
+        ShmSlotHeader *slot = getSlotHeader(base_, i);
+        new (&slot->seq) std::atomic<uint64_t>(0);
+        slot->width = slot->height = 0;
+        slot->stamp = 0;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    hdr->magic = SHM_RING_MAGIC;
+}
+
+CloudShmRingWriter::~CloudShmRingWriter()
+{
+    if (base_ != NULL)
+    {
+        munmap(base_, map_size_);
+        shm_unlink(shm_name_.c_str()); // readers that still map it keep their copy until they unmap
+    }
+}
+
+bool CloudShmRingWriter::write(const PointCloud<PointXYZRGB> &cloud, CloudShmSlotDesc &desc)
+{
+    if (base_ == NULL)
+        return false;
+    ShmRingHeader *hdr = reinterpret_cast<ShmRingHeader *>(base_);
+    if (cloud.points.size() > hdr->slot_capacity)
+    {
+        cout << "my WARNING: cloud of " << cloud.points.size() << " points exceeds the shm slot capacity "
+             << hdr->slot_capacity << endl;
+        return false;
+    }
+
+    uint64_t cnt = hdr->write_count.load(std::memory_order_relaxed);
+    uint32_t slot_idx = cnt % hdr->num_slots;
+    ShmSlotHeader *slot = getSlotHeader(base_, slot_idx);
+
+    // -- Seqlock write: odd seq while writing, then the next even seq.
+    uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    unsigned char *data = reinterpret_cast<unsigned char *>(slot) + getSlotHeaderSize();
+    memcpy(data, cloud.points.data(), cloud.points.size() * sizeof(PointXYZRGB));
+    bool is_organized = cloud.points.size() == (size_t)cloud.width * cloud.height;
+    slot->width = is_organized ? cloud.width : cloud.points.size();
+    slot->height = is_organized ? cloud.height : 1;
+    slot->stamp = cloud.header.stamp;
+
+    slot->seq.store(seq + 2, std::memory_order_release);
+    hdr->write_count.store(cnt + 1, std::memory_order_release);
+
+    // -- Output
+    desc.slot = slot_idx;
+    desc.seq = seq + 2;
+    desc.width = slot->width;
+    desc.height = slot->height;
+    desc.stamp = slot->stamp;
+    return true;
+}
+
+// ------------------------------------------------------------------------------------
+
+CloudShmRingReader::CloudShmRingReader(const string &shm_name)
+    : map_size_(0), base_(NULL)
+{
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+    {
+        cout << "my ERROR: shm_open fails for " << shm_name << ": " << strerror(errno) << endl;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(ShmRingHeader))
+    {
+        cout << "my ERROR: shared memory " << shm_name << " is not a cloud ring" << endl;
+        close(fd);
+        return;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        cout << "my ERROR: mmap fails for " << shm_name << ": " << strerror(errno) << endl;
+        return;
+    }
+
+    // -- Check the layout is what this build expects
+    const ShmRingHeader *hdr = static_cast<const ShmRingHeader *>(p);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (hdr->magic != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION ||
+        hdr->point_size != sizeof(PointXYZRGB))
+    {
+        cout << "my ERROR: shared memory " << shm_name << " has an incompatible layout" << endl;
+        munmap(p, st.st_size);
+        return;
+    }
+    map_size_ = st.st_size;
+    base_ = static_cast<unsigned char *>(p);
+}
+
+CloudShmRingReader::~CloudShmRingReader()
+{
+    if (base_ != NULL)
+        munmap(base_, map_size_);
+}
+
+const ShmSlotHeader *CloudShmRingReader::getSlot(uint32_t slot) const
+{
+    if (base_ == NULL || slot >= reinterpret_cast<const ShmRingHeader *>(base_)->num_slots)
+        return NULL;
+    return getSlotHeader(base_, slot);
+}
+
+const PointXYZRGB *CloudShmRingReader::acquire(const CloudShmSlotDesc &desc) const
+{
+    const ShmRingHeader *hdr = reinterpret_cast<const ShmRingHeader *>(base_);
+    const ShmSlotHeader *slot = getSlot(desc.slot);
+    if (slot == NULL || (uint64_t)desc.width * desc.height > hdr->slot_capacity)
+        return NULL;
+    if (slot->seq.load(std::memory_order_acquire) != desc.seq)
+        return NULL;
+    return reinterpret_cast<const PointXYZRGB *>(
+        reinterpret_cast<const unsigned char *>(slot) + getSlotHeaderSize());
+}
+
+bool CloudShmRingReader::validate(const CloudShmSlotDesc &desc) const
+{
+    const ShmSlotHeader *slot = getSlot(desc.slot);
+    if (slot == NULL)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->seq.load(std::memory_order_relaxed) == desc.seq;
+}
+
+bool CloudShmRingReader::read(const CloudShmSlotDesc &desc, PointCloud<PointXYZRGB>::Ptr &cloud) const
+{
+    const PointXYZRGB *points = acquire(desc);
+    if (points == NULL)
+        return false;
+    cloud.reset(new PointCloud<PointXYZRGB>);
+    cloud->points.assign(points, points + desc.width * desc.height);
+    if (!validate(desc))
+    {
+        cloud->points.clear();
+        return false;
+    }
+    cloud->width = desc.width;
+    cloud->height = desc.height;
+    cloud->header.stamp = desc.stamp;
+    cloud->is_dense = false;
+    return true;
+}
+
+} // namespace my_pcl
@@ -0,0 +1,288 @@
+#include "my_pcl/pcl_spatial_index.h"
+#include "my_pcl/pcl_filters.h"
+#include "my_basics/parallel.h"
+
+#include <cmath>
+
+namespace my_pcl
+{
+
+// Key of a voxel. Each coordinate must be within +-2^20.
+static inline uint64_t voxelKey(int64_t cx, int64_t cy, int64_t cz)
+{
+    const int64_t offset = 1 << 20;
+    return ((uint64_t)(cx + offset) << 42) | ((uint64_t)(cy + offset) << 21) | (uint64_t)(cz + offset);
+}
+
+FrameSpatialIndex::FrameSpatialIndex(const PointCloud<PointXYZRGB>::Ptr cloud, float voxel_size)
+    : cloud_(cloud), voxel_size_(voxel_size), num_stale_(0),
+      valid_(cloud->points.size()), num_valid_(0), num_kdtree_builds_(0)
+{
+    assert(voxel_size > 0);
+    for (size_t i = 0; i < cloud->points.size(); i++)
+    {
+        const PointXYZRGB &p = cloud->points[i];
+        valid_[i] = std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+        num_valid_ += valid_[i];
+    }
+    buildVoxels();
+}
+
+void FrameSpatialIndex::buildVoxels()
+{
+    voxels_.clear();
+    for (size_t i = 0; i < cloud_->points.size(); i++)
+    {
+        if (!valid_[i])
+            continue;
+        const PointXYZRGB &p = cloud_->points[i];
+        voxels_[voxelKey(std::floor(p.x / voxel_size_), std::floor(p.y / voxel_size_), std::floor(p.z / voxel_size_))]
+            .push_back(i);
+    }
+    num_stale_ = 0;
+}
+
+// ------------------------------------- Invalidation -------------------------------------
+
+void FrameSpatialIndex::onPointsRemoved(int num_removed)
+{
+    if (num_removed == 0)
+        return;
+    num_valid_ -= num_removed;
+    num_stale_ += num_removed;
+    valid_indices_.reset();
+    tree_.reset();
+    if (num_stale_ > num_valid_) // most entries of the voxels are useless
+        buildVoxels();
+}
+
+void FrameSpatialIndex::removePoints(const vector<int> &indices)
+{
+    int num_removed = 0;
+    for (int i : indices)
+        if (valid_[i])
+        {
+            valid_[i] = false;
+            num_removed++;
+        }
+    onPointsRemoved(num_removed);
+}
+
+void FrameSpatialIndex::keepOnly(const vector<int> &indices)
+{
+    vector<bool> keep(valid_.size(), false);
+    for (int i : indices)
+        keep[i] = true;
+    int num_removed = 0;
+    for (size_t i = 0; i < valid_.size(); i++)
+        if (valid_[i] && !keep[i])
+        {
+            valid_[i] = false;
+            num_removed++;
+        }
+    onPointsRemoved(num_removed);
+}
+
+IndicesConstPtr FrameSpatialIndex::getValidIndices()
+{
+    if (!valid_indices_)
+    {
+        valid_indices_.reset(new vector<int>);
+        valid_indices_->reserve(num_valid_);
+        for (size_t i = 0; i < valid_.size(); i++)
+            if (valid_[i])
+                valid_indices_->push_back(i);
+    }
+    return valid_indices_;
+}
+
+PointCloud<PointXYZRGB>::Ptr FrameSpatialIndex::extractValid()
+{
+    IndicesConstPtr indices = getValidIndices();
+    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
+    cloud->header = cloud_->header;
+    cloud->points.reserve(indices->size());
+    for (int i : *indices)
+        cloud->points.push_back(cloud_->points[i]);
+    cloud->width = cloud->points.size();
+    cloud->height = 1;
+    cloud->is_dense = true;
+    return cloud;
+}
+
+// ------------------------------------- Neighbors -------------------------------------
+
+void FrameSpatialIndex::radiusSearch(int i, float radius, vector<int> &neighbors) const
+{
+    neighbors.clear();
+    const PointXYZRGB &p = cloud_->points[i];
+    int64_t cx = std::floor(p.x / voxel_size_), cy = std::floor(p.y / voxel_size_), cz = std::floor(p.z / voxel_size_);
+    int64_t r = std::ceil(radius / voxel_size_);
+    float radius2 = radius * radius;
+    for (int64_t dx = -r; dx <= r; dx++)
+        for (int64_t dy = -r; dy <= r; dy++)
+            for (int64_t dz = -r; dz <= r; dz++)
+            {
+                unordered_map<uint64_t, vector<int>>::const_iterator it = voxels_.find(voxelKey(cx + dx, cy + dy, cz + dz));
+                if (it == voxels_.end())
+                    continue;
+                for (int j : it->second)
+                {
+                    if (!valid_[j])
+                        continue;
+                    const PointXYZRGB &q = cloud_->points[j];
+                    float ex = q.x - p.x, ey = q.y - p.y, ez = q.z - p.z;
+                    if (ex * ex + ey * ey + ez * ez <= radius2)
+                        neighbors.push_back(j);
+                }
+            }
+}
+
+search::KdTree<PointXYZRGB>::Ptr FrameSpatialIndex::getKdTree()
+{
+    if (!tree_)
+    {
+        tree_.reset(new search::KdTree<PointXYZRGB>);
+        tree_->setInputCloud(cloud_, getValidIndices());
+        num_kdtree_builds_++;
+    }
+    return tree_;
+}
+
+// ------------------------------------- Stages -------------------------------------
+
+int filtByStatisticalOutlierRemoval(FrameSpatialIndex &index, float mean_k, float std_dev, int num_threads)
+{
+    // Mean distance of each point to its mean_k neighbors
+    search::KdTree<PointXYZRGB>::Ptr tree = index.getKdTree();
+    IndicesConstPtr indices = index.getValidIndices();
+    const PointCloud<PointXYZRGB> &cloud = *index.getCloud();
+    int N = indices->size();
+    vector<float> mean_dists(N, 0);
+    my_basics::parallelFor(0, N, [&](int begin, int end, int) {
+        vector<int> nn_indices;
+        vector<float> nn_dists;
+        for (int k = begin; k < end; k++)
+        {
+            int num_found = tree->nearestKSearch(cloud.points[(*indices)[k]], mean_k + 1, nn_indices, nn_dists);
+            double sum = 0;
+            for (int n = 1; n < num_found; n++) // the first one is the point itself
+                sum += std::sqrt(nn_dists[n]);
+            mean_dists[k] = num_found > 1 ? sum / (num_found - 1) : 0;
+        }
+    }, num_threads, 256);
+
+    // Remove the points farther than mean + std_dev * stddev
+    double sum = 0, sq_sum = 0;
+    for (float d : mean_dists)
+        sum += d, sq_sum += d * d;
+    double mean = sum / max(N, 1);
+    double stddev = std::sqrt(max(0.0, (sq_sum - sum * sum / max(N, 1)) / max(N - 1, 1)));
+    double threshold = mean + std_dev * stddev;
+    vector<int> outliers;
+    for (int k = 0; k < N; k++)
+        if (mean_dists[k] > threshold)
+            outliers.push_back((*indices)[k]);
+    index.removePoints(outliers);
+    return outliers.size();
+}
+
+vector<PointIndices> divideIntoClusters(const FrameSpatialIndex &index, double cluster_tolerance,
+                                        int min_cluster_size, int max_cluster_size)
+{
+    int N = index.getCloud()->points.size();
+    vector<bool> processed(N, false);
+    vector<PointIndices> clusters;
+    vector<int> queue, neighbors;
+    for (int seed = 0; seed < N; seed++)
+    {
+        if (!index.isValid(seed) || processed[seed])
+            continue;
+        queue.clear();
+        queue.push_back(seed);
+        processed[seed] = true;
+        for (size_t k = 0; k < queue.size(); k++)
+        {
+            index.radiusSearch(queue[k], cluster_tolerance, neighbors);
+            for (int j : neighbors)
+                if (!processed[j])
+                {
+                    processed[j] = true;
+                    queue.push_back(j);
+                }
+        }
+        if ((int)queue.size() >= min_cluster_size && (int)queue.size() <= max_cluster_size)
+        {
+            PointIndices cluster;
+            cluster.indices = queue;
+            sort(cluster.indices.begin(), cluster.indices.end());
+            clusters.push_back(cluster);
+        }
+    }
+    sort(clusters.begin(), clusters.end(),
+         [](const PointIndices &a, const PointIndices &b) { return a.indices.size() > b.indices.size(); });
+    return clusters;
+}
+
+int removePlanes(FrameSpatialIndex &index, const vector<int> &candidate_indices,
+                 float plane_distance_threshold, int plane_max_iterations,
+                 int stop_criteria_num_planes, float stop_criteria_rest_points_ratio,
+                 bool horizontal_first)
+{
+    assert(stop_criteria_num_planes >= 0 || stop_criteria_rest_points_ratio >= 0);
+    vector<int> candidates;
+    for (int i : candidate_indices)
+        if (index.isValid(i))
+            candidates.push_back(i);
+    int total_points = candidates.size();
+    int cnt_planes = 0;
+    while (1)
+    {
+        if (stop_criteria_num_planes >= 0)
+        {
+            if (cnt_planes >= stop_criteria_num_planes)
+                break;
+        }
+        else
+        {
+            if (candidates.size() <= stop_criteria_rest_points_ratio * total_points)
+                break;
+        }
+
+        // -- detectPlane on the candidates
+        PointCloud<PointXYZRGB>::Ptr sub_cloud(new PointCloud<PointXYZRGB>);
+        for (int i : candidates)
+            sub_cloud->points.push_back(index.getCloud()->points[i]);
+        sub_cloud->width = sub_cloud->points.size();
+        sub_cloud->height = 1;
+        ModelCoefficients::Ptr coefficients;
+        PointIndices::Ptr inliers;
+        bool res = sub_cloud->points.size() >= 3 && horizontal_first && cnt_planes == 0 &&
+                   detectHorizontalPlane(sub_cloud, coefficients, inliers, plane_distance_threshold);
+        if (!res && (sub_cloud->points.size() < 3 ||
+                     !detectPlane(sub_cloud, coefficients, inliers, plane_distance_threshold, plane_max_iterations)))
+        {
+            cout << "my WARNING: removePlanes' iteration fails to reach the desired times." << endl;
+            break;
+        }
+        cnt_planes++;
+
+        // -- Remove the plane from the index and from the candidates
+        vector<bool> is_inlier(candidates.size(), false);
+        vector<int> plane;
+        for (int k : inliers->indices)
+        {
+            is_inlier[k] = true;
+            plane.push_back(candidates[k]);
+        }
+        index.removePoints(plane);
+        vector<int> rest;
+        for (size_t k = 0; k < candidates.size(); k++)
+            if (!is_inlier[k])
+                rest.push_back(candidates[k]);
+        candidates.swap(rest);
+    }
+    return cnt_planes;
+}
+
+} // namespace my_pcl
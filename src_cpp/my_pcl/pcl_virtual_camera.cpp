@@ -0,0 +1,418 @@
+#include "my_pcl/pcl_virtual_camera.h"
+#include "my_basics/parallel.h"
+
+#include <pcl/io/ply_io.h>
+#include <pcl/conversions.h>
+#include <pcl/PolygonMesh.h>
+
+#include <cmath>
+#include <random>
+#include <limits>
+
+namespace my_pcl
+{
+
+static const int BVH_LEAF_SIZE = 4;
+
+static inline uint32_t packRGB(uint8_t r, uint8_t g, uint8_t b)
+{
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+}
+
+static inline Eigen::Vector3f transformPoint(const Eigen::Matrix4f &T, const Eigen::Vector3f &p)
+{
+    return T.block<3, 3>(0, 0) * p + T.block<3, 1>(0, 3);
+}
+
+// Möller–Trumbore. Return the distance along the ray, or -1.
+static inline float intersectTriangle(const Eigen::Vector3f &origin, const Eigen::Vector3f &dir,
+                                      const Eigen::Vector3f &v0, const Eigen::Vector3f &v1, const Eigen::Vector3f &v2)
+{
+    Eigen::Vector3f e1 = v1 - v0, e2 = v2 - v0;
+    Eigen::Vector3f p = dir.cross(e2);
+    float det = e1.dot(p);
+    if (std::fabs(det) < 1e-12f)
+        return -1;
+    float inv_det = 1.0f / det;
+    Eigen::Vector3f s = origin - v0;
+    float u = s.dot(p) * inv_det;
+    if (u < 0 || u > 1)
+        return -1;
+    Eigen::Vector3f q = s.cross(e1);
+    float v = dir.dot(q) * inv_det;
+    if (v < 0 || u + v > 1)
+        return -1;
+    return e2.dot(q) * inv_det;
+}
+
+// Slab test. Return whether the ray enters the box before max_t.
+static inline bool intersectBox(const Eigen::Vector3f &origin, const Eigen::Vector3f &inv_dir,
+                                const Eigen::Vector3f &box_min, const Eigen::Vector3f &box_max, float max_t)
+{
+    float t0 = 0, t1 = max_t;
+    for (int i = 0; i < 3; i++)
+    {
+        float a = (box_min[i] - origin[i]) * inv_dir[i], b = (box_max[i] - origin[i]) * inv_dir[i];
+        if (a > b)
+            std::swap(a, b);
+        t0 = max(t0, a);
+        t1 = min(t1, b);
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+// ------------------------------------- VirtualScene -------------------------------------
+
+VirtualScene::VirtualScene() : is_built_(false)
+{
+}
+
+int VirtualScene::addShape(const Shape &shape)
+{
+    shapes_.push_back(shape);
+    is_built_ = false;
+    return shapes_.size() - 1;
+}
+
+void VirtualScene::addTriangle(const Eigen::Matrix4f &T, const Eigen::Vector3f &v0, const Eigen::Vector3f &v1,
+                               const Eigen::Vector3f &v2, int shape_id)
+{
+    Triangle tri;
+    tri.v0 = transformPoint(T, v0);
+    tri.v1 = transformPoint(T, v1);
+    tri.v2 = transformPoint(T, v2);
+    tri.shape_id = shape_id;
+    triangles_.push_back(tri);
+}
+
+int VirtualScene::addRectangle(const Eigen::Matrix4f &T, float size_x, float size_y, uint8_t r, uint8_t g, uint8_t b)
+{
+    Shape shape;
+    shape.type = PLAIN;
+    shape.rgb = packRGB(r, g, b);
+    shape.T_shape_to_world = T;
+    int id = addShape(shape);
+    float hx = size_x / 2, hy = size_y / 2;
+    Eigen::Vector3f a(-hx, -hy, 0), b_(hx, -hy, 0), c(hx, hy, 0), d(-hx, hy, 0);
+    addTriangle(T, a, b_, c, id);
+    addTriangle(T, a, c, d, id);
+    return id;
+}
+
+int VirtualScene::addChessboard(const Eigen::Matrix4f &T, int rows, int cols, float square_size)
+{
+    int id = addRectangle(T, cols * square_size, rows * square_size, 255, 255, 255);
+    shapes_[id].type = CHESSBOARD;
+    shapes_[id].rows = rows;
+    shapes_[id].cols = cols;
+    shapes_[id].square_size = square_size;
+    return id;
+}
+
+int VirtualScene::addBox(const Eigen::Matrix4f &T, float size_x, float size_y, float size_z,
+                         uint8_t r, uint8_t g, uint8_t b)
+{
+    Shape shape;
+    shape.type = PLAIN;
+    shape.rgb = packRGB(r, g, b);
+    shape.T_shape_to_world = T;
+    int id = addShape(shape);
+    float hx = size_x / 2, hy = size_y / 2, hz = size_z / 2;
+    Eigen::Vector3f v[8];
+    for (int k = 0; k < 8; k++)
+        v[k] = Eigen::Vector3f((k & 1) ? hx : -hx, (k & 2) ? hy : -hy, (k & 4) ? hz : -hz);
+    const int faces[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+    for (int f = 0; f < 6; f++)
+    {
+        addTriangle(T, v[faces[f][0]], v[faces[f][1]], v[faces[f][2]], id);
+        addTriangle(T, v[faces[f][0]], v[faces[f][2]], v[faces[f][3]], id);
+    }
+    return id;
+}
+
+int VirtualScene::addSphere(const Eigen::Vector3f &center, float radius, uint8_t r, uint8_t g, uint8_t b)
+{
+    Shape shape;
+    shape.type = SPHERE;
+    shape.rgb = packRGB(r, g, b);
+    shape.T_shape_to_world.setIdentity();
+    shape.center = center;
+    shape.radius = radius;
+    return addShape(shape);
+}
+
+int VirtualScene::addMesh(const Eigen::Matrix4f &T, const vector<Eigen::Vector3f> &vertices,
+                          const vector<Eigen::Vector3i> &triangles, uint8_t r, uint8_t g, uint8_t b)
+{
+    Shape shape;
+    shape.type = PLAIN;
+    shape.rgb = packRGB(r, g, b);
+    shape.T_shape_to_world = T;
+    int id = addShape(shape);
+    for (const Eigen::Vector3i &tri : triangles)
+        addTriangle(T, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], id);
+    return id;
+}
+
+int VirtualScene::addMeshFromPLY(const Eigen::Matrix4f &T, const string &filename, uint8_t r, uint8_t g, uint8_t b)
+{
+    PolygonMesh mesh;
+    if (io::loadPLYFile(filename, mesh) < 0)
+    {
+        cout << "my ERROR: cannot read the mesh " << filename << endl;
+        return -1;
+    }
+    PointCloud<PointXYZ> cloud;
+    fromPCLPointCloud2(mesh.cloud, cloud);
+    vector<Eigen::Vector3f> vertices;
+    for (const PointXYZ &p : cloud.points)
+        vertices.push_back(Eigen::Vector3f(p.x, p.y, p.z));
+    vector<Eigen::Vector3i> triangles;
+    for (const Vertices &poly : mesh.polygons)
+        for (size_t k = 2; k < poly.vertices.size(); k++) // fan triangulation of polygons
+            triangles.push_back(Eigen::Vector3i(poly.vertices[0], poly.vertices[k - 1], poly.vertices[k]));
+    return addMesh(T, vertices, triangles, r, g, b);
+}
+
+void VirtualScene::build()
+{
+    bvh_.clear();
+    if (!triangles_.empty())
+        buildNode(0, triangles_.size());
+    is_built_ = true;
+}
+
+int VirtualScene::buildNode(int first, int count)
+{
+    BVHNode node;
+    node.box_min.setConstant(std::numeric_limits<float>::max());
+    node.box_max.setConstant(-std::numeric_limits<float>::max());
+    for (int i = first; i < first + count; i++)
+    {
+        const Triangle &tri = triangles_[i];
+        node.box_min = node.box_min.cwiseMin(tri.v0).cwiseMin(tri.v1).cwiseMin(tri.v2);
+        node.box_max = node.box_max.cwiseMax(tri.v0).cwiseMax(tri.v1).cwiseMax(tri.v2);
+    }
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+    int idx = bvh_.size();
+    bvh_.push_back(node);
+    if (count <= BVH_LEAF_SIZE)
+        return idx;
+
+    // Median split of the centroids along the longest axis
+    int axis;
+    (node.box_max - node.box_min).maxCoeff(&axis);
+    int mid = first + count / 2;
+    std::nth_element(triangles_.begin() + first, triangles_.begin() + mid, triangles_.begin() + first + count,
+                     [axis](const Triangle &a, const Triangle &b) {
+                         return a.v0[axis] + a.v1[axis] + a.v2[axis] < b.v0[axis] + b.v1[axis] + b.v2[axis];
+                     });
+    int left = buildNode(first, mid - first);
+    int right = buildNode(mid, first + count - mid);
+    bvh_[idx].left = left; // bvh_ may be reallocated by the calls above
+    bvh_[idx].right = right;
+    return idx;
+}
+
+uint32_t VirtualScene::getColor(int shape_id, const Eigen::Vector3f &p) const
+{
+    const Shape &shape = shapes_[shape_id];
+    if (shape.type != CHESSBOARD)
+        return shape.rgb;
+    Eigen::Matrix4f T_world_to_shape = shape.T_shape_to_world.inverse();
+    Eigen::Vector3f local = transformPoint(T_world_to_shape, p);
+    int i = std::floor(local.x() / shape.square_size + shape.cols / 2.0f);
+    int j = std::floor(local.y() / shape.square_size + shape.rows / 2.0f);
+    return ((i + j) % 2 == 0) ? packRGB(20, 20, 20) : packRGB(235, 235, 235);
+}
+
+bool VirtualScene::intersect(const Eigen::Vector3f &origin, const Eigen::Vector3f &dir, float max_t,
+                             float &t, uint32_t &rgb, int &shape_id) const
+{
+    assert(is_built_);
+    t = max_t;
+    shape_id = -1;
+
+    // -- Triangles
+    if (!bvh_.empty())
+    {
+        Eigen::Vector3f inv_dir(1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z());
+        int stack[64], top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BVHNode &node = bvh_[stack[--top]];
+            if (!intersectBox(origin, inv_dir, node.box_min, node.box_max, t))
+                continue;
+            if (node.left < 0)
+            {
+                for (int i = node.first; i < node.first + node.count; i++)
+                {
+                    const Triangle &tri = triangles_[i];
+                    float ti = intersectTriangle(origin, dir, tri.v0, tri.v1, tri.v2);
+                    if (ti > 0 && ti < t)
+                        t = ti, shape_id = tri.shape_id;
+                }
+            }
+            else
+            {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+        }
+    }
+
+    // -- Spheres
+    for (size_t k = 0; k < shapes_.size(); k++)
+    {
+        const Shape &shape = shapes_[k];
+        if (shape.type != SPHERE)
+            continue;
+        Eigen::Vector3f oc = origin - shape.center;
+        float b = oc.dot(dir), c = oc.squaredNorm() - shape.radius * shape.radius;
+        float disc = b * b - c;
+        if (disc < 0)
+            continue;
+        float sq = std::sqrt(disc);
+        float ti = (-b - sq > 0) ? -b - sq : -b + sq;
+        if (ti > 0 && ti < t)
+            t = ti, shape_id = k;
+    }
+
+    if (shape_id < 0)
+        return false;
+    rgb = getColor(shape_id, origin + t * dir);
+    return true;
+}
+
+PointCloud<PointXYZRGB>::Ptr VirtualScene::sampleSurface(float spacing, const vector<int> &shape_ids,
+                                                         unsigned int seed) const
+{
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    vector<bool> selected(shapes_.size(), shape_ids.empty());
+    for (int id : shape_ids)
+        selected[id] = true;
+
+    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
+    auto addPoint = [&](const Eigen::Vector3f &p, int shape_id) {
+        PointXYZRGB pt;
+        pt.x = p.x(), pt.y = p.y(), pt.z = p.z();
+        pt.rgba = 0xff000000 | getColor(shape_id, p);
+        cloud->points.push_back(pt);
+    };
+
+    // -- Triangles: uniform random points, about area / spacing^2 of them
+    for (const Triangle &tri : triangles_)
+    {
+        if (!selected[tri.shape_id])
+            continue;
+        float area = 0.5f * (tri.v1 - tri.v0).cross(tri.v2 - tri.v0).norm();
+        float expected = area / (spacing * spacing);
+        int n = (int)expected + (uniform(gen) < expected - (int)expected);
+        for (int k = 0; k < n; k++)
+        {
+            float u = uniform(gen), v = uniform(gen);
+            if (u + v > 1)
+                u = 1 - u, v = 1 - v;
+            addPoint(tri.v0 + u * (tri.v1 - tri.v0) + v * (tri.v2 - tri.v0), tri.shape_id);
+        }
+    }
+
+    // -- Spheres: Fibonacci lattice
+    for (size_t k = 0; k < shapes_.size(); k++)
+    {
+        const Shape &shape = shapes_[k];
+        if (shape.type != SPHERE || !selected[k])
+            continue;
+        int n = max(1, (int)(4 * M_PI * shape.radius * shape.radius / (spacing * spacing)));
+        const float golden_angle = M_PI * (3 - std::sqrt(5.0f));
+        for (int i = 0; i < n; i++)
+        {
+            float z = 1 - 2 * (i + 0.5f) / n, r = std::sqrt(1 - z * z), phi = golden_angle * i;
+            addPoint(shape.center + shape.radius * Eigen::Vector3f(r * std::cos(phi), r * std::sin(phi), z), k);
+        }
+    }
+
+    cloud->width = cloud->points.size();
+    cloud->height = 1;
+    cloud->is_dense = true;
+    return cloud;
+}
+
+// ------------------------------------- VirtualDepthCamera -------------------------------------
+
+VirtualDepthCamera::VirtualDepthCamera(const CameraIntrinsics &intrinsics, const DepthNoise &noise)
+    : intrinsics_(intrinsics), noise_(noise)
+{
+}
+
+Eigen::Matrix4f VirtualDepthCamera::lookAt(const Eigen::Vector3f &position, const Eigen::Vector3f &target,
+                                           const Eigen::Vector3f &up)
+{
+    // Optical frame: z forward, x right, y down
+    Eigen::Vector3f z = (target - position).normalized();
+    Eigen::Vector3f x = z.cross(up).normalized();
+    Eigen::Vector3f y = z.cross(x);
+    Eigen::Matrix4f T = Eigen::Matrix4f::Identity();
+    T.block<3, 1>(0, 0) = x;
+    T.block<3, 1>(0, 1) = y;
+    T.block<3, 1>(0, 2) = z;
+    T.block<3, 1>(0, 3) = position;
+    return T;
+}
+
+PointCloud<PointXYZRGB>::Ptr VirtualDepthCamera::render(const VirtualScene &scene, const Eigen::Matrix4f &T_world_to_cam,
+                                                        int frame_idx, int num_threads) const
+{
+    const CameraIntrinsics &K = intrinsics_;
+    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
+    cloud->width = K.width;
+    cloud->height = K.height;
+    cloud->is_dense = false;
+    cloud->points.resize(K.width * K.height);
+
+    const Eigen::Matrix3f R = T_world_to_cam.block<3, 3>(0, 0);
+    const Eigen::Vector3f origin = T_world_to_cam.block<3, 1>(0, 3);
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    my_basics::parallelFor(0, K.height, [&](int row_begin, int row_end, int) {
+        for (int v = row_begin; v < row_end; v++)
+        {
+            // Noise of each row only depends on (seed, frame, row), so it does not depend on the threads.
+            std::mt19937 gen(noise_.seed * 1000003u + frame_idx * 10007u + v);
+            std::normal_distribution<float> gauss(0, 1);
+            std::uniform_real_distribution<float> uniform(0, 1);
+            for (int u = 0; u < K.width; u++)
+            {
+                PointXYZRGB &p = cloud->points[v * K.width + u];
+                p.x = p.y = p.z = nan;
+                p.rgba = 0xff000000;
+
+                Eigen::Vector3f ray_cam((u - K.cx) / K.fx, (v - K.cy) / K.fy, 1); // z = 1
+                float ray_norm = ray_cam.norm();
+                Eigen::Vector3f dir = R * ray_cam / ray_norm;
+                float t;
+                uint32_t rgb;
+                int shape_id;
+                if (!scene.intersect(origin, dir, K.max_depth * ray_norm, t, rgb, shape_id))
+                    continue;
+                float z = t / ray_norm;
+                if (z < K.min_depth || uniform(gen) < noise_.dropout_ratio)
+                    continue;
+                z += gauss(gen) * (noise_.sigma_const + noise_.sigma_quadratic * z * z);
+                p.x = ray_cam.x() * z;
+                p.y = ray_cam.y() * z;
+                p.z = z;
+                p.rgba = 0xff000000 | rgb;
+            }
+        }
+    }, num_threads);
+    return cloud;
+}
+
+} // namespace my_pcl
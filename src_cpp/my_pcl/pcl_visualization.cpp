@@ -56,4 +56,88 @@ void setViewerPose(boost::shared_ptr<visualization::PCLVisualizer> viewer,
     setViewerPose(viewer, T.cast<float>());
 }
 
+// -------------------------------- AsyncCloudViewer --------------------------------
+
+AsyncCloudViewer::AsyncCloudViewer(const string &viewer_name, const string &cloud_name,
+                                   int point_budget, double coord_unit)
+    : viewer_name_(viewer_name), cloud_name_(cloud_name), point_budget_(point_budget), coord_unit_(coord_unit),
+      running_(false), stop_requested_(false), num_received_(0), num_rendered_(0)
+{
+    assert(point_budget > 0);
+}
+
+AsyncCloudViewer::~AsyncCloudViewer()
+{
+    stop();
+}
+
+void AsyncCloudViewer::start()
+{
+    if (render_thread_.joinable())
+        return;
+    stop_requested_ = false;
+    running_ = true;
+    render_thread_ = std::thread(&AsyncCloudViewer::renderLoop, this);
+}
+
+void AsyncCloudViewer::stop()
+{
+    stop_requested_ = true;
+    if (render_thread_.joinable())
+        render_thread_.join();
+}
+
+void AsyncCloudViewer::setCloud(const PointCloud<PointXYZRGB>::ConstPtr cloud)
+{
+    // -- Fill a new back buffer. The renderer may still be reading the previous ones, so none is reused.
+    PointCloud<PointXYZRGB>::Ptr back(new PointCloud<PointXYZRGB>);
+    size_t N = cloud->points.size();
+    size_t step = (N + point_budget_ - 1) / point_budget_; // keep every step-th point
+    if (step <= 1)
+        *back = *cloud;
+    else
+    {
+        back->points.reserve(N / step + 1);
+        for (size_t i = 0; i < N; i += step)
+            back->points.push_back(cloud->points[i]);
+        back->width = back->points.size();
+        back->height = 1;
+        back->is_dense = cloud->is_dense;
+    }
+
+    // -- Swap it in. A pending cloud not rendered yet is dropped.
+    {
+        std::lock_guard<std::mutex> lock(mtx_pending_);
+        pending_.swap(back);
+    }
+    num_received_++;
+}
+
+void AsyncCloudViewer::renderLoop()
+{
+    // VTK must be used from the thread that creates it
+    PointCloud<PointXYZRGB>::Ptr front(new PointCloud<PointXYZRGB>);
+    boost::shared_ptr<visualization::PCLVisualizer> viewer =
+        initPointCloudRGBViewer(front, viewer_name_, cloud_name_, coord_unit_);
+
+    while (!stop_requested_ && !viewer->wasStopped())
+    {
+        PointCloud<PointXYZRGB>::Ptr newest;
+        {
+            std::lock_guard<std::mutex> lock(mtx_pending_);
+            newest.swap(pending_);
+        }
+        if (newest)
+        {
+            front = newest; // the viewer keeps reading front until the next update
+            visualization::PointCloudColorHandlerRGBField<PointXYZRGB> color_setting(front);
+            viewer->updatePointCloud<PointXYZRGB>(front, color_setting, cloud_name_);
+            num_rendered_++;
+        }
+        viewer->spinOnce(10);
+    }
+    viewer->close();
+    running_ = false;
+}
+
 } // namespace my_pcl
\ No newline at end of file
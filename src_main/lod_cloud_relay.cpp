@@ -0,0 +1,117 @@
+/*
+Level-of-detail relay for visualization topics.
+
+Subscribe a cloud (e.g. node2's cloud_rotated, or node3's whole model), and publish a
+point-budgeted, coarse-to-fine version of it at a limited rate (my_pcl::LodOctree).
+Only the octree nodes that changed since the last publish are sent, so the display needs a Decay Time.
+With input_shm_topic, the input is node2's CloudSlot descriptors, and the points are read from its shared memory
+(my_pcl::CloudShmRingReader) instead of being serialized by node2.
+*/
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <ros/ros.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "my_pcl/pcl_lod_octree.h"
+#include "my_pcl/pcl_shm_ring.h"
+#include "scan3d_by_baxter/CloudSlot.h" // my message
+
+using namespace std;
+using namespace pcl;
+
+// ------------------------------------- ROS Params -------------------------------------
+
+string input_topic, output_topic;
+string input_shm_topic;     // CloudSlots instead of input_topic. "": not used
+int point_budget;           // max points per message
+double max_publish_rate;    // Hz
+double leaf_size;           // cell size of the finest level
+int num_levels;
+bool flag_refresh_when_idle; // re-send the finest nodes in turn when nothing changed
+
+#define NH_GET_PARAM(param_name, returned_val)                              \
+    if (!nh.getParam(param_name, returned_val))                             \
+    {                                                                       \
+        cout << "Error in reading ROS param named: " << param_name << endl; \
+        assert(0);                                                          \
+    }
+
+// ------------------------------------- Vars -------------------------------------
+
+boost::shared_ptr<my_pcl::LodOctree> lod_octree;
+string frame_id = "base";
+map<string, boost::shared_ptr<my_pcl::CloudShmRingReader>> shm_readers; // by shm name, opened at the first cloud
+
+void subCallback(const sensor_msgs::PointCloud2 &ros_cloud)
+{
+    PointCloud<PointXYZRGB> cloud;
+    fromROSMsg(ros_cloud, cloud);
+    frame_id = ros_cloud.header.frame_id;
+    int num_changed = lod_octree->update(cloud);
+    ROS_INFO("LOD relay: %d points in, %d octree nodes changed", (int)cloud.points.size(), num_changed);
+}
+
+void subCallbackShm(const scan3d_by_baxter::CloudSlot &slot_msg)
+{
+    boost::shared_ptr<my_pcl::CloudShmRingReader> &reader = shm_readers[slot_msg.shm_name];
+    my_pcl::CloudShmSlotDesc desc;
+    desc.slot = slot_msg.slot;
+    desc.seq = slot_msg.seq;
+    desc.width = slot_msg.width;
+    desc.height = slot_msg.height;
+    PointCloud<PointXYZRGB>::Ptr cloud;
+    if (!reader || !reader->isOpen() || !reader->read(desc, cloud))
+    {
+        // Not mapped yet, or node2 has restarted and created a new ring: map it again
+        reader.reset(new my_pcl::CloudShmRingReader(slot_msg.shm_name));
+        if (!reader->isOpen() || !reader->read(desc, cloud)) // overwritten: a newer one is coming
+            return;
+    }
+    frame_id = slot_msg.header.frame_id;
+    int num_changed = lod_octree->update(*cloud);
+    ROS_INFO("LOD relay: %d points in (shm), %d octree nodes changed", (int)cloud->points.size(), num_changed);
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "lod_cloud_relay");
+    ros::NodeHandle nh("~");
+    NH_GET_PARAM("input_topic", input_topic)
+    NH_GET_PARAM("output_topic", output_topic)
+    NH_GET_PARAM("input_shm_topic", input_shm_topic)
+    NH_GET_PARAM("point_budget", point_budget)
+    NH_GET_PARAM("max_publish_rate", max_publish_rate)
+    NH_GET_PARAM("leaf_size", leaf_size)
+    NH_GET_PARAM("num_levels", num_levels)
+    NH_GET_PARAM("flag_refresh_when_idle", flag_refresh_when_idle)
+
+    lod_octree.reset(new my_pcl::LodOctree(leaf_size, num_levels));
+    ros::NodeHandle nh_global;
+    ros::Subscriber sub = input_shm_topic.empty() // only the newest cloud matters
+                              ? nh_global.subscribe(input_topic, 1, subCallback)
+                              : nh_global.subscribe(input_shm_topic, 1, subCallbackShm);
+    ros::Publisher pub = nh_global.advertise<sensor_msgs::PointCloud2>(output_topic, 10);
+
+    // The rate limit: at most one message per cycle.
+    ros::Rate rate(max_publish_rate);
+    PointCloud<PointXYZRGB> cloud_to_pub;
+    while (ros::ok())
+    {
+        ros::spinOnce();
+        if (pub.getNumSubscribers() > 0 &&
+            lod_octree->getUpdate(point_budget, cloud_to_pub, flag_refresh_when_idle) > 0)
+        {
+            sensor_msgs::PointCloud2 ros_cloud_to_pub;
+            pcl::toROSMsg(cloud_to_pub, ros_cloud_to_pub);
+            ros_cloud_to_pub.header.frame_id = frame_id;
+            ros_cloud_to_pub.header.stamp = ros::Time::now();
+            pub.publish(ros_cloud_to_pub);
+        }
+        rate.sleep();
+    }
+    return 0;
+}
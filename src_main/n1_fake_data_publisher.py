@@ -65,7 +65,7 @@ class ClassPubDepthCamPose(object):
                 T[i][j]=vals[j]
         return T
 
-    def pub_pose(self):
+    def pub_pose(self, stamp):
         T = self.readNextPose()
 
         # Trans to 1x16 array
@@ -73,7 +73,10 @@ class ClassPubDepthCamPose(object):
         for i in range(4):
             for j in range(4):
                 pose_1x16 += [T[i, j]]
-        self.pub.publish(pose_1x16)
+        msg = T4x4()
+        msg.header.stamp = stamp # node2 pairs the pose and the cloud by stamp
+        msg.TransformationMatrix = pose_1x16
+        self.pub.publish(msg)
         print("Node 1: publish camera pose.\n")
         return
 
@@ -90,13 +93,14 @@ class ClassPubPointClous(object):
         self.pub = rospy.Publisher(
             self.topic_name_rgbd_cloud, PointCloud2, queue_size=10)
 
-    def pub_cloud(self):
+    def pub_cloud(self, stamp):
         filename = self.getFileName()
         open3d_cloud = open3d.read_point_cloud(filename)
         print "Node 1: sim: load cloud file:\n  " + filename
         print "  points = " + str(getCloudSize(open3d_cloud))
         
         ros_cloud = convertCloudFromOpen3dToRos(open3d_cloud, frame_id="base")
+        ros_cloud.header.stamp = stamp
         self.pub.publish(ros_cloud)
         print("Node 1: sim: publishing cloud "+str(ith_goalpose) + "to: " + self.topic_name_rgbd_cloud)
 
@@ -119,8 +123,9 @@ if __name__ == "__main__":
         ith_goalpose += 1
         print "\n----------------------------------------"
         print "Node 1: Moving to ", ith_goalpose,"th pose:"
-        pub_poses.pub_pose()
-        pub_clouds.pub_cloud()
+        stamp = rospy.Time.now()
+        pub_poses.pub_pose(stamp)
+        pub_clouds.pub_cloud(stamp)
         rospy.sleep(1.0)
         if ith_goalpose == num_goalposes:
             pub_poses.closeFile()
@@ -17,11 +17,13 @@ sys.path.append(PYTHON_FILE_PATH + "../src_python")
 from lib_baxter import MyBaxter
 from lib_geo_trans_ros import form_T, quaternion_to_R, toRosPose, pose2T, transXYZ
 from lib_cloud_conversion_between_Open3D_and_ROS import convertCloudFromOpen3dToRos
+from lib_trace import TraceRecorder, makeTraceId
 
 # -- Message types
 # from std_msgs.msg import Int32  # used for indexing the ith robot pose
 from geometry_msgs.msg import Pose, Point, Quaternion
 from scan3d_by_baxter.msg import T4x4
+from scan3d_by_baxter.srv import NextBestView
 
 
 # ------------------------------------------------------------
@@ -38,14 +40,19 @@ class JointPosPublisher(object):
     def __init__(self, topic_endeffector_pos):
         self.pub = rospy.Publisher(topic_endeffector_pos, T4x4, queue_size=10)
 
-    def publishPose(self, pose):
+    def publishPose(self, pose, stamp=None, trace_id=0):
         T = pose
         # Trans to 1x16 array
         pose_1x16 = []
         for i in range(4):
             for j in range(4):
                 pose_1x16 += [T[i, j]]
-        self.pub.publish(pose_1x16)
+        msg = T4x4()
+        # node2 pairs it with the cloud of the nearest stamp, or interpolates the poses at the cloud's stamp
+        msg.header.stamp = rospy.Time.now() if stamp is None else stamp
+        msg.TransformationMatrix = pose_1x16
+        msg.trace_id = trace_id # node2 gives it to the view of this pose
+        self.pub.publish(msg)
         return
 
 def readKinectCameraPose():
@@ -54,6 +61,10 @@ def readKinectCameraPose():
     T = T_base_to_arm.dot(T_arm_to_depth)
     return T
 
+def readKinectCameraPoseStamped():
+    T_base_to_arm, stamp = my_Baxter.getFramePoseStamped('/left_lower_forearm')
+    return T_base_to_arm.dot(T_arm_to_depth), stamp
+
 # def set_target_joint_angles():
 #     target_joint_angles=[
 #         [1.3456846475601196, -0.8774369955062866, 0.44907286763191223, 2.608534336090088, -1.5892040729522705, 1.0565292835235596, -3.0434179306030273,],
@@ -88,6 +99,35 @@ def set_target_joint_angles():
     return target_joint_angles
 
 
+# Camera poses of the goal joint angles, in the format of camera_pose.txt (e.g. saved by a previous scan)
+def readCameraPosesOfGoals(filename):
+    rows = []
+    for line in open(filename):
+        vals = line.split()
+        if len(vals) == 4:
+            rows.append([float(v) for v in vals])
+    return [np.array(rows[i:i+4]) for i in range(0, len(rows) - 3, 4)]
+
+# Ask node2 which goal not visited yet observes the most unknown space. Return None to stop the scan.
+def askNextBestView(srv_nbv, camera_poses_of_goals, visited, num_views_sent):
+    candidates = [i for i in range(num_goalposes) if i not in visited]
+    if len(candidates) == 0:
+        return None
+    poses = []
+    for i in candidates:
+        poses += list(camera_poses_of_goals[i].flatten())
+    while not rospy.is_shutdown():
+        res = srv_nbv(num_views_sent, poses)
+        if res.ready:
+            break
+        rospy.sleep(0.1) # node2 is still processing the views
+    rospy.loginfo("Node 1: next best view: gains {}, {:.1f}% of the box known".format(
+        list(res.gains), 100*res.known_ratio))
+    if res.stop or res.best_index < 0:
+        return None
+    return candidates[res.best_index]
+
+
 # -- Functions: Write results to file
 
 # Write ndarray to file
@@ -137,6 +177,11 @@ if __name__ == "__main__":
 
     topic_endeffector_pos = rospy.get_param("topic_n1_to_n2")
     num_goalposes = rospy.get_param("num_goalposes")
+    flag_continuous_scan = rospy.get_param("flag_continuous_scan")
+    flag_use_nbv = rospy.get_param("flag_use_nbv")
+    continuous_pose_rate = rospy.get_param("continuous_pose_rate")
+    tracer = TraceRecorder("node1", enabled=rospy.get_param("flag_trace"))
+    SCAN_ID = 1 # node1 does one scan. The views are numbered from 1 by ith_goalpose.
 
     # -- Set Baxter
     my_Baxter = MyBaxter(['left', 'right'][0])
@@ -146,6 +191,14 @@ if __name__ == "__main__":
     #   sends the pose to node2 to tell it to take the picture.
     pub = JointPosPublisher(topic_endeffector_pos)
 
+    # -- Next best view: node2 chooses the order of the goals, and when to stop
+    if flag_use_nbv:
+        camera_poses_of_goals = readCameraPosesOfGoals(
+            config_folder + rospy.get_param("file_name_camera_poses_of_goals"))
+        assert len(camera_poses_of_goals) >= num_goalposes
+        rospy.wait_for_service(rospy.get_param("nbv_service_name"))
+        srv_nbv = rospy.ServiceProxy(rospy.get_param("nbv_service_name"), NextBestView)
+
     # ---------------------------------------------------------------------
 
     # Start node when pressing enter
@@ -168,9 +221,27 @@ if __name__ == "__main__":
     ith_goalpose = 0
     savePoseToFile(None, None, clear=True)
 
-    while ith_goalpose < num_goalposes and not rospy.is_shutdown():
+    # -- Continuous scan: sweep through all goal positions without stopping,
+    #   and publish the camera pose at a high rate. node2 takes every cloud during the sweep.
+    if flag_continuous_scan and not DEBUG__I_DONT_HAVE_BAXTER:
+        last_stamp = [rospy.Time(0)]
+        def publishCurrentPose(event):
+            pose, stamp = readKinectCameraPoseStamped()
+            if stamp > last_stamp[0]: # tf has a new pose
+                pub.publishPose(pose, stamp, makeTraceId(SCAN_ID, 0)) # node2 numbers the views
+                last_stamp[0] = stamp
+        timer = rospy.Timer(rospy.Duration(1.0/continuous_pose_rate), publishCurrentPose)
+        rospy.loginfo("Node 1: Baxter sweeps through all {} poses".format(num_goalposes))
+        with tracer.scope("sweep", makeTraceId(SCAN_ID, 0)):
+            my_Baxter.sweepThroughJointAngles(list_target_joint_angles[1:num_goalposes], 4.0)
+        timer.shutdown()
+        ith_goalpose = num_goalposes # skip the stop-and-shoot loop
+
+    next_goal, visited_goals = 0, []
+    while ith_goalpose < num_goalposes and next_goal is not None and not rospy.is_shutdown():
         ith_goalpose += 1
-        joint_angles = list_target_joint_angles[ith_goalpose-1]
+        joint_angles = list_target_joint_angles[next_goal]
+        trace_id = makeTraceId(SCAN_ID, ith_goalpose)
 
         # Move robot to the next pose for taking picture
         if not DEBUG__I_DONT_HAVE_BAXTER:
@@ -178,7 +249,8 @@ if __name__ == "__main__":
             rospy.loginfo("Node 1: {}th pos".format(ith_goalpose))
             rospy.loginfo("Node 1: Baxter is moving to pos: "+str(joint_angles))
 
-            my_Baxter.moveToJointAngles(joint_angles, 4.0)
+            with tracer.scope("move_arm", trace_id):
+                my_Baxter.moveToJointAngles(joint_angles, 4.0)
             
             # if ith_goalpose<=8:
             # elif ith_goalpose==9:
@@ -189,19 +261,31 @@ if __name__ == "__main__":
             rospy.loginfo("Node 1: Baxter reached the pose!")
 
         rospy.loginfo("Node 1: Wait until stable for 1 more second")
-        rospy.sleep(1.0)
+        with tracer.scope("wait_stable", trace_id):
+            rospy.sleep(1.0)
         rospy.loginfo("Node 1: publish "+str(ith_goalpose) +
                       "th camera pose to node2")
 
         # Publish camera pose to node2
-        pose = readKinectCameraPose()
-        pub.publishPose(pose)
+        with tracer.scope("publish_pose", trace_id):
+            pose = readKinectCameraPose()
+            pub.publishPose(pose, trace_id=trace_id)
         
         # End
         savePoseToFile(pose, ith_goalpose)
         rospy.loginfo("--------------------------------")
         rospy.sleep(1)
+
+        # Choose the next goal
+        visited_goals.append(next_goal)
+        if flag_use_nbv:
+            with tracer.scope("ask_next_best_view", trace_id):
+                next_goal = askNextBestView(srv_nbv, camera_poses_of_goals, visited_goals, ith_goalpose)
+        else:
+            next_goal = ith_goalpose
         # if ith_goalpose==num_goalposes: ith_goalpose = 0
 
     # -- Node stops
+    if tracer.enabled:
+        tracer.write(file_folder + "trace_node1.json")
     rospy.loginfo("!!!!! Node 1 stops.")
@@ -2,6 +2,31 @@
 Main function:
 * subscribe to cloud_src, filter it, rotated, pub to rviz.
 * seg plane, do clustering, pub the object to node3
+
+Multiple streams (e.g. a camera on each arm): each stream has its own cloud and pose topics, buffers and crop box.
+Frames of different streams are processed concurrently on a worker pool (one frame per stream at a time,
+so that frames of a stream keep their order). Outputs are published and saved by the main thread.
+
+Continuous scan: the arm sweeps without stopping, and every cloud of the camera is a view.
+Node1 publishes the camera pose at a high rate, and the pose of each cloud is interpolated at its stamp.
+A stream has up to max_frames_in_flight frames in processing, so their outputs may be out of order.
+With flag_select_keyframes, only the views that observe enough new parts of the crop box are processed
+(checked on the main thread before dispatching them).
+
+Next best view: with flag_use_nbv, node2 keeps an occupancy grid of the object's box from the processed views,
+and answers node1 (service nbv_service_name) which of its candidate poses would observe the most unknown space,
+and whether the scan can stop.
+
+Adaptive crop box: with flag_adaptive_roi, once a few views have segmented the object, the crop box of the next
+frames shrinks to the object's box plus a margin, and the raw cloud is cropped by it before any filtering.
+
+Multi-object scan: with flag_multi_object, all clusters of a view are kept (cloud_segmented is their union).
+The main thread associates them with the objects of the scan (my_pcl::ObjectTracker), and each object has its own
+multi-view refinement, refined in parallel after the scan. Outputs of an object are tagged by its index.
+
+Live reconfiguration: the filter and segmentation params of cfg/Node2.cfg can be changed while node2 runs
+(dynamic_reconfigure). A new config is applied by the main thread once no frame is in processing,
+so that each frame is processed with one set of params.
 */
 
 #include <iostream>
@@ -9,20 +34,44 @@ Main function:
 #include <stdio.h>
 #include <vector>
 #include <queue>
+#include <deque>
+#include <mutex>
 
 #include <ros/ros.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pcl/common/transforms.h>
+#include <boost/bind.hpp>
+#include <dynamic_reconfigure/server.h>
 
 #include <sensor_msgs/PointCloud2.h>
 #include "geometry_msgs/Pose.h"
 
 #include "my_basics/basics.h"
+#include "my_basics/parallel.h"
+#include "my_basics/stamp_sync.h"
+#include "my_basics/pose_interpolator.h"
+#include "my_basics/memory_profiler.h"
+#include "my_basics/trace.h"
 #include "my_pcl/pcl_visualization.h"
 #include "my_pcl/pcl_commons.h"
 #include "my_pcl/pcl_filters.h"
 #include "my_pcl/pcl_advanced.h"
 #include "my_pcl/pcl_io.h"
+#include "my_pcl/pcl_shm_ring.h"
+#include "my_pcl/pcl_archive.h"
+#include "my_pcl/pcl_normals.h"
+#include "my_pcl/pcl_registration.h"
+#include "my_pcl/pcl_segment_view.h"
+#include "my_pcl/pcl_spatial_index.h"
+#include "my_pcl/pcl_keyframe.h"
+#include "my_pcl/pcl_next_best_view.h"
+#include "my_pcl/pcl_carving.h"
+#include "my_pcl/pcl_adaptive_roi.h"
+#include "my_pcl/pcl_object_tracker.h"
 #include "scan3d_by_baxter/T4x4.h" // my message
+#include "scan3d_by_baxter/CloudSlot.h" // my message
+#include "scan3d_by_baxter/NextBestView.h" // my service
+#include "scan3d_by_baxter/Node2Config.h" // my dynamic_reconfigure params
 
 using namespace std;
 using namespace pcl;
@@ -31,10 +80,23 @@ using namespace pcl;
 
 // Topic names
 string topic_n1_to_n2, topic_n2_to_n3, topic_name_rgbd_cloud, topic_n2_to_rviz;
+string topic_n2_to_n3_normals, topic_n2_to_rviz_refined;
+
+// Shared memory transport: clouds are written into a shm ring, and only CloudSlot descriptors are published.
+bool flag_use_shm_transport;
+string topic_n2_to_n3_shm, topic_n2_to_rviz_shm;
+string shm_name_cloud_segmented, shm_name_cloud_rotated;
+int shm_num_slots, shm_slot_capacity;
 
 // Filenames for writing to file
-string file_folder, file_name_cloud_src, file_name_cloud_segmented;
+string file_folder, file_name_cloud_src, file_name_cloud_segmented, file_name_cloud_refined;
 int file_name_index_width;
+bool flag_write_pcd_files; // src_01.pcd, segmented_01.pcd, ... (src_right_01.pcd, ... for the other streams)
+
+// Scan session archive: all views (pose + cloud_src + cloud_segmented) in one file
+bool flag_write_archive;
+string file_name_archive;
+int archive_max_frames;
 
 // Filename for reading chessboard's pose
 string file_folder_config, file_name_T_baxter_to_chess;
@@ -42,36 +104,206 @@ string file_folder_config, file_name_T_baxter_to_chess;
 // Filter: voxel filtering (filtByVoxelGrid)
 float x_grid_size, y_grid_size, z_grid_size;
 
+// Filter: voxel filtering with a point budget (filtByVoxelGridToBudget), instead of the fixed grid size above.
+// The budget is fixed (voxel_point_budget), or adapted to keep the processing time of a frame under frame_time_budget.
+int voxel_point_budget;   // <= 0: use x/y/z_grid_size
+double frame_time_budget; // seconds. <= 0: disabled
+float voxel_min_grid_size, voxel_max_grid_size;
+double voxel_search_seconds;
+
+// Filter: adaptive crop box. After roi_min_views views, the crop box of a frame is shrunk (except its bottom,
+// to keep the table under the object) to the box of the object segmented so far plus roi_margin, and the raw
+// cloud is cropped by it before the voxel grid. The roi_outlier_ratio extreme points of each side of a view are
+// ignored. Needs flag_do_range_filt. cloud_rotated (rviz) shows the cropped region only.
+bool flag_adaptive_roi;
+float roi_margin, roi_outlier_ratio;
+int roi_min_views;
+
 // Fitler: isolated points (filtByStatisticalOutlierRemoval)
 float mean_k = 50, std_dev = 1.0;
 
-// Filter: range filtering
+// Filter: range filtering (the crop box of each stream is in Stream)
 bool flag_do_range_filt;
-float x_range_radius, y_range_radius, z_range_low, z_range_up;
 float chessboard_x, chessboard_y, chessboard_z;
 float T_baxter_to_chess[4][4] = {0}, T_chess_to_baxter[4][4] = {0};
+bool flag_use_compact_cloud; // voxel grid, rotate, crop and cluster on the int16 CompactCloud instead of PointXYZRGB
+float compact_cloud_resolution;
 
 // Filter: plane segmentation
 float plane_distance_threshold, plane_distance_threshold_0;
 int plane_max_iterations;
 int num_planes;
 float ratio_of_rest_points = -1; // disabled
+bool flag_detect_table_by_histogram; // the first plane by z histogram + least squares, RANSAC only if the fit is poor
 
 // Filter: divide cloud into clusters
 bool flag_do_clustering;
 double cluster_tolerance;
 int min_cluster_size, max_cluster_size;
 
-// ------------------------------------- Vars -------------------------------------
+// Multi-object scan: all clusters are kept, and tracked across views by their boxes (overlap of at least
+// object_min_box_overlap of the smaller box) and centroids (within object_max_centroid_distance).
+// Each object (at most max_objects) has its own multi-view refinement with object_icp_threads ICP threads.
+// Needs flag_do_clustering.
+bool flag_multi_object;
+float object_max_centroid_distance, object_min_box_overlap;
+int max_objects, object_icp_threads;
+
+// One neighbor search index per view, shared by plane removal, clustering and normals
+bool flag_use_spatial_index;
+float spatial_index_voxel_size;
+
+// Normals of cloud_segmented, oriented towards the depth camera
+bool flag_compute_normals;
+int normals_k_search;
+
+// Multi-view refinement: pairwise ICP between views while the arm moves, then a pose graph over all views
+bool flag_do_multiview_refine;
+int num_goalposes;
+float refine_voxel_size, refine_max_correspondence_distance, refine_merge_voxel_size;
+int refine_max_iterations, refine_max_neighbors;
+
+// Free-space carving of the merged cloud of the refinement: points that another view saw through are removed.
+// The depth buffer of each view is built from its whole input cloud (the table and background are evidence too).
+bool flag_do_carving;
+float carving_pixel_angle, carving_margin; // radians per pixel of the depth buffers; meters
+int carving_min_votes;
+
+// Pairing of poses and clouds by time stamp, with bounded queues
+double sync_tolerance;             // seconds between the stamps of a pose and its cloud
+int sync_max_poses, sync_max_clouds; // queue sizes
+string sync_drop_policy;           // when a queue is full: "drop_oldest" or "drop_newest"
+float ingest_voxel_size;           // voxelize clouds once paired with a pose. <= 0: disabled
+
+// Continuous scan: poses are interpolated instead of paired (the sync_ params above are not used, except sync_max_clouds)
+bool flag_continuous_scan;
+double pose_buffer_seconds; // poses kept for interpolation
+double pose_max_gap;        // seconds. A cloud between two poses farther apart is dropped.
+int max_frames_in_flight;   // per stream
+double sweep_end_seconds;   // the multi-view refinement runs when no view comes for this long
+
+// Keyframe selection: a view is processed only if it observes keyframe_min_new_voxels voxels (of the crop box
+// of stream 0, above the table) that no previous view observed
+bool flag_select_keyframes;
+float keyframe_voxel_size;
+int keyframe_min_new_voxels, keyframe_sample_stride;
+
+// Memory profiling: print the heap, the clouds held by node2 and the queue depths with each frame,
+// and the allocations of each stage after each scan. Allocations are counted only when built with
+// -DPROFILE_MEMORY=ON (see my_basics/memory_profiler.h).
+bool flag_profile_memory;
+
+// Tracing: the spans of each view, by the trace ID of its pose (see my_basics/trace.h), are written to
+// file_folder + "trace_node2.json" after each scan. Merge with the other nodes' by src_python/merge_traces.py.
+bool flag_trace;
+
+// Next best view: an occupancy grid of the box of the keyframe selection (at nbv_voxel_size), updated by
+// every nbv_sample_stride-th point of each view. Candidates are scored by a camera of the given image size
+// and focal length, casting a ray every nbv_pixel_step pixels.
+bool flag_use_nbv;
+string nbv_service_name;
+float nbv_voxel_size;
+int nbv_sample_stride, nbv_pixel_step;
+int nbv_min_gain; // the scan stops when no candidate observes this many unknown voxels
+my_pcl::CameraIntrinsics nbv_intrinsics;
+
+// Streams: stream 0 takes topic_name_rgbd_cloud and topic_n1_to_n2, the others are set by "~stream<k>/"
+int num_streams;
 
-// Data contents
-queue<PointCloud<PointXYZRGB>::Ptr> buff_cloud_src;     // When sub cloud from topic, save it to the buff first,
-queue<vector<vector<float>>> buff_T_baxter_to_depthcam; // to avoid that new data flush the old ones.
+// ------------------------------------- Vars -------------------------------------
 
-vector<vector<float>> T_baxter_to_depthcam;
-PointCloud<PointXYZRGB>::Ptr cloud_src(new PointCloud<PointXYZRGB>);
-PointCloud<PointXYZRGB>::Ptr cloud_rotated(new PointCloud<PointXYZRGB>);   // this pubs to rviz
-PointCloud<PointXYZRGB>::Ptr cloud_segmented(new PointCloud<PointXYZRGB>); // this pubs to node3
+// One view of a stream: its input, and the results of each processing step
+struct Frame
+{
+    int stream_idx;
+    int cnt_cloud; // index of the view in its stream, from 1
+    vector<vector<float>> T_baxter_to_depthcam;
+    int point_budget;      // of filtByVoxelGridToBudget, copied from the stream, and the budget for the next frame
+    float voxel_grid_size; // same
+    ros::Time stamp_cloud_src; // stamp of the input cloud. All outputs of this frame carry it.
+    uint64_t trace_id;         // of its pose. Or in continuous scan, the scan of the last pose and the view count.
+    my_pcl::CropBox crop_box;  // in the chessboard frame: the stream's, or shrunk to the object
+    bool is_roi_shrunk;        // crop_box is the adaptive one: crop the raw cloud first
+    double process_seconds;    // time of process_frame
+    PointCloud<PointXYZRGB>::Ptr cloud_src;
+    PointCloud<PointXYZRGB>::Ptr cloud_rotated;   // this pubs to rviz
+    PointCloud<PointXYZRGB>::Ptr cloud_segmented; // this pubs to node3
+    vector<PointCloud<PointXYZRGB>::Ptr> cloud_objects; // with flag_multi_object: the clusters, largest first
+    PointCloud<Normal>::Ptr normals_segmented;    // normals of cloud_segmented
+    boost::shared_ptr<my_pcl::FrameSpatialIndex> index_segmented; // valid points == cloud_segmented
+};
+typedef boost::shared_ptr<Frame> FramePtr;
+
+// One depth camera and the topic of its poses
+struct Stream
+{
+    string name; // tag of its outputs
+    string topic_name_rgbd_cloud, topic_n1_to_n2;
+    float x_range_radius, y_range_radius, z_range_low, z_range_up; // crop box, centered at the chessboard
+
+    // Data contents: poses (T_baxter_to_depthcam) and clouds, paired by stamp.
+    // Clouds are queued as messages, and converted only once paired.
+    my_basics::StampSync<vector<vector<float>>, sensor_msgs::PointCloud2::ConstPtr> sync;
+    // Or, in continuous scan, the clouds waiting for the poses around their stamps
+    my_basics::PoseInterpolator pose_buffer;
+    deque<PointCloud<PointXYZRGB>::Ptr> clouds;
+    int num_dropped_clouds;
+    map<double, uint64_t> trace_ids_of_poses; // by the stamps of the queued poses
+    uint64_t last_trace_id;
+
+    int cnt_cloud;
+    int num_processing; // frames of this stream in the worker pool
+
+    // Updated by the main thread when a frame is done
+    int point_budget;      // current budget of filtByVoxelGridToBudget
+    float voxel_grid_size; // leaf size chosen for the last frame, and initial guess for the next one
+
+    ros::Subscriber sub_pose, sub_cloud;
+    ros::Publisher pub_to_node3_tagged; // <topic_n2_to_n3>/<name>, published only when subscribed
+
+    Stream() : num_dropped_clouds(0), last_trace_id(0), cnt_cloud(0), num_processing(0), point_budget(-1), voxel_grid_size(-1) {}
+};
+vector<Stream> streams;
+
+// Worker pool. Processed frames are queued back to the main thread.
+boost::shared_ptr<my_basics::ThreadPool> worker_pool;
+std::mutex mtx_frames_done;
+queue<FramePtr> frames_done;
+
+boost::shared_ptr<my_pcl::CloudShmRingWriter> shm_cloud_rotated, shm_cloud_segmented;
+boost::shared_ptr<my_pcl::ScanArchiveWriter> archive_writer;
+boost::shared_ptr<my_pcl::MultiViewRegistration> multiview_register;
+boost::shared_ptr<my_pcl::CoverageKeyframeSelector> keyframe_selector;
+boost::shared_ptr<my_pcl::NextBestViewPlanner> nbv_planner;
+boost::shared_ptr<my_pcl::FreeSpaceCarving> carving;
+boost::shared_ptr<my_pcl::AdaptiveCropBox> adaptive_roi; // updated by the main thread when a frame is output
+boost::shared_ptr<my_pcl::ObjectTracker> object_tracker;  // same
+
+// Multi-object scan: the refinement and the publishers of each object, by its ID. Publishers are advertised
+// when their object is first seen.
+vector<boost::shared_ptr<my_pcl::MultiViewRegistration>> object_registers;
+vector<vector<int>> object_carving_views; // the carving's view of each view of each object
+vector<ros::Publisher> pubs_object_to_node3, pubs_object_refined;
+int cnt_views_received = 0;    // frames popped from the streams, including the skipped ones
+
+// Memory profiling: stages of the allocations, and the gauges sampled by the main thread
+int mem_stage_receive, mem_stage_filter, mem_stage_segment, mem_stage_normals, mem_stage_output, mem_stage_register,
+    mem_stage_refine;
+int64_t bytes_of_clouds_in_flight = 0; // input clouds of the frames in the worker pool
+my_basics::PeakGauge gauge_cloud_bytes, gauge_queue_depth, gauge_frame_bytes;
+boost::shared_ptr<my_basics::TraceRecorder> tracer;
+int nbv_first_view_of_scan = 0; // get_num_poses_done() when the scan started
+bool nbv_scan_stopped = false;  // node1 is told to stop: refine the views once they are done
+
+// Live reconfiguration: the latest config waits here until the frames in processing are done.
+// No frame is dispatched meanwhile.
+bool has_pending_config = false;
+scan3d_by_baxter::Node2Config pending_config;
+
+struct Publishers
+{
+    ros::Publisher to_node3, to_rviz, to_node3_shm, to_rviz_shm, normals_to_node3, refined;
+};
 
 // ------------------------------------- Functions -------------------------------------
 // -- Read params from ROS parameter server
@@ -86,56 +318,145 @@ void initAllROSParams();
 // -- Input/Output and Sub/Publisher
 
 void read_T_from_file(float T_16x1[16], string filename);
-void subCallbackFromNode1(const scan3d_by_baxter::T4x4::ConstPtr &pose_message);
-void subCallbackFromKinect(const sensor_msgs::PointCloud2 &ros_cloud);
-void pubPclCloudToTopic(ros::Publisher &pub, PointCloud<PointXYZRGB>::Ptr pcl_cloud);
+void subCallbackFromNode1(const scan3d_by_baxter::T4x4::ConstPtr &pose_message, int stream_idx);
+void subCallbackFromKinect(const sensor_msgs::PointCloud2::ConstPtr &ros_cloud, int stream_idx);
+bool srvCallbackNextBestView(scan3d_by_baxter::NextBestView::Request &req, scan3d_by_baxter::NextBestView::Response &res);
+void reconfigureCallback(scan3d_by_baxter::Node2Config &config, uint32_t level);
+void pubPclCloudToTopic(ros::Publisher &pub, PointCloud<PointXYZRGB>::Ptr pcl_cloud, const ros::Time &stamp);
+void pubPclCloudToTopic(ros::Publisher &pub, PointCloud<PointXYZRGBNormal>::Ptr pcl_cloud, const ros::Time &stamp);
+void pubPclCloudToShm(my_pcl::CloudShmRingWriter &shm, const string &shm_name, ros::Publisher &pub,
+                      PointCloud<PointXYZRGB>::Ptr pcl_cloud, const ros::Time &stamp, const string &stream_name,
+                      uint64_t trace_id, const string &file_name);
 
 // -- Main processing functions
-void process_to_get_cloud_rotated();
-void process_to_get_cloud_segmented();
-void print_cloud_processing_result(int cnt_cloud);
+PointCloud<PointXYZRGB>::Ptr convert_ros_cloud(const sensor_msgs::PointCloud2 &ros_cloud);
+bool pop_paired_frame(Stream &stream, Frame &frame);
+bool pop_interpolated_frame(Stream &stream, Frame &frame);
+int get_num_poses_done();
+bool select_keyframe(const Frame &frame);
+void process_frame(Frame &frame, const Stream &stream);
+void process_to_get_cloud_rotated(Frame &frame, const Stream &stream);
+void process_to_get_cloud_segmented(Frame &frame, const Stream &stream);
+my_pcl::ViewSegmentationParams get_segmentation_params();
+void process_to_get_normals_segmented(Frame &frame);
+void output_frame(Frame &frame, Publishers &pubs);
+void process_to_refine_all_views(ros::Publisher &pub_refined);
+void end_scan(ros::Publisher &pub_refined, bool flag_refine);
+void output_objects(Frame &frame);
+PointCloud<PointXYZRGB>::Ptr process_to_refine_objects();
+void get_camera_pos_in_chess_frame(const Frame &frame, float &cam_x, float &cam_y, float &cam_z);
+Eigen::Matrix4f get_T_chess_to_depthcam(const vector<vector<float>> &T_baxter_to_depthcam);
+void print_cloud_processing_result(const Frame &frame);
+void update_point_budget(Frame &frame, double frame_seconds);
+void update_memory_gauges();
+void print_memory_of_frame(const Frame &frame);
+bool apply_pending_config();
 
 // -- Main Loop:
-void main_loop(ros::Publisher &pub_to_node3, ros::Publisher &pub_to_rviz)
+void main_loop(Publishers &pubs)
 {
-    int cnt_cloud = 0;
+    int cnt_views = 0, cnt_views_to_refine = 0, cnt_skipped_views = 0; // of all streams, in the current scan
+    ros::WallTime time_last_view = ros::WallTime::now();
     while (ros::ok())
     {
-        if (!buff_cloud_src.empty() && !buff_T_baxter_to_depthcam.empty())
-        {
-            cnt_cloud++;
-
-            // Get data from buff
-            T_baxter_to_depthcam = buff_T_baxter_to_depthcam.front();
-            buff_T_baxter_to_depthcam.pop();
-            cloud_src = buff_cloud_src.front();
-            buff_cloud_src.pop();
-
-            // Process cloud
-            process_to_get_cloud_rotated();
-            process_to_get_cloud_segmented();
-
-            // print
-            print_cloud_processing_result(cnt_cloud); // Print info
+        // -- Apply a new config between frames
+        if (has_pending_config)
+            apply_pending_config();
 
+        // -- Dispatch the next frames of each stream to the worker pool
+        for (int k = 0; k < num_streams; k++)
+        {
+            Stream &stream = streams[k];
+            while (!has_pending_config && stream.num_processing < max_frames_in_flight)
+            {
+                FramePtr frame(new Frame);
+                if (!(flag_continuous_scan ? pop_interpolated_frame(stream, *frame) : pop_paired_frame(stream, *frame)))
+                    break;
+                frame->stream_idx = k;
+                cnt_views_received++;
+                if (flag_continuous_scan)
+                    frame->trace_id = my_basics::makeTraceId(my_basics::getTraceScan(stream.last_trace_id),
+                                                             cnt_views_received);
+                if (flag_select_keyframes && !select_keyframe(*frame))
+                {
+                    cnt_skipped_views++;
+                    continue;
+                }
+                frame->cnt_cloud = ++stream.cnt_cloud;
+                frame->stamp_cloud_src = pcl_conversions::fromPCL(frame->cloud_src->header.stamp);
+                frame->point_budget = stream.point_budget;
+                frame->voxel_grid_size = stream.voxel_grid_size;
+                frame->crop_box = my_pcl::CropBox{-stream.x_range_radius, stream.x_range_radius,
+                                                  -stream.y_range_radius, stream.y_range_radius,
+                                                  stream.z_range_low, stream.z_range_up};
+                frame->is_roi_shrunk = adaptive_roi && adaptive_roi->shrinkBox(frame->crop_box);
+
+                stream.num_processing++;
+                bytes_of_clouds_in_flight += my_pcl::getCloudBytes(*frame->cloud_src);
+                worker_pool->push([frame]() {
+                    process_frame(*frame, streams[frame->stream_idx]);
+                    std::lock_guard<std::mutex> lock(mtx_frames_done);
+                    frames_done.push(frame);
+                });
+            }
+        }
 
-            // Save to file
-            string suffix = my_basics::int2str(cnt_cloud, file_name_index_width) + ".pcd";
-
-            string f0 = file_folder + file_name_cloud_src + suffix;
-            my_pcl::write_point_cloud(f0, cloud_src);
+        // -- Output the processed frames
+        while (1)
+        {
+            FramePtr frame;
+            {
+                std::lock_guard<std::mutex> lock(mtx_frames_done);
+                if (frames_done.empty())
+                    break;
+                frame = frames_done.front();
+                frames_done.pop();
+            }
+            Stream &stream = streams[frame->stream_idx];
+            stream.num_processing--;
+            bytes_of_clouds_in_flight -= my_pcl::getCloudBytes(*frame->cloud_src);
+            stream.point_budget = frame->point_budget;
+            stream.voxel_grid_size = frame->voxel_grid_size;
+            {
+                my_basics::MemoryStage memory_stage(mem_stage_output);
+                my_basics::TraceScope trace_scope(*tracer, "output", frame->trace_id, frame->cloud_src->header.stamp);
+                output_frame(*frame, pubs);
+            }
+            cnt_views++, cnt_views_to_refine++;
+            time_last_view = ros::WallTime::now();
+        }
 
-            string f2 = file_folder + file_name_cloud_segmented + suffix;
-            my_pcl::write_point_cloud(f2, cloud_segmented);
+        // -- After the last view (of all streams) is output or skipped, or after node1 is told to stop
+        int num_processing = 0;
+        for (const Stream &stream : streams)
+            num_processing += stream.num_processing;
+        if (!flag_continuous_scan &&
+            (cnt_views + cnt_skipped_views == num_goalposes * num_streams || (nbv_scan_stopped && num_processing == 0)))
+        {
+            end_scan(pubs.refined, cnt_views_to_refine > 0);
+            cnt_views = cnt_skipped_views = cnt_views_to_refine = 0; // count the views of the next scan
+        }
+        if (nbv_scan_stopped && num_processing == 0)
+            nbv_scan_stopped = false;
 
-            // Publish
-            pubPclCloudToTopic(pub_to_rviz, cloud_rotated);
-            pubPclCloudToTopic(pub_to_node3, cloud_segmented);
+        // -- In continuous scan, the number of views is unknown. A sweep ends when no view comes for a while.
+        if (flag_continuous_scan && cnt_views + cnt_skipped_views > 0 &&
+            ros::WallTime::now().toSec() - time_last_view.toSec() > sweep_end_seconds)
+        {
+            end_scan(pubs.refined, cnt_views_to_refine >= 2);
+            cnt_views = cnt_skipped_views = cnt_views_to_refine = 0;
+        }
 
+        update_memory_gauges();
+        {
+            my_basics::MemoryStage memory_stage(mem_stage_receive); // deserialize and queue the clouds
+            ros::spinOnce(); // In python, sub is running in different thread. In C++, same thread. So need this.
         }
-        ros::spinOnce(); // In python, sub is running in different thread. In C++, same thread. So need this.
         ros::Duration(0.01).sleep();
     }
+    worker_pool.reset(); // finish the frames in the pool
+    if (flag_trace)
+        tracer->write(file_folder + "trace_node2.json");
 }
 
 // -- Main: set up variables, subscribers, and publishers.
@@ -147,14 +468,104 @@ int main(int argc, char **argv)
     ros::NodeHandle nh;
     initAllROSParams();
 
+    // Live reconfiguration. The initial config is read from the params of the launch file.
+    dynamic_reconfigure::Server<scan3d_by_baxter::Node2Config> reconfigure_server(ros::NodeHandle("~"));
+    reconfigure_server.setCallback(boost::bind(reconfigureCallback, _1, _2));
+
     // Subscriber and Publisher
-    ros::Subscriber sub_from_node1 = nh.subscribe(topic_n1_to_n2, 10, subCallbackFromNode1); // 10 is queue size
-    ros::Subscriber sub_from_kinect = nh.subscribe(topic_name_rgbd_cloud, 10, subCallbackFromKinect);
-    ros::Publisher pub_to_node3 = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_n3, 10);
-    ros::Publisher pub_to_rviz = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_rviz, 10);
+    for (int k = 0; k < num_streams; k++)
+    {
+        Stream &stream = streams[k];
+        stream.sub_pose = nh.subscribe<scan3d_by_baxter::T4x4>(
+            stream.topic_n1_to_n2, 10, boost::bind(subCallbackFromNode1, _1, k)); // 10 is queue size
+        stream.sub_cloud = nh.subscribe<sensor_msgs::PointCloud2>(
+            stream.topic_name_rgbd_cloud, 10, boost::bind(subCallbackFromKinect, _1, k));
+        stream.pub_to_node3_tagged = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_n3 + "/" + stream.name, 10);
+    }
+    Publishers pubs;
+    pubs.to_node3 = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_n3, 10);
+    pubs.to_rviz = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_rviz, 10);
+    pubs.normals_to_node3 = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_n3_normals, 10);
+    pubs.refined = nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_rviz_refined, 10);
+
+    // Shared memory transport
+    if (flag_use_shm_transport)
+    {
+        shm_cloud_rotated.reset(new my_pcl::CloudShmRingWriter(
+            shm_name_cloud_rotated, shm_num_slots, shm_slot_capacity));
+        shm_cloud_segmented.reset(new my_pcl::CloudShmRingWriter(
+            shm_name_cloud_segmented, shm_num_slots, shm_slot_capacity));
+        assert(shm_cloud_rotated->isOpen() && shm_cloud_segmented->isOpen());
+        pubs.to_node3_shm = nh.advertise<scan3d_by_baxter::CloudSlot>(topic_n2_to_n3_shm, 10);
+        pubs.to_rviz_shm = nh.advertise<scan3d_by_baxter::CloudSlot>(topic_n2_to_rviz_shm, 10);
+    }
+
+    // Scan session archive
+    if (flag_write_archive)
+    {
+        archive_writer.reset(new my_pcl::ScanArchiveWriter(file_folder + file_name_archive, archive_max_frames));
+        assert(archive_writer->isOpen());
+    }
+
+    // Multi-view refinement
+    if (flag_do_multiview_refine)
+        multiview_register.reset(new my_pcl::MultiViewRegistration(
+            refine_voxel_size, refine_max_correspondence_distance,
+            refine_max_iterations, refine_max_neighbors));
+    if (flag_do_multiview_refine && flag_do_carving)
+        carving.reset(new my_pcl::FreeSpaceCarving(carving_pixel_angle, carving_margin, carving_min_votes));
+
+    // Keyframe selection
+    if (flag_select_keyframes)
+    {
+        const Stream &stream = streams[0];
+        keyframe_selector.reset(new my_pcl::CoverageKeyframeSelector(
+            -stream.x_range_radius, stream.x_range_radius, -stream.y_range_radius, stream.y_range_radius,
+            max(stream.z_range_low, plane_distance_threshold_0), stream.z_range_up,
+            keyframe_voxel_size, keyframe_min_new_voxels, keyframe_sample_stride));
+    }
+
+    // Multi-object scan
+    if (flag_multi_object && !flag_do_clustering)
+        cout << "my WARNING: flag_multi_object needs flag_do_clustering. Scan a single object." << endl;
+    else if (flag_multi_object)
+        object_tracker.reset(new my_pcl::ObjectTracker(object_max_centroid_distance, object_min_box_overlap,
+                                                       max_objects));
+
+    // Adaptive crop box
+    if (flag_adaptive_roi && flag_do_range_filt)
+        adaptive_roi.reset(new my_pcl::AdaptiveCropBox(roi_margin, roi_min_views, roi_outlier_ratio));
+
+    // Next best view
+    ros::ServiceServer srv_nbv;
+    if (flag_use_nbv)
+    {
+        const Stream &stream = streams[0];
+        nbv_planner.reset(new my_pcl::NextBestViewPlanner(
+            -stream.x_range_radius, stream.x_range_radius, -stream.y_range_radius, stream.y_range_radius,
+            max(stream.z_range_low, plane_distance_threshold_0), stream.z_range_up, nbv_voxel_size));
+        srv_nbv = nh.advertiseService(nbv_service_name, srvCallbackNextBestView);
+    }
+
+    // Tracing
+    tracer.reset(new my_basics::TraceRecorder("node2", flag_trace));
+
+    // Memory profiling
+    mem_stage_receive = my_basics::getMemoryStage("receive");
+    mem_stage_filter = my_basics::getMemoryStage("filter");
+    mem_stage_segment = my_basics::getMemoryStage("segment");
+    mem_stage_normals = my_basics::getMemoryStage("normals");
+    mem_stage_output = my_basics::getMemoryStage("output");
+    mem_stage_register = my_basics::getMemoryStage("register");
+    mem_stage_refine = my_basics::getMemoryStage("refine");
+    if (flag_profile_memory && !my_basics::isMemoryProfilingEnabled())
+        cout << "my WARNING: allocations are not counted. Build with -DPROFILE_MEMORY=ON to count them." << endl;
+
+    // max_frames_in_flight workers per stream
+    worker_pool.reset(new my_basics::ThreadPool(num_streams * max_frames_in_flight));
 
     // -- Loop, subscribe ros_cloud, and view
-    main_loop(pub_to_node3, pub_to_rviz);
+    main_loop(pubs);
 
     // Return
     ROS_INFO("Node2 stops");
@@ -167,15 +578,150 @@ int main(int argc, char **argv)
 
 // -----------------------------------------------------
 // -----------------------------------------------------
-void process_to_get_cloud_rotated()
+PointCloud<PointXYZRGB>::Ptr convert_ros_cloud(const sensor_msgs::PointCloud2 &ros_cloud)
+{
+    // Func: The input cloud of a view, voxelized by ingest_voxel_size. The header (stamp) is kept.
+    PointCloud<PointXYZRGB>::Ptr cloud(new PointCloud<PointXYZRGB>);
+    fromROSMsg(ros_cloud, *cloud);
+    if (ingest_voxel_size > 0)
+        cloud = my_pcl::filtByVoxelGrid(cloud, ingest_voxel_size, ingest_voxel_size, ingest_voxel_size);
+    return cloud;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+bool pop_paired_frame(Stream &stream, Frame &frame)
+{
+    // Func: Get the next pair of pose and cloud
+    double stamp_pose, stamp_cloud;
+    sensor_msgs::PointCloud2::ConstPtr ros_cloud;
+    if (!stream.sync.pop(frame.T_baxter_to_depthcam, ros_cloud, stamp_pose, stamp_cloud))
+        return false;
+    frame.cloud_src = convert_ros_cloud(*ros_cloud);
+    map<double, uint64_t>::iterator it = stream.trace_ids_of_poses.find(stamp_pose);
+    frame.trace_id = it == stream.trace_ids_of_poses.end() ? 0 : it->second;
+    stream.trace_ids_of_poses.erase(stream.trace_ids_of_poses.begin(), stream.trace_ids_of_poses.upper_bound(stamp_pose));
+    printf("Node 2: %s: pose at %.3f <--> cloud at %.3f. Dropped so far: %d poses, %d clouds\n",
+           stream.name.c_str(), stamp_pose, stamp_cloud,
+           stream.sync.getNumDroppedFirst(), stream.sync.getNumDroppedSecond());
+    return true;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+bool pop_interpolated_frame(Stream &stream, Frame &frame)
+{
+    // Func: Get the oldest cloud whose pose can be interpolated. Clouds whose pose will never be known are dropped.
+    while (!stream.clouds.empty())
+    {
+        PointCloud<PointXYZRGB>::Ptr cloud = stream.clouds.front();
+        double stamp = pcl_conversions::fromPCL(cloud->header.stamp).toSec();
+        Eigen::Matrix4f T;
+        my_basics::PoseInterpolator::Result res = stream.pose_buffer.interpolate(stamp, T);
+        if (res == my_basics::PoseInterpolator::TOO_NEW)
+            return false; // wait for the poses
+        stream.clouds.pop_front();
+        if (res != my_basics::PoseInterpolator::OK)
+        {
+            stream.num_dropped_clouds++;
+            continue;
+        }
+        frame.cloud_src = cloud;
+        frame.T_baxter_to_depthcam.assign(4, vector<float>(4, 0));
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                frame.T_baxter_to_depthcam[i][j] = T(i, j);
+        printf("Node 2: %s: cloud at %.3f, pose interpolated. Dropped so far: %d clouds\n",
+               stream.name.c_str(), stamp, stream.num_dropped_clouds);
+        return true;
+    }
+    return false;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+int get_num_poses_done()
+{
+    // Func: Poses of node1 that are done with: popped as a view, or dropped by the sync (no cloud matched, or
+    //       the queue was full). node1 waits for this to reach the number of views it sent.
+    int num = cnt_views_received;
+    for (const Stream &stream : streams)
+        num += stream.sync.getNumDroppedFirst();
+    return num;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+bool select_keyframe(const Frame &frame)
+{
+    // Func: Whether the view observes enough new voxels of the crop box, by its raw cloud and pose.
+    //       Rejected views skip all the processing, registration and writing.
+    my_basics::TraceScope trace_scope(*tracer, "select_keyframe", frame.trace_id, frame.cloud_src->header.stamp);
+    bool res = keyframe_selector->select(*frame.cloud_src, get_T_chess_to_depthcam(frame.T_baxter_to_depthcam));
+    printf("Node 2: %s: %s keyframe, %d new voxels. Observed %d/%d voxels, %d keyframes, %d skipped\n",
+           streams[frame.stream_idx].name.c_str(), res ? "a" : "not a", keyframe_selector->getLastNewVoxels(),
+           keyframe_selector->getNumObserved(), keyframe_selector->getNumVoxels(),
+           keyframe_selector->getNumSelected(), keyframe_selector->getNumRejected());
+    return res;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+void process_frame(Frame &frame, const Stream &stream)
+{
+    // Func: All processing of a frame. Runs on a worker thread.
+    ros::WallTime t0 = ros::WallTime::now();
+    const uint64_t stamp_us = frame.cloud_src->header.stamp;
+    {
+        my_basics::MemoryStage memory_stage(mem_stage_filter);
+        my_basics::TraceScope trace_scope(*tracer, "filter", frame.trace_id, stamp_us);
+        process_to_get_cloud_rotated(frame, stream);
+    }
+    {
+        my_basics::MemoryStage memory_stage(mem_stage_segment);
+        my_basics::TraceScope trace_scope(*tracer, "segment", frame.trace_id, stamp_us);
+        process_to_get_cloud_segmented(frame, stream);
+    }
+    if (flag_compute_normals)
+    {
+        my_basics::MemoryStage memory_stage(mem_stage_normals);
+        my_basics::TraceScope trace_scope(*tracer, "normals", frame.trace_id, stamp_us);
+        process_to_get_normals_segmented(frame);
+    }
+    frame.process_seconds = ros::WallTime::now().toSec() - t0.toSec();
+    update_point_budget(frame, frame.process_seconds);
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+void process_to_get_cloud_rotated(Frame &frame, const Stream &stream)
 {
     // Func: Filtering; Rotate cloud to Baxter robot frame
-    pcl::copyPointCloud(*cloud_src, *cloud_rotated);
+    if (frame.is_roi_shrunk)
+    {
+        // -- Crop the raw cloud by the adaptive crop box, so that all later steps process the object's region only
+        printf("Node2 (%s): crop by the adaptive box ...", stream.name.c_str());
+        frame.cloud_rotated = my_pcl::cropByBoxInFrame(
+            *frame.cloud_src, get_T_chess_to_depthcam(frame.T_baxter_to_depthcam), frame.crop_box);
+        const my_pcl::CropBox &box = frame.crop_box;
+        printf("done. %d of %d points; box x [%.3f, %.3f], y [%.3f, %.3f], z [%.3f, %.3f] m\n",
+               (int)frame.cloud_rotated->points.size(), (int)frame.cloud_src->points.size(),
+               box.x_min, box.x_max, box.y_min, box.y_max, box.z_min, box.z_max);
+    }
+    else
+    {
+        frame.cloud_rotated.reset(new PointCloud<PointXYZRGB>);
+        pcl::copyPointCloud(*frame.cloud_src, *frame.cloud_rotated);
+    }
 
-    // -- filtByVoxelGrid
-    printf("Node2: filtByVoxelGrid ...");
-    cloud_rotated = my_pcl::filtByVoxelGrid(cloud_rotated, x_grid_size, y_grid_size, z_grid_size);
-    printf("done\n");
+    // -- filtByVoxelGrid, or filtByVoxelGridToBudget if voxel_point_budget > 0
+    printf("Node2 (%s): filtByVoxelGrid ...", stream.name.c_str());
+    frame.cloud_rotated = my_pcl::filtViewByVoxelGrid(frame.cloud_rotated, get_segmentation_params(),
+                                                      frame.point_budget, frame.voxel_grid_size);
+    if (voxel_point_budget > 0)
+        printf("done. Budget %d points, grid size %.4f m\n", frame.point_budget, frame.voxel_grid_size);
+    else
+        printf("done\n");
 
     // -- filtByStatisticalOutlierRemoval
     // printf("Node2: filtByStatisticalOutlierRemoval ... ");
@@ -183,93 +729,353 @@ void process_to_get_cloud_rotated()
     // printf("done\n");
 
     // -- rotate cloud to Baxter's frame
-    printf("Node2: rotate cloud to Baxter's frame ...");
-    for (PointXYZRGB &p : cloud_rotated->points)
-        my_basics::preTranslatePoint(T_baxter_to_depthcam, p.x, p.y, p.z);
+    printf("Node2 (%s): rotate cloud to Baxter's frame ...", stream.name.c_str());
+    for (PointXYZRGB &p : frame.cloud_rotated->points)
+        my_basics::preTranslatePoint(frame.T_baxter_to_depthcam, p.x, p.y, p.z);
     printf("done\n");
 }
 
 // -----------------------------------------------------
 // -----------------------------------------------------
-void process_to_get_cloud_segmented()
+void process_to_get_cloud_segmented(Frame &frame, const Stream &stream)
 {
     // Func:    Range filtering，
     //          Optional: Remove plane (table); Do clustering; Choose the largest one
+    //          (see my_pcl/pcl_segment_view.h, also run by the offline tools)
+    const my_pcl::ViewSegmentationParams params = get_segmentation_params();
+
+    // -- rotate cloud to Chessboard's frame, and filtByPassThrough (by range)
+    printf("Node2 (%s): rotate to the chessboard frame%s ...", stream.name.c_str(),
+           flag_do_range_filt ? " and do_range_filt" : "");
+    PointCloud<PointXYZRGB>::Ptr cloud_cropped =
+        my_pcl::cropViewInChessFrame(*frame.cloud_rotated, T_chess_to_baxter, frame.crop_box, params);
+    printf("done\n");
 
-    // -- rotate cloud to Chessboard's frame
-    copyPointCloud(*cloud_rotated, *cloud_segmented);
-    for (PointXYZRGB &p : cloud_segmented->points)
-        my_basics::preTranslatePoint(T_chess_to_baxter, p.x, p.y, p.z);
+    // -- Remove planes, and clustering
+    my_pcl::SegmentedView res;
+    my_pcl::segmentView(cloud_cropped, params, res);
+    frame.cloud_segmented = res.cloud_segmented;
+    frame.cloud_objects = res.cloud_objects;
+    frame.index_segmented = res.index;
+}
 
-    // -- filtByPassThrough (by range)
-    if (flag_do_range_filt)
+// -----------------------------------------------------
+// -----------------------------------------------------
+my_pcl::ViewSegmentationParams get_segmentation_params()
+{
+    // Func: The params of the filtering and segmentation of a frame, from the current ROS params.
+    my_pcl::ViewSegmentationParams params;
+    params.x_grid_size = x_grid_size, params.y_grid_size = y_grid_size, params.z_grid_size = z_grid_size;
+    params.voxel_point_budget = voxel_point_budget;
+    params.voxel_min_grid_size = voxel_min_grid_size, params.voxel_max_grid_size = voxel_max_grid_size;
+    params.voxel_search_seconds = voxel_search_seconds;
+    params.flag_do_range_filt = flag_do_range_filt;
+    params.flag_use_compact_cloud = flag_use_compact_cloud;
+    params.compact_cloud_resolution = compact_cloud_resolution;
+    params.plane_distance_threshold_0 = plane_distance_threshold_0;
+    params.plane_distance_threshold = plane_distance_threshold;
+    params.plane_max_iterations = plane_max_iterations, params.num_planes = num_planes;
+    params.ratio_of_rest_points = ratio_of_rest_points;
+    params.flag_detect_table_by_histogram = flag_detect_table_by_histogram;
+    params.flag_do_clustering = flag_do_clustering;
+    params.cluster_tolerance = cluster_tolerance;
+    params.min_cluster_size = min_cluster_size, params.max_cluster_size = max_cluster_size;
+    params.flag_multi_object = flag_multi_object;
+    params.flag_use_spatial_index = flag_use_spatial_index;
+    params.spatial_index_voxel_size = spatial_index_voxel_size;
+    return params;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+void process_to_get_normals_segmented(Frame &frame)
+{
+    // Func: Compute normals of cloud_segmented (in chessboard frame) once per view,
+    //       and make them point to the depth camera.
+    printf("Node2 (%s): compute normals ...", streams[frame.stream_idx].name.c_str());
+    if (frame.index_segmented) // reuse the kdtree of the index
+        frame.normals_segmented = my_pcl::computeNormalsPCA(*frame.index_segmented, normals_k_search);
+    else
+        frame.normals_segmented = my_pcl::computeNormalsPCA(frame.cloud_segmented, normals_k_search);
+
+    float cam_x, cam_y, cam_z;
+    get_camera_pos_in_chess_frame(frame, cam_x, cam_y, cam_z);
+    my_pcl::orientNormalsTowardsViewpoint(frame.cloud_segmented, frame.normals_segmented, cam_x, cam_y, cam_z);
+    printf("done\n");
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+void output_frame(Frame &frame, Publishers &pubs)
+{
+    // Func: Save and publish the results of a processed frame. Runs on the main thread.
+    Stream &stream = streams[frame.stream_idx];
+    if (carving) // by the arm pose. The refinement corrects it after the scan.
     {
-        printf("Node2: do_range_filt ... ");
-        // my_pcl::printCloudSize(cloud_segmented);
-        cloud_segmented = my_pcl::filtByPassThrough(
-            // cloud_segmented, "x", chessboard_x + x_range_radius, chessboard_x - x_range_radius);
-            cloud_segmented, "x", 0 + x_range_radius, 0 - x_range_radius);
+        Eigen::Matrix4f T_chess_to_depthcam = get_T_chess_to_depthcam(frame.T_baxter_to_depthcam);
+        PointCloud<PointXYZRGB> cloud_in_chess_frame;
+        pcl::transformPointCloud(*frame.cloud_src, cloud_in_chess_frame, T_chess_to_depthcam);
+        carving->addView(cloud_in_chess_frame, T_chess_to_depthcam);
+    }
+    if (object_tracker)
+        output_objects(frame);
+    if (flag_do_multiview_refine && !object_tracker) // or by object
+    {
+        // Queue the pairwise ICP of this view. It runs on other threads while the arm moves.
+        float cam_x, cam_y, cam_z;
+        get_camera_pos_in_chess_frame(frame, cam_x, cam_y, cam_z);
+        my_basics::MemoryStage memory_stage(mem_stage_register); // and its queued ICP jobs
+        multiview_register->addView(frame.cloud_segmented, Eigen::Vector3f(cam_x, cam_y, cam_z));
+    }
+    if (adaptive_roi) // the crop box of the next frames
+        adaptive_roi->addView(*frame.cloud_segmented);
+    if (flag_use_nbv) // the raw cloud also frees the space in front of the table
+        nbv_planner->integrateView(*frame.cloud_src, get_T_chess_to_depthcam(frame.T_baxter_to_depthcam),
+                                   nbv_sample_stride);
+
+    // print
+    print_cloud_processing_result(frame); // Print info
+    if (flag_profile_memory)
+        print_memory_of_frame(frame);
+
+    // Save to file
+    if (flag_write_archive)
+        archive_writer->appendFrame(frame.T_baxter_to_depthcam, frame.cloud_src, frame.cloud_segmented);
+    string file_segmented; // node3 reads it if the shm slot is overwritten
+    if (flag_write_pcd_files)
+    {
+        // The first stream keeps the file names of a single camera
+        string prefix = frame.stream_idx == 0 ? "" : stream.name + "_";
+        string suffix = prefix + my_basics::int2str(frame.cnt_cloud, file_name_index_width) + ".pcd";
 
-        cloud_segmented = my_pcl::filtByPassThrough(
-            // cloud_segmented, "y", chessboard_y + y_range_radius, chessboard_y - y_range_radius);
-            cloud_segmented, "y", 0 + y_range_radius, 0 - y_range_radius);
+        string f0 = file_folder + file_name_cloud_src + suffix;
+        my_pcl::write_point_cloud(f0, frame.cloud_src);
 
-        cloud_segmented = my_pcl::filtByPassThrough(
-            // cloud_segmented, "z", chessboard_z + z_range_up, chessboard_z + z_range_low);
-            cloud_segmented, "z", 0 + z_range_up, 0 + z_range_low);
-        printf("done\n");
-        // my_pcl::printCloudSize(cloud_segmented);
-    }
-
-    // -- Remove planes
-    // 1. Seprate cloud into {near plane} & {far from plane}
-    PointCloud<PointXYZRGB>::Ptr cld_near_plane(new PointCloud<PointXYZRGB>);
-    PointCloud<PointXYZRGB>::Ptr cld_far_plane(new PointCloud<PointXYZRGB>);
-    double th = plane_distance_threshold_0;
-    for(PointXYZRGB &pt:cloud_segmented->points){
-        if(pt.z<=th && pt.z>=-th){
-            cld_near_plane->points.push_back(pt);
-        }else{
-            cld_far_plane->points.push_back(pt);
-        }
+        file_segmented = file_folder + file_name_cloud_segmented + suffix;
+        my_pcl::write_point_cloud(file_segmented, frame.cloud_segmented);
     }
-    cld_near_plane->width  = cld_near_plane->points.size();
-    cld_far_plane->width  = cld_far_plane->points.size();
-    cld_near_plane->height = cld_far_plane->height = 1;
 
-    // 2. Remove plane in {near plane} 
-    int num_removed_planes = my_pcl::removePlanes(
-        cld_near_plane,
-        plane_distance_threshold, plane_max_iterations,
-        num_planes, ratio_of_rest_points, true);
+    // Publish. The common topics take the frames of all streams.
+    const ros::Time &stamp = frame.stamp_cloud_src;
+    if (flag_use_shm_transport)
+    {
+        pubPclCloudToShm(*shm_cloud_rotated, shm_name_cloud_rotated, pubs.to_rviz_shm,
+                         frame.cloud_rotated, stamp, stream.name, frame.trace_id, "");
+        pubPclCloudToShm(*shm_cloud_segmented, shm_name_cloud_segmented, pubs.to_node3_shm,
+                         frame.cloud_segmented, stamp, stream.name, frame.trace_id, file_segmented);
+    }
+    // With shm on, only serialize the full cloud when some node (rviz, node3) subscribes by TCP.
+    if (!flag_use_shm_transport || pubs.to_rviz.getNumSubscribers() > 0)
+        pubPclCloudToTopic(pubs.to_rviz, frame.cloud_rotated, stamp);
+    if (!flag_use_shm_transport || pubs.to_node3.getNumSubscribers() > 0)
+        pubPclCloudToTopic(pubs.to_node3, frame.cloud_segmented, stamp);
+    if (stream.pub_to_node3_tagged.getNumSubscribers() > 0)
+        pubPclCloudToTopic(stream.pub_to_node3_tagged, frame.cloud_segmented, stamp);
+    if (flag_compute_normals && pubs.normals_to_node3.getNumSubscribers() > 0)
+        pubPclCloudToTopic(pubs.normals_to_node3,
+                           my_pcl::combinePointsAndNormals(frame.cloud_segmented, frame.normals_segmented), stamp);
+}
 
-    // 3. Combine {near plane} & {far from plane} and save back to cloud_segmented
-    *cld_near_plane += *cld_far_plane;
-    pcl::copyPointCloud(*cld_near_plane, *cloud_segmented);
+// -----------------------------------------------------
+// -----------------------------------------------------
+void process_to_refine_all_views(ros::Publisher &pub_refined)
+{
+    // Func: After the last view, solve the pose graph of all views (the pairwise ICP is already done
+    //       or running on the thread pool), then merge the corrected views, pub and save.
+    //       With flag_multi_object, the views of each object, and the union of the objects.
+    my_basics::MemoryStage memory_stage(mem_stage_refine);
+    my_basics::TraceScope trace_scope(*tracer, "refine", 0);
+    PointCloud<PointXYZRGB>::Ptr cloud_refined;
+    if (object_tracker) // the union of the objects, each refined and carved
+        cloud_refined = process_to_refine_objects();
+    else
+    {
+        printf("Node2: refine all %d views ...", multiview_register->getNumViews());
+        ros::Time t0 = ros::Time::now();
+        int num_edges = multiview_register->refine();
+        cloud_refined = multiview_register->getMergedCloud(refine_merge_voxel_size);
+        printf("done. %d pairwise edges, %.3f seconds\n", num_edges, (ros::Time::now() - t0).toSec());
+    }
+    if (carving && !object_tracker) // by the refined poses: the views of the refinement are the carving's views
+    {
+        assert(multiview_register->getNumViews() == carving->getNumViews());
+        my_pcl::FreeSpaceCarving::Corrections corrections(carving->getNumViews());
+        for (int k = 0; k < carving->getNumViews(); k++)
+            corrections[k] = multiview_register->getCorrection(k);
+        int num_points = cloud_refined->points.size();
+        cloud_refined = carving->carve(*cloud_refined, corrections);
+        printf("Node2: free-space carving by %d views removed %d of %d points\n", carving->getNumViews(),
+               num_points - (int)cloud_refined->points.size(), num_points);
+    }
 
+    pubPclCloudToTopic(pub_refined, cloud_refined, ros::Time::now());
+    my_pcl::write_point_cloud(file_folder + file_name_cloud_refined, cloud_refined);
+}
 
-    // -- Clustering: Divide the remaining point cloud into different clusters
-    if (flag_do_clustering)
+// -----------------------------------------------------
+// -----------------------------------------------------
+void end_scan(ros::Publisher &pub_refined, bool flag_refine)
+{
+    // Func: After the last view of a scan, or at the end of a sweep: refine the views if asked, then reset all
+    //       that was built over the scan, whether it was refined or not. The next scan starts afresh.
+    if (flag_do_multiview_refine && flag_refine)
+        process_to_refine_all_views(pub_refined);
+    if (multiview_register)
+        multiview_register->clear();
+    if (carving)
+        carving.reset(new my_pcl::FreeSpaceCarving(carving_pixel_angle, carving_margin, carving_min_votes));
+    if (object_tracker)
+        object_tracker->clear(), object_registers.clear(), object_carving_views.clear();
+    if (keyframe_selector)
+        keyframe_selector->clear();
+    if (adaptive_roi)
+        adaptive_roi->clear();
+    if (nbv_planner)
+    {
+        nbv_planner->clear();
+        nbv_first_view_of_scan = get_num_poses_done();
+    }
+    if (flag_trace)
+        tracer->write(file_folder + "trace_node2.json");
+    if (flag_profile_memory) // the allocations of this scan, and the peaks
     {
-        vector<PointIndices> clusters_indices = my_pcl::divideIntoClusters(
-            cloud_segmented, cluster_tolerance, min_cluster_size, max_cluster_size);
+        printf("Node2: memory of the scan: largest frame %.2f MB, clouds held %.2f MB, queued frames %d at peak\n%s",
+               gauge_frame_bytes.getPeak() / 1e6, gauge_cloud_bytes.getPeak() / 1e6,
+               (int)gauge_queue_depth.getPeak(), my_basics::getMemoryReport().c_str());
+        my_basics::resetMemoryStats();
+        gauge_frame_bytes.resetPeak(), gauge_cloud_bytes.resetPeak(), gauge_queue_depth.resetPeak();
+    }
+}
 
-        // -- Extract indices into cloud clusters
-        vector<PointCloud<PointXYZRGB>::Ptr> cloud_clusters =
-            my_pcl::extractSubCloudsByIndices(cloud_segmented, clusters_indices);
-        cloud_segmented = cloud_clusters[0];
+// -----------------------------------------------------
+// -----------------------------------------------------
+void output_objects(Frame &frame)
+{
+    // Func: Associate the clusters of a processed frame with the objects, and give each object its part of the view:
+    //       its multi-view refinement, its topic and its files. Runs on the main thread.
+    vector<int> ids = object_tracker->addView(frame.cloud_objects);
+    vector<PointCloud<PointXYZRGB>::Ptr> views_of_objects(object_tracker->getNumObjects());
+    for (size_t c = 0; c < ids.size(); c++)
+    {
+        if (ids[c] < 0)
+            continue;
+        PointCloud<PointXYZRGB>::Ptr &view = views_of_objects[ids[c]];
+        if (!view)
+            view.reset(new PointCloud<PointXYZRGB>);
+        *view += *frame.cloud_objects[c];
     }
+    ros::NodeHandle nh;
+    float cam_x, cam_y, cam_z;
+    get_camera_pos_in_chess_frame(frame, cam_x, cam_y, cam_z);
+    printf("Node 2: %d clusters of %s, %d objects:", (int)ids.size(), streams[frame.stream_idx].name.c_str(),
+           object_tracker->getNumObjects());
+    for (int id = 0; id < object_tracker->getNumObjects(); id++)
+    {
+        // A new object
+        const string tag = "object" + my_basics::int2str(id + 1, 2);
+        if (id >= (int)object_registers.size())
+            object_registers.push_back(boost::shared_ptr<my_pcl::MultiViewRegistration>(
+                new my_pcl::MultiViewRegistration(refine_voxel_size, refine_max_correspondence_distance,
+                                                  refine_max_iterations, refine_max_neighbors, 1e-4,
+                                                  object_icp_threads)));
+        if (id >= (int)object_carving_views.size())
+            object_carving_views.push_back(vector<int>());
+        if (id >= (int)pubs_object_to_node3.size())
+        {
+            pubs_object_to_node3.push_back(nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_n3 + "/" + tag, 10));
+            pubs_object_refined.push_back(
+                nh.advertise<sensor_msgs::PointCloud2>(topic_n2_to_rviz_refined + "/" + tag, 10));
+        }
 
+        const PointCloud<PointXYZRGB>::Ptr &view = views_of_objects[id];
+        if (!view)
+            continue;
+        printf(" %s %d points (%d views)", tag.c_str(), (int)view->points.size(), object_tracker->getObject(id).num_views);
+        if (flag_do_multiview_refine)
+        {
+            my_basics::MemoryStage memory_stage(mem_stage_register);
+            object_registers[id]->addView(view, Eigen::Vector3f(cam_x, cam_y, cam_z));
+            if (carving) // added for this frame by output_frame
+                object_carving_views[id].push_back(carving->getNumViews() - 1);
+        }
+        if (flag_write_pcd_files)
+            my_pcl::write_point_cloud(file_folder + file_name_cloud_segmented + tag + "_" +
+                                          my_basics::int2str(frame.cnt_cloud, file_name_index_width) + ".pcd",
+                                      view);
+        if (pubs_object_to_node3[id].getNumSubscribers() > 0)
+            pubPclCloudToTopic(pubs_object_to_node3[id], view, frame.stamp_cloud_src);
+    }
+    printf("\n");
+}
+
+PointCloud<PointXYZRGB>::Ptr process_to_refine_objects()
+{
+    // Func: Refine the views of each object, all objects in parallel (their pairwise ICP is already done or running
+    //       on their own thread pools), then carve, pub and save each object. Return the union of the objects.
+    const int num_objects = object_registers.size();
+    printf("Node2: refine %d objects ...", num_objects);
+    ros::Time t0 = ros::Time::now();
+    vector<PointCloud<PointXYZRGB>::Ptr> clouds_refined(num_objects);
+    my_basics::parallelFor(0, num_objects, [&](int begin, int end, int) {
+        for (int id = begin; id < end; id++)
+        {
+            object_registers[id]->refine();
+            clouds_refined[id] = object_registers[id]->getMergedCloud(refine_merge_voxel_size);
+            if (carving) // read only. By the object's refined poses; the views without the object keep the arm pose.
+            {
+                my_pcl::FreeSpaceCarving::Corrections corrections(carving->getNumViews(), Eigen::Matrix4f::Identity());
+                for (int k = 0; k < object_registers[id]->getNumViews(); k++)
+                    corrections[object_carving_views[id][k]] = object_registers[id]->getCorrection(k);
+                clouds_refined[id] = carving->carve(*clouds_refined[id], corrections, 1);
+            }
+        }
+    });
+    printf("done. %.3f seconds\n", (ros::Time::now() - t0).toSec());
+
+    PointCloud<PointXYZRGB>::Ptr cloud_all(new PointCloud<PointXYZRGB>);
+    for (int id = 0; id < num_objects; id++)
+    {
+        const string tag = "object" + my_basics::int2str(id + 1, 2);
+        printf("Node2: %s: %d views, %d points\n", tag.c_str(), object_registers[id]->getNumViews(),
+               (int)clouds_refined[id]->points.size());
+        pubPclCloudToTopic(pubs_object_refined[id], clouds_refined[id], ros::Time::now());
+        my_pcl::write_point_cloud(file_folder + tag + "_" + file_name_cloud_refined, clouds_refined[id]);
+        *cloud_all += *clouds_refined[id];
+    }
+    return cloud_all;
 }
 
 // -----------------------------------------------------
 // -----------------------------------------------------
-void print_cloud_processing_result(int cnt_cloud)
+void get_camera_pos_in_chess_frame(const Frame &frame, float &cam_x, float &cam_y, float &cam_z)
+{
+    // camera position: baxter frame --> chessboard frame
+    const vector<vector<float>> &T = frame.T_baxter_to_depthcam;
+    cam_x = T[0][3], cam_y = T[1][3], cam_z = T[2][3];
+    my_basics::preTranslatePoint(T_chess_to_baxter, cam_x, cam_y, cam_z);
+}
+
+Eigen::Matrix4f get_T_chess_to_depthcam(const vector<vector<float>> &T_baxter_to_depthcam)
+{
+    Eigen::Matrix4f T1, T2;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+        {
+            T1(i, j) = T_chess_to_baxter[i][j];
+            T2(i, j) = T_baxter_to_depthcam[i][j];
+        }
+    return T1 * T2;
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+void print_cloud_processing_result(const Frame &frame)
 {
 
     cout << endl;
     printf("------------------------------------------\n");
-    printf("Node 2: Processing %dth cloud ------------\n", cnt_cloud);
+    printf("Node 2: Processing %dth cloud of %s ------------\n",
+           frame.cnt_cloud, streams[frame.stream_idx].name.c_str());
     ROS_INFO("Subscribed a point cloud from ros topic.");
 
     // cout << "camera pos:" << endl;
@@ -282,16 +1088,104 @@ void print_cloud_processing_result(int cnt_cloud)
     // cout << endl;
 
     cout << "cloud_src: ";
-    my_pcl::printCloudSize(cloud_src);
+    my_pcl::printCloudSize(frame.cloud_src);
 
     cout << "cloud_rotated: ";
-    my_pcl::printCloudSize(cloud_rotated);
+    my_pcl::printCloudSize(frame.cloud_rotated);
 
     cout << "cloud_segmented: ";
-    my_pcl::printCloudSize(cloud_segmented);
+    my_pcl::printCloudSize(frame.cloud_segmented);
     printf("------------------------------------------\n\n");
 }
 
+// -----------------------------------------------------
+// -----------------------------------------------------
+void update_point_budget(Frame &frame, double frame_seconds)
+{
+    // Func: Scale the point budget of the next frame by frame_time_budget / frame_seconds,
+    //       by at most x2 per frame, and within [1000, voxel_point_budget].
+    printf("Node2 (%s): processed the frame in %.3f seconds\n", streams[frame.stream_idx].name.c_str(), frame_seconds);
+    if (voxel_point_budget <= 0 || frame_time_budget <= 0 || frame_seconds <= 0)
+        return;
+    double scale = min(max(frame_time_budget / frame_seconds, 0.5), 2.0);
+    frame.point_budget = min(max((int)(frame.point_budget * scale), 1000), voxel_point_budget);
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+void update_memory_gauges()
+{
+    // Func: Sample the bytes of the clouds held by node2 (queued, or in the worker pool) and the queue depths.
+    //       Runs on the main thread, which owns the queues.
+    int64_t bytes = bytes_of_clouds_in_flight;
+    int depth = 0;
+    for (const Stream &stream : streams)
+    {
+        for (const pair<double, sensor_msgs::PointCloud2::ConstPtr> &item : stream.sync.getSeconds())
+            bytes += item.second->data.size();
+        for (const PointCloud<PointXYZRGB>::Ptr &cloud : stream.clouds)
+            bytes += my_pcl::getCloudBytes(*cloud);
+        depth += stream.sync.getNumSeconds() + stream.clouds.size() + stream.num_processing;
+    }
+    gauge_cloud_bytes.set(bytes);
+    gauge_queue_depth.set(depth);
+}
+
+void print_memory_of_frame(const Frame &frame)
+{
+    // Func: Memory of a processed frame, next to its processing time
+    int64_t frame_bytes = my_pcl::getCloudBytes(*frame.cloud_src) + my_pcl::getCloudBytes(*frame.cloud_rotated) +
+                          my_pcl::getCloudBytes(*frame.cloud_segmented);
+    if (frame.normals_segmented)
+        frame_bytes += my_pcl::getCloudBytes(*frame.normals_segmented);
+    gauge_frame_bytes.set(frame_bytes);
+    printf("Node2 (%s): memory: processed in %.3f s, clouds of the frame %.2f MB; clouds held %.2f MB (peak %.2f), "
+           "queued frames %d (peak %d); heap %.2f MB (peak %.2f), peak RSS %.2f MB\n",
+           streams[frame.stream_idx].name.c_str(), frame.process_seconds, frame_bytes / 1e6,
+           gauge_cloud_bytes.get() / 1e6, gauge_cloud_bytes.getPeak() / 1e6,
+           (int)gauge_queue_depth.get(), (int)gauge_queue_depth.getPeak(),
+           my_basics::getHeapBytes() / 1e6, my_basics::getPeakHeapBytes() / 1e6, my_basics::getPeakRssBytes() / 1e6);
+}
+
+// -----------------------------------------------------
+// -----------------------------------------------------
+bool apply_pending_config()
+{
+    // Func: Copy the pending config of dynamic_reconfigure into the params, once no frame is in processing.
+    //       Runs on the main thread. Return false if frames are still in processing.
+    for (const Stream &stream : streams)
+        if (stream.num_processing > 0)
+            return false;
+    const scan3d_by_baxter::Node2Config &config = pending_config;
+#define APPLY_CONFIG(param_name)                                                                              \
+    if (param_name != (decltype(param_name))config.param_name)                                                \
+    {                                                                                                         \
+        cout << "Node 2: reconfigure " #param_name ": " << param_name << " -> " << config.param_name << endl; \
+        param_name = config.param_name;                                                                       \
+    }
+    if (voxel_point_budget != config.voxel_point_budget || frame_time_budget != config.frame_time_budget)
+        for (Stream &stream : streams)
+            stream.point_budget = -1, stream.voxel_grid_size = -1; // start again from voxel_point_budget
+    APPLY_CONFIG(x_grid_size)
+    APPLY_CONFIG(y_grid_size)
+    APPLY_CONFIG(z_grid_size)
+    APPLY_CONFIG(voxel_point_budget)
+    APPLY_CONFIG(frame_time_budget)
+    APPLY_CONFIG(num_planes)
+    APPLY_CONFIG(plane_distance_threshold_0)
+    APPLY_CONFIG(plane_distance_threshold)
+    APPLY_CONFIG(plane_max_iterations)
+    APPLY_CONFIG(flag_detect_table_by_histogram)
+    APPLY_CONFIG(flag_do_clustering)
+    APPLY_CONFIG(cluster_tolerance)
+    APPLY_CONFIG(min_cluster_size)
+    APPLY_CONFIG(max_cluster_size)
+    APPLY_CONFIG(normals_k_search)
+#undef APPLY_CONFIG
+    has_pending_config = false;
+    return true;
+}
+
 // -----------------------------------------------------
 // -----------------------------------------------------
 void read_T_from_file(float T_16x1[16], string filename)
@@ -307,34 +1201,138 @@ void read_T_from_file(float T_16x1[16], string filename)
     return;
 }
 
-void subCallbackFromNode1(const scan3d_by_baxter::T4x4::ConstPtr &pose_message)
+void subCallbackFromNode1(const scan3d_by_baxter::T4x4::ConstPtr &pose_message, int stream_idx)
 {
     const vector<float> &trans_mat_16x1 = pose_message->TransformationMatrix;
+    Stream &stream = streams[stream_idx];
+    double t_received = my_basics::TraceRecorder::now();
+    tracer->record("receive_pose", t_received, t_received, pose_message->trace_id);
+    stream.last_trace_id = pose_message->trace_id;
+    if (flag_continuous_scan) // a high rate stream: no print
+    {
+        Eigen::Matrix4f T;
+        for (int cnt = 0, i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                T(i, j) = trans_mat_16x1[cnt++];
+        stream.pose_buffer.push(pose_message->header.stamp.toSec(), T);
+        return;
+    }
     vector<vector<float>> tmp(4, vector<float>(4,0));
     for (int cnt = 0, i = 0; i < 4; i++)
         for (int j = 0; j < 4; j++)
             tmp[i][j] = trans_mat_16x1[cnt++];
-    buff_T_baxter_to_depthcam.push(tmp);
-    printf("Node 2: subscribe camera pose from node 1.\n");
+    if (stream.sync.pushFirst(pose_message->header.stamp.toSec(), tmp))
+        stream.trace_ids_of_poses[pose_message->header.stamp.toSec()] = pose_message->trace_id;
+    else
+        cout << "my WARNING: the pose queue of " << stream.name << " is full. Drop the new pose." << endl;
+    printf("Node 2: subscribe camera pose of %s from node 1.\n", stream.name.c_str());
 }
-void subCallbackFromKinect(const sensor_msgs::PointCloud2 &ros_cloud)
+void subCallbackFromKinect(const sensor_msgs::PointCloud2::ConstPtr &ros_cloud, int stream_idx)
 {
-    static int cnt=0;
-    if(buff_T_baxter_to_depthcam.size()>buff_cloud_src.size()){
-        PointCloud<PointXYZRGB>::Ptr tmp(new PointCloud<PointXYZRGB>);
-        fromROSMsg(ros_cloud, *tmp);
-        buff_cloud_src.push(tmp);
-        printf("Node 2 has subscribed the %dth cloud with size %d\n ", ++cnt, (int)tmp->points.size());
+    // The view is not known yet: the span is linked to it by the stamp
+    my_basics::TraceScope trace_scope(*tracer, "receive_cloud", 0, ros_cloud->header.stamp.toNSec() / 1000);
+
+    // Queue the message: it is converted by pop_paired_frame, once paired with a pose
+    Stream &stream = streams[stream_idx];
+    double stamp = ros_cloud->header.stamp.toSec();
+    if (!flag_continuous_scan)
+    {
+        stream.sync.pushSecond(stamp, ros_cloud);
+        return;
     }
+
+    // In continuous scan, all clouds are views. Skip the conversion of a cloud older than all poses to come.
+    if (stream.pose_buffer.size() > 0 && stamp < stream.pose_buffer.getOldestStamp())
+        return;
+    // Keep the latest clouds: the workers are behind the camera
+    if ((int)stream.clouds.size() >= sync_max_clouds)
+        stream.clouds.pop_front(), stream.num_dropped_clouds++;
+    stream.clouds.push_back(convert_ros_cloud(*ros_cloud));
     return;
 }
-void pubPclCloudToTopic(ros::Publisher &pub, PointCloud<PointXYZRGB>::Ptr pcl_cloud)
+bool srvCallbackNextBestView(scan3d_by_baxter::NextBestView::Request &req, scan3d_by_baxter::NextBestView::Response &res)
+{
+    // Wait until all views of this scan are processed
+    int num_processing = 0;
+    for (const Stream &stream : streams)
+        num_processing += stream.num_processing;
+    res.ready = get_num_poses_done() - nbv_first_view_of_scan >= req.num_views_sent && num_processing == 0;
+    res.best_index = -1;
+    res.stop = false;
+    res.known_ratio = nbv_planner->getKnownRatio();
+    if (!res.ready)
+        return true;
+
+    vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> candidates;
+    for (size_t k = 0; k + 16 <= req.candidate_poses.size(); k += 16)
+    {
+        vector<vector<float>> T(4, vector<float>(4, 0));
+        for (int cnt = 0, i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                T[i][j] = req.candidate_poses[k + cnt++];
+        candidates.push_back(get_T_chess_to_depthcam(T));
+    }
+    vector<int> gains = nbv_planner->computeGains(candidates, nbv_intrinsics, nbv_pixel_step);
+    res.gains = gains;
+    if (!gains.empty())
+        res.best_index = max_element(gains.begin(), gains.end()) - gains.begin();
+    res.stop = gains.empty() || gains[res.best_index] < nbv_min_gain;
+    printf("Node 2: next best view: %d candidates, best %d with %d unknown voxels, %.1f%% of the box known%s\n",
+           (int)gains.size(), res.best_index, gains.empty() ? 0 : gains[res.best_index],
+           100 * res.known_ratio, res.stop ? ". Stop the scan" : "");
+
+    if (res.stop) // ready for the next scan
+    {
+        nbv_scan_stopped = true;
+        nbv_first_view_of_scan = get_num_poses_done();
+        nbv_planner->clear();
+    }
+    return true;
+}
+void reconfigureCallback(scan3d_by_baxter::Node2Config &config, uint32_t level)
+{
+    // Called by spinOnce on the main thread. Only keep the latest config: the frames in processing use the params.
+    if (config.min_cluster_size > config.max_cluster_size)
+        config.min_cluster_size = config.max_cluster_size; // shown back in the reconfigure GUI
+    pending_config = config;
+    has_pending_config = true;
+}
+void pubPclCloudToTopic(ros::Publisher &pub, PointCloud<PointXYZRGB>::Ptr pcl_cloud, const ros::Time &stamp)
 {
     sensor_msgs::PointCloud2 ros_cloud_to_pub;
     pcl::toROSMsg(*pcl_cloud, ros_cloud_to_pub);
     ros_cloud_to_pub.header.frame_id = "base";
+    ros_cloud_to_pub.header.stamp = stamp;
     pub.publish(ros_cloud_to_pub);
 }
+void pubPclCloudToTopic(ros::Publisher &pub, PointCloud<PointXYZRGBNormal>::Ptr pcl_cloud, const ros::Time &stamp)
+{
+    sensor_msgs::PointCloud2 ros_cloud_to_pub;
+    pcl::toROSMsg(*pcl_cloud, ros_cloud_to_pub);
+    ros_cloud_to_pub.header.frame_id = "base";
+    ros_cloud_to_pub.header.stamp = stamp;
+    pub.publish(ros_cloud_to_pub);
+}
+void pubPclCloudToShm(my_pcl::CloudShmRingWriter &shm, const string &shm_name, ros::Publisher &pub,
+                      PointCloud<PointXYZRGB>::Ptr pcl_cloud, const ros::Time &stamp, const string &stream_name,
+                      uint64_t trace_id, const string &file_name)
+{
+    my_pcl::CloudShmSlotDesc desc;
+    if (!shm.write(*pcl_cloud, desc))
+        return;
+    scan3d_by_baxter::CloudSlot msg;
+    msg.header.stamp = stamp;
+    msg.header.frame_id = "base";
+    msg.shm_name = shm_name;
+    msg.slot = desc.slot;
+    msg.seq = desc.seq;
+    msg.width = desc.width;
+    msg.height = desc.height;
+    msg.stream = stream_name;
+    msg.trace_id = trace_id;
+    msg.file_name = file_name;
+    pub.publish(msg);
+}
 
 void initAllROSParams()
 {
@@ -346,12 +1344,23 @@ void initAllROSParams()
         NH_GET_PARAM("topic_n2_to_n3", topic_n2_to_n3)
         NH_GET_PARAM("topic_name_rgbd_cloud", topic_name_rgbd_cloud)
         NH_GET_PARAM("topic_n2_to_rviz", topic_n2_to_rviz)
+        NH_GET_PARAM("topic_n2_to_n3_shm", topic_n2_to_n3_shm)
+        NH_GET_PARAM("topic_n2_to_n3_normals", topic_n2_to_n3_normals)
+        NH_GET_PARAM("topic_n2_to_rviz_shm", topic_n2_to_rviz_shm)
+        NH_GET_PARAM("topic_n2_to_rviz_refined", topic_n2_to_rviz_refined)
+        NH_GET_PARAM("num_goalposes", num_goalposes)
+        NH_GET_PARAM("flag_continuous_scan", flag_continuous_scan)
+        NH_GET_PARAM("flag_use_nbv", flag_use_nbv)
+        NH_GET_PARAM("nbv_service_name", nbv_service_name)
+        NH_GET_PARAM("flag_trace", flag_trace)
 
         // File names for saving point cloud
         NH_GET_PARAM("file_folder", file_folder)
         NH_GET_PARAM("file_name_cloud_src", file_name_cloud_src)
         NH_GET_PARAM("file_name_cloud_segmented", file_name_cloud_segmented)
         NH_GET_PARAM("file_name_index_width", file_name_index_width)
+        NH_GET_PARAM("file_name_archive", file_name_archive)
+        NH_GET_PARAM("file_name_cloud_refined", file_name_cloud_refined)
 
         // Filename for reading chessboard's pose
         NH_GET_PARAM("file_folder_config", file_folder_config)
@@ -372,28 +1381,151 @@ void initAllROSParams()
     {
         ros::NodeHandle nh("~");
 
+        // -- Output files
+        NH_GET_PARAM("flag_write_pcd_files", flag_write_pcd_files)
+        NH_GET_PARAM("flag_write_archive", flag_write_archive)
+        NH_GET_PARAM("archive_max_frames", archive_max_frames)
+
+        // -- Shared memory transport
+        NH_GET_PARAM("flag_use_shm_transport", flag_use_shm_transport)
+        NH_GET_PARAM("shm_name_cloud_rotated", shm_name_cloud_rotated)
+        NH_GET_PARAM("shm_name_cloud_segmented", shm_name_cloud_segmented)
+        NH_GET_PARAM("shm_num_slots", shm_num_slots)
+        NH_GET_PARAM("shm_slot_capacity", shm_slot_capacity)
+
         // -- filtByPassThrough
         NH_GET_PARAM("flag_do_range_filt", flag_do_range_filt)
-        NH_GET_PARAM("x_range_radius", x_range_radius)
-        NH_GET_PARAM("y_range_radius", y_range_radius)
-        NH_GET_PARAM("z_range_low", z_range_low)
-        NH_GET_PARAM("z_range_up", z_range_up)
+        NH_GET_PARAM("flag_use_compact_cloud", flag_use_compact_cloud)
+        NH_GET_PARAM("compact_cloud_resolution", compact_cloud_resolution)
+        NH_GET_PARAM("flag_adaptive_roi", flag_adaptive_roi)
+        NH_GET_PARAM("roi_margin", roi_margin)
+        NH_GET_PARAM("roi_min_views", roi_min_views)
+        NH_GET_PARAM("roi_outlier_ratio", roi_outlier_ratio)
 
         // -- filtByVoxelGrid
         NH_GET_PARAM("x_grid_size", x_grid_size)
         NH_GET_PARAM("y_grid_size", y_grid_size)
         NH_GET_PARAM("z_grid_size", z_grid_size)
+        NH_GET_PARAM("voxel_point_budget", voxel_point_budget)
+        NH_GET_PARAM("frame_time_budget", frame_time_budget)
+        NH_GET_PARAM("voxel_min_grid_size", voxel_min_grid_size)
+        NH_GET_PARAM("voxel_max_grid_size", voxel_max_grid_size)
+        NH_GET_PARAM("voxel_search_seconds", voxel_search_seconds)
 
         // -- Segment plane
         NH_GET_PARAM("plane_distance_threshold", plane_distance_threshold)
         NH_GET_PARAM("plane_distance_threshold_0", plane_distance_threshold_0)
         NH_GET_PARAM("plane_max_iterations", plane_max_iterations)
         NH_GET_PARAM("num_planes", num_planes)
+        NH_GET_PARAM("flag_detect_table_by_histogram", flag_detect_table_by_histogram)
 
         // -- Clustering
         NH_GET_PARAM("flag_do_clustering", flag_do_clustering)
         NH_GET_PARAM("cluster_tolerance", cluster_tolerance)
         NH_GET_PARAM("min_cluster_size", min_cluster_size)
         NH_GET_PARAM("max_cluster_size", max_cluster_size)
+        NH_GET_PARAM("flag_multi_object", flag_multi_object)
+        NH_GET_PARAM("object_max_centroid_distance", object_max_centroid_distance)
+        NH_GET_PARAM("object_min_box_overlap", object_min_box_overlap)
+        NH_GET_PARAM("max_objects", max_objects)
+        NH_GET_PARAM("object_icp_threads", object_icp_threads)
+
+        // -- Shared spatial index
+        NH_GET_PARAM("flag_use_spatial_index", flag_use_spatial_index)
+        NH_GET_PARAM("spatial_index_voxel_size", spatial_index_voxel_size)
+
+        // -- Normals
+        NH_GET_PARAM("flag_compute_normals", flag_compute_normals)
+        NH_GET_PARAM("normals_k_search", normals_k_search)
+
+        // -- Multi-view refinement
+        NH_GET_PARAM("flag_do_multiview_refine", flag_do_multiview_refine)
+        NH_GET_PARAM("refine_voxel_size", refine_voxel_size)
+        NH_GET_PARAM("refine_max_correspondence_distance", refine_max_correspondence_distance)
+        NH_GET_PARAM("refine_max_iterations", refine_max_iterations)
+        NH_GET_PARAM("refine_max_neighbors", refine_max_neighbors)
+        NH_GET_PARAM("refine_merge_voxel_size", refine_merge_voxel_size)
+        NH_GET_PARAM("flag_do_carving", flag_do_carving)
+        NH_GET_PARAM("carving_pixel_angle", carving_pixel_angle)
+        NH_GET_PARAM("carving_margin", carving_margin)
+        NH_GET_PARAM("carving_min_votes", carving_min_votes)
+
+        // -- Pose and cloud pairing
+        NH_GET_PARAM("sync_tolerance", sync_tolerance)
+        NH_GET_PARAM("sync_max_poses", sync_max_poses)
+        NH_GET_PARAM("sync_max_clouds", sync_max_clouds)
+        NH_GET_PARAM("sync_drop_policy", sync_drop_policy)
+        NH_GET_PARAM("ingest_voxel_size", ingest_voxel_size)
+        assert(sync_drop_policy == "drop_oldest" || sync_drop_policy == "drop_newest");
+
+        // -- Continuous scan
+        NH_GET_PARAM("pose_buffer_seconds", pose_buffer_seconds)
+        NH_GET_PARAM("pose_max_gap", pose_max_gap)
+        NH_GET_PARAM("max_frames_in_flight", max_frames_in_flight)
+        NH_GET_PARAM("sweep_end_seconds", sweep_end_seconds)
+        if (!flag_continuous_scan)
+            max_frames_in_flight = 1; // keep the order of the views
+        assert(max_frames_in_flight >= 1);
+
+        // -- Keyframe selection
+        NH_GET_PARAM("flag_select_keyframes", flag_select_keyframes)
+        NH_GET_PARAM("keyframe_voxel_size", keyframe_voxel_size)
+        NH_GET_PARAM("keyframe_min_new_voxels", keyframe_min_new_voxels)
+        NH_GET_PARAM("keyframe_sample_stride", keyframe_sample_stride)
+
+        // -- Memory profiling
+        NH_GET_PARAM("flag_profile_memory", flag_profile_memory)
+        // -- Next best view
+        NH_GET_PARAM("nbv_voxel_size", nbv_voxel_size)
+        NH_GET_PARAM("nbv_sample_stride", nbv_sample_stride)
+        NH_GET_PARAM("nbv_pixel_step", nbv_pixel_step)
+        NH_GET_PARAM("nbv_min_gain", nbv_min_gain)
+        double nbv_fx, nbv_fy, nbv_max_depth;
+        NH_GET_PARAM("nbv_image_width", nbv_intrinsics.width)
+        NH_GET_PARAM("nbv_image_height", nbv_intrinsics.height)
+        NH_GET_PARAM("nbv_fx", nbv_fx)
+        NH_GET_PARAM("nbv_fy", nbv_fy)
+        NH_GET_PARAM("nbv_max_depth", nbv_max_depth)
+        nbv_intrinsics.fx = nbv_fx, nbv_intrinsics.fy = nbv_fy, nbv_intrinsics.max_depth = nbv_max_depth;
+        nbv_intrinsics.cx = nbv_intrinsics.width / 2.0, nbv_intrinsics.cy = nbv_intrinsics.height / 2.0;
+
+        // -- Streams
+        NH_GET_PARAM("num_streams", num_streams)
+        assert(num_streams >= 1);
+        streams.resize(num_streams);
+        for (Stream &stream : streams)
+        {
+            stream.sync = my_basics::StampSync<vector<vector<float>>, sensor_msgs::PointCloud2::ConstPtr>(
+                sync_tolerance, sync_max_poses, sync_max_clouds,
+                sync_drop_policy == "drop_oldest" ? my_basics::DROP_OLDEST : my_basics::DROP_NEWEST);
+            stream.pose_buffer = my_basics::PoseInterpolator(pose_buffer_seconds, pose_max_gap);
+        }
+    }
+
+    // ---------------------------- Streams ----------------------------
+    {
+        // Stream 0: the global topics, and the crop box of ~
+        ros::NodeHandle nh("~");
+        Stream &stream = streams[0];
+        NH_GET_PARAM("stream0/name", stream.name)
+        stream.topic_name_rgbd_cloud = topic_name_rgbd_cloud;
+        stream.topic_n1_to_n2 = topic_n1_to_n2;
+        NH_GET_PARAM("x_range_radius", stream.x_range_radius)
+        NH_GET_PARAM("y_range_radius", stream.y_range_radius)
+        NH_GET_PARAM("z_range_low", stream.z_range_low)
+        NH_GET_PARAM("z_range_up", stream.z_range_up)
+    }
+    for (int k = 1; k < num_streams; k++)
+    {
+        // Others: all set in ~stream<k>/
+        ros::NodeHandle nh("~stream" + to_string(k));
+        Stream &stream = streams[k];
+        NH_GET_PARAM("name", stream.name)
+        NH_GET_PARAM("topic_name_rgbd_cloud", stream.topic_name_rgbd_cloud)
+        NH_GET_PARAM("topic_n1_to_n2", stream.topic_n1_to_n2)
+        NH_GET_PARAM("x_range_radius", stream.x_range_radius)
+        NH_GET_PARAM("y_range_radius", stream.y_range_radius)
+        NH_GET_PARAM("z_range_low", stream.z_range_low)
+        NH_GET_PARAM("z_range_up", stream.z_range_up)
     }
 }
@@ -11,6 +11,7 @@ PYTHON_FILE_PATH = os.path.join(os.path.dirname(__file__))+"/"
 # Include ROS
 import rospy
 from sensor_msgs.msg import PointCloud2
+from scan3d_by_baxter.msg import CloudSlot
 
 # Include my lib
 sys.path.append(PYTHON_FILE_PATH + "../src_python")
@@ -18,6 +19,8 @@ from lib_cloud_conversion_between_Open3D_and_ROS import convertCloudFromOpen3dTo
 from lib_cloud_registration import CloudRegister, resizeCloudXYZ, mergeClouds, createXYZAxis, getCloudSize, filtCloudByRange
 
 from lib_geo_trans import rotx, roty, rotz
+from lib_trace import TraceRecorder, getStampMicroseconds
+from lib_shm_cloud import ShmCloudReader
 
 VIEW_RES_BY_OPEN3D=True # This is difficult to set orientation. And has some bug.
 VIEW_RES_BY_RVIZ=~VIEW_RES_BY_OPEN3D
@@ -73,12 +76,48 @@ def chooseViewer():
 
 # ---------------------------- One subscriber ----------------------------
 class SubscriberOfCloud(object):
-    def __init__(self):
-        topic_n2_to_n3 = rospy.get_param("topic_n2_to_n3")
-        rospy.Subscriber(topic_n2_to_n3, PointCloud2, self.sub_callback)
+    def __init__(self, use_shm_transport):
+        if use_shm_transport: # CloudSlot descriptors. The points are read from node2's shared memory.
+            topic_n2_to_n3_shm = rospy.get_param("topic_n2_to_n3_shm")
+            rospy.Subscriber(topic_n2_to_n3_shm, CloudSlot, self.sub_callback_shm)
+        else:
+            topic_n2_to_n3 = rospy.get_param("topic_n2_to_n3")
+            rospy.Subscriber(topic_n2_to_n3, PointCloud2, self.sub_callback)
+        self.shm_readers = {} # by shm name, opened at the first cloud, and reopened if node2 recreates it
         self.cloud_buff = deque()
 
+    def sub_callback_shm(self, slot_msg):
+        stamp_us = getStampMicroseconds(slot_msg.header.stamp)
+        with tracer.scope("receive_cloud", trace_id=slot_msg.trace_id, stamp_us=stamp_us):
+            open3d_cloud = self.readShm(slot_msg, reopen=False)
+            if open3d_cloud is None: # node2 may have restarted and created a new ring: map it again
+                open3d_cloud = self.readShm(slot_msg, reopen=True)
+            if open3d_cloud is None and slot_msg.file_name: # node2 has reused the slot: read the file it also wrote
+                print "  The shared memory slot is overwritten. Read the cloud from " + slot_msg.file_name
+                open3d_cloud = open3d.read_point_cloud(slot_msg.file_name)
+            elif open3d_cloud is None:
+                print "  The shared memory slot is overwritten, and node2 wrote no file. Skip the cloud."
+                open3d_cloud = open3d.PointCloud()
+        self.cloud_buff.append((open3d_cloud, stamp_us))
+
+    def readShm(self, slot_msg, reopen):
+        ''' Return None if the cloud can't be read from node2's shared memory '''
+        if reopen or slot_msg.shm_name not in self.shm_readers:
+            try:
+                self.shm_readers[slot_msg.shm_name] = ShmCloudReader(slot_msg.shm_name)
+            except Exception: # no such ring (yet), or not a compatible one
+                self.shm_readers.pop(slot_msg.shm_name, None)
+                return None
+        return self.shm_readers[slot_msg.shm_name].read(slot_msg)
+
     def sub_callback(self, ros_cloud):
+        # node2 copies the stamp of its input cloud: merge_traces.py finds the view by it
+        stamp_us = getStampMicroseconds(ros_cloud.header.stamp)
+        with tracer.scope("receive_cloud", stamp_us=stamp_us):
+            open3d_cloud = self.readCloud(ros_cloud)
+        self.cloud_buff.append((open3d_cloud, stamp_us))
+
+    def readCloud(self, ros_cloud):
         if 1:
             rospy.sleep(2.0)
             filename=file_folder+file_name_cloud_segmented+"{:02d}".format(cnt+1)+".pcd"
@@ -89,12 +128,13 @@ class SubscriberOfCloud(object):
             open3d_cloud = convertCloudFromRosToOpen3d(ros_cloud)
         # open3d.write_point_cloud(file_folder+"n3_subed_cloud_"+str(cnt)+".pcd", open3d_cloud)
         # self.rotateCloudForBetterViewing(open3d_cloud)
-        self.cloud_buff.append(open3d_cloud)
+        return open3d_cloud
     
     def hasNewCloud(self):
         return len(self.cloud_buff)>0
 
     def popCloud(self):
+        ''' Return the cloud and its stamp in microseconds '''
         return self.cloud_buff.popleft()
 
     # def rotateCloudForBetterViewing(self, cloud):
@@ -105,14 +145,17 @@ class SubscriberOfCloud(object):
 if __name__ == "__main__":
     rospy.init_node("node3")
     num_goalposes = rospy.get_param("num_goalposes")
+    # node2 publishes the views of all its streams (cameras) on the same topic
+    num_views = num_goalposes * rospy.get_param("/node2/num_streams", 1)
 
     # -- Set output filename
     file_folder = rospy.get_param("file_folder") 
     file_name_cloud_final = rospy.get_param("file_name_cloud_final")
     file_name_cloud_segmented = rospy.get_param("file_name_cloud_segmented")
+    tracer = TraceRecorder("node3", enabled=rospy.get_param("flag_trace"))
 
     # -- Subscribe to cloud + Visualize it
-    cloud_subscriber = SubscriberOfCloud() # set subscriber
+    cloud_subscriber = SubscriberOfCloud(rospy.get_param("~flag_use_shm_transport")) # set subscriber
     viewer = chooseViewer() # set viewer
 
     # -- Parameters
@@ -130,7 +173,7 @@ if __name__ == "__main__":
 
 
     while not rospy.is_shutdown():
-        if cnt<num_goalposes and cloud_subscriber.hasNewCloud():
+        if cnt<num_views and cloud_subscriber.hasNewCloud():
             
             cnt += 1
             rospy.loginfo("=========================================")
@@ -138,24 +181,26 @@ if __name__ == "__main__":
 
 
             # Register Point Cloud
-            new_cloud = cloud_subscriber.popCloud()
+            new_cloud, stamp_us = cloud_subscriber.popCloud()
             if getCloudSize(new_cloud)==0:
                 print "  The received cloud is empty. Not processing it."
                 continue
             
             # Filter
-            cl,ind = open3d.statistical_outlier_removal(new_cloud, # Statistical oulier removal
-                nb_neighbors=20, std_ratio=2.0)
-            new_cloud = open3d.select_down_sample(new_cloud, ind)
+            with tracer.scope("filter", stamp_us=stamp_us):
+                cl,ind = open3d.statistical_outlier_removal(new_cloud, # Statistical oulier removal
+                    nb_neighbors=20, std_ratio=2.0)
+                new_cloud = open3d.select_down_sample(new_cloud, ind)
             
             # Regi
-            res_cloud = cloud_register.addCloud(new_cloud)
+            with tracer.scope("addCloud", stamp_us=stamp_us):
+                res_cloud = cloud_register.addCloud(new_cloud)
             print "Size of the registered cloud: ", getCloudSize(res_cloud)
             
             # Update and save to file
             viewer.updateCloud(res_cloud)
             
-            if cnt==num_goalposes:
+            if cnt==num_views:
                 rospy.loginfo("=========== Cloud Registration Completes ===========")
                 rospy.loginfo("====================================================")
                 rospy.sleep(1.0)
@@ -169,6 +214,8 @@ if __name__ == "__main__":
             
             # Save resultant point cloud
             open3d.write_point_cloud(file_folder+file_name_cloud_final, res_cloud)
+            if tracer.enabled:
+                tracer.write(file_folder + "trace_node3.json")
 
         # Update viewer
         viewer.updateView()
@@ -0,0 +1,381 @@
+/*
+Virtual depth camera: a replacement of node1 + the Baxter + the RealSense, for benchmarks and regression tests.
+
+A scene is built in the chessboard frame (table, chessboard, and a box + a sphere, or a PLY mesh),
+and placed in the Baxter frame by T_baxter_to_chess. Camera poses are read from a camera_pose.txt
+(the format written by node1), or placed on a ring around the chessboard looking at it.
+For each pose, the T4x4 pose message is published to node2, followed by the ray-casted cloud.
+
+With flag_continuous_scan, the camera sweeps through the poses without stopping (one loop in sweep_seconds):
+clouds are rendered at publish_rate, and poses of the path are published at continuous_pose_rate,
+up to one pose after the stamp of each cloud, so that node2 can interpolate it.
+
+With flag_use_nbv, the poses are visited in the order chosen by node2's next-best-view service,
+and a loop ends when node2 says the coverage has converged.
+
+With flag_trace, each pose carries the trace ID (loop, view), and the rendering of each view is written to
+file_folder + "trace_camera.json" (see my_basics/trace.h).
+
+The ground truth of the object (surface samples in the chessboard frame, the frame of node2's
+segmented cloud) is saved to file_folder + "ground_truth_object.pcd".
+*/
+
+#include <iostream>
+#include <string>
+#include <fstream>
+
+#include <ros/ros.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "my_pcl/pcl_virtual_camera.h"
+#include "my_pcl/pcl_io.h"
+#include "my_basics/pose_interpolator.h"
+#include "my_basics/trace.h"
+#include "scan3d_by_baxter/T4x4.h" // my message
+#include "scan3d_by_baxter/NextBestView.h" // my service
+
+using namespace std;
+using namespace pcl;
+
+// ------------------------------------- ROS Params -------------------------------------
+
+// Global
+string topic_n1_to_n2, topic_name_rgbd_cloud;
+string file_folder, file_folder_config, file_name_T_baxter_to_chess;
+int num_goalposes;
+bool flag_continuous_scan;
+double continuous_pose_rate;
+bool flag_use_nbv;
+string nbv_service_name;
+bool flag_trace;
+
+// Camera
+my_pcl::CameraIntrinsics intrinsics;
+my_pcl::DepthNoise noise;
+string cloud_frame_id;
+int num_threads;
+
+// Poses
+string file_camera_pose; // "" to use a ring of poses
+double ring_radius, ring_height;
+double publish_rate;
+int num_loops; // how many times the poses are replayed. -1 for forever
+double sweep_seconds; // continuous scan: time of one loop
+
+// Scene
+string file_object_mesh; // "" to use the default box and sphere
+int chessboard_rows, chessboard_cols;
+double chessboard_square_size;
+
+#define NH_GET_PARAM(param_name, returned_val)                              \
+    if (!nh.getParam(param_name, returned_val))                             \
+    {                                                                       \
+        cout << "Error in reading ROS param named: " << param_name << endl; \
+        assert(0);                                                          \
+    }
+
+void initAllROSParams();
+
+// ------------------------------------- Functions -------------------------------------
+
+Eigen::Matrix4f readMatrix4f(const string &filename)
+{
+    ifstream fin(filename);
+    assert(fin.is_open()); // Fail to find the config file
+    Eigen::Matrix4f T;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            fin >> T(i, j);
+    return T;
+}
+
+// camera_pose.txt: for each pose, a blank line, the index, and 4 rows of T_baxter_to_depthcam
+vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> readCameraPoses(const string &filename)
+{
+    vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> poses;
+    ifstream fin(filename);
+    assert(fin.is_open());
+    string index;
+    while (fin >> index)
+    {
+        Eigen::Matrix4f T;
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                fin >> T(i, j);
+        if (!fin)
+            break;
+        poses.push_back(T);
+    }
+    return poses;
+}
+
+// Continuous scan: pose at time t of the path through all poses (a closed loop of sweep_seconds)
+Eigen::Matrix4f getPoseOfSweep(const vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses,
+                               double t)
+{
+    double u = fmod(t / sweep_seconds, 1.0) * poses.size();
+    int k = min((int)u, (int)poses.size() - 1);
+    return my_basics::interpolatePose(poses[k], poses[(k + 1) % poses.size()], u - k);
+}
+
+void pubPose(ros::Publisher &pub, const Eigen::Matrix4f &T, const ros::Time &stamp, uint64_t trace_id)
+{
+    scan3d_by_baxter::T4x4 pose_msg;
+    pose_msg.header.stamp = stamp;
+    pose_msg.trace_id = trace_id;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            pose_msg.TransformationMatrix.push_back(T(i, j));
+    pub.publish(pose_msg);
+}
+
+// Ask node2 which of the poses not visited yet is the next. Return -1 to stop the loop.
+int askNextBestView(ros::ServiceClient &client,
+                    const vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> &poses,
+                    const vector<bool> &visited, int num_views_sent)
+{
+    scan3d_by_baxter::NextBestView srv;
+    srv.request.num_views_sent = num_views_sent;
+    vector<int> candidates;
+    for (size_t k = 0; k < poses.size(); k++)
+        if (!visited[k])
+        {
+            candidates.push_back(k);
+            for (int i = 0; i < 4; i++)
+                for (int j = 0; j < 4; j++)
+                    srv.request.candidate_poses.push_back(poses[k](i, j));
+        }
+    if (candidates.empty())
+        return -1;
+    while (ros::ok())
+    {
+        if (!client.call(srv))
+        {
+            cout << "my WARNING: fail to call the next best view service. Take the next pose." << endl;
+            return candidates[0];
+        }
+        if (srv.response.ready)
+            break;
+        ros::Duration(0.05).sleep(); // node2 is still processing the views
+    }
+    if (srv.response.stop || srv.response.best_index < 0)
+        return -1;
+    return candidates[srv.response.best_index];
+}
+
+// Objects are inside the chessboard's crop box used by node2
+vector<int> buildScene(my_pcl::VirtualScene &scene, const Eigen::Matrix4f &T_baxter_to_chess)
+{
+    Eigen::Matrix4f T = T_baxter_to_chess, T_local;
+
+    T_local.setIdentity();
+    T_local(2, 3) = -0.001; // just under the chessboard
+    scene.addRectangle(T * T_local, 1.2, 1.0, 150, 120, 90);
+    scene.addChessboard(T, chessboard_rows, chessboard_cols, chessboard_square_size);
+
+    vector<int> object_ids;
+    if (!file_object_mesh.empty())
+    {
+        int id = scene.addMeshFromPLY(T, file_object_mesh, 200, 160, 40);
+        assert(id >= 0);
+        object_ids.push_back(id);
+    }
+    else
+    {
+        T_local.setIdentity();
+        T_local.block<3, 3>(0, 0) = Eigen::AngleAxisf(0.4, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+        T_local(2, 3) = 0.06;
+        object_ids.push_back(scene.addBox(T * T_local, 0.08, 0.06, 0.12, 200, 40, 40));
+        Eigen::Vector3f sphere_center(0.07, 0.05, 0.035);
+        object_ids.push_back(scene.addSphere(
+            T.block<3, 3>(0, 0) * sphere_center + T.block<3, 1>(0, 3), 0.035, 40, 60, 200));
+    }
+    scene.build();
+    return object_ids;
+}
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "virtual_depth_camera");
+    ros::NodeHandle nh;
+    initAllROSParams();
+
+    ros::Publisher pub_pose = nh.advertise<scan3d_by_baxter::T4x4>(topic_n1_to_n2, 10);
+    ros::Publisher pub_cloud = nh.advertise<sensor_msgs::PointCloud2>(topic_name_rgbd_cloud, 10);
+
+    // -- Scene
+    Eigen::Matrix4f T_baxter_to_chess = readMatrix4f(file_folder_config + file_name_T_baxter_to_chess);
+    my_pcl::VirtualScene scene;
+    vector<int> object_ids = buildScene(scene, T_baxter_to_chess);
+
+    // -- Ground truth of the object, in the chessboard frame
+    PointCloud<PointXYZRGB>::Ptr ground_truth = scene.sampleSurface(0.001, object_ids);
+    Eigen::Matrix4f T_chess_to_baxter = T_baxter_to_chess.inverse();
+    for (PointXYZRGB &p : ground_truth->points)
+        p.getVector3fMap() = T_chess_to_baxter.block<3, 3>(0, 0) * p.getVector3fMap() + T_chess_to_baxter.block<3, 1>(0, 3);
+    my_pcl::write_point_cloud(file_folder + "ground_truth_object.pcd", ground_truth);
+
+    // -- Poses of the camera in the Baxter frame
+    vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> poses;
+    if (!file_camera_pose.empty())
+        poses = readCameraPoses(file_camera_pose);
+    else
+        for (int k = 0; k < num_goalposes; k++)
+        {
+            double angle = 2 * M_PI * k / num_goalposes;
+            Eigen::Vector3f position(ring_radius * cos(angle), ring_radius * sin(angle), ring_height);
+            Eigen::Matrix4f T_chess_to_cam = my_pcl::VirtualDepthCamera::lookAt(position, Eigen::Vector3f(0, 0, 0.05));
+            poses.push_back(T_baxter_to_chess * T_chess_to_cam);
+        }
+    assert(!poses.empty());
+
+    // -- Wait for node2, then publish pose + cloud of each view
+    while (ros::ok() && (pub_pose.getNumSubscribers() == 0 || pub_cloud.getNumSubscribers() == 0))
+        ros::Duration(0.1).sleep();
+
+    my_pcl::VirtualDepthCamera camera(intrinsics, noise);
+    my_basics::TraceRecorder tracer("camera", flag_trace);
+    ros::Rate rate(publish_rate);
+    if (flag_continuous_scan)
+    {
+        ros::Time t0 = ros::Time::now();
+        int cnt_poses = 0;
+        for (int frame_idx = 0; ros::ok(); frame_idx++)
+        {
+            ros::Time stamp = ros::Time::now();
+            double t = (stamp - t0).toSec();
+            if (num_loops >= 0 && t >= num_loops * sweep_seconds)
+                break;
+            double t1 = my_basics::TraceRecorder::now();
+            PointCloud<PointXYZRGB>::Ptr cloud = camera.render(scene, getPoseOfSweep(poses, t), frame_idx, num_threads);
+            double t_render = my_basics::TraceRecorder::now() - t1;
+            // node2 numbers the views of a sweep. The loop is the scan.
+            uint64_t trace_id = my_basics::makeTraceId(t / sweep_seconds + 1, 0);
+            tracer.record("render", t1, t1 + t_render, trace_id, stamp.toNSec() / 1000);
+
+            // The poses up to the first one after the cloud
+            while (cnt_poses == 0 || (cnt_poses - 1) / continuous_pose_rate <= t)
+            {
+                double t_pose = cnt_poses++ / continuous_pose_rate;
+                pubPose(pub_pose, getPoseOfSweep(poses, t_pose), t0 + ros::Duration(t_pose), trace_id);
+            }
+
+            sensor_msgs::PointCloud2 ros_cloud;
+            pcl::toROSMsg(*cloud, ros_cloud);
+            ros_cloud.header.frame_id = cloud_frame_id;
+            ros_cloud.header.stamp = stamp;
+            pub_cloud.publish(ros_cloud);
+            printf("Virtual camera: published %dth frame of the sweep at %.2f s, rendered in %.3f seconds\n",
+                   frame_idx + 1, t, t_render);
+            ros::spinOnce();
+            rate.sleep();
+        }
+        if (flag_trace)
+            tracer.write(file_folder + "trace_camera.json");
+        ROS_INFO("Virtual camera stops");
+        return 0;
+    }
+    ros::ServiceClient client_nbv;
+    if (flag_use_nbv)
+    {
+        client_nbv = nh.serviceClient<scan3d_by_baxter::NextBestView>(nbv_service_name);
+        client_nbv.waitForExistence();
+    }
+    for (int loop = 0, frame_idx = 0; ros::ok() && (num_loops < 0 || loop < num_loops); loop++)
+    {
+        vector<bool> visited(poses.size(), false);
+        for (int k = 0, num_sent = 0; k >= 0 && ros::ok(); frame_idx++)
+        {
+            double t0 = my_basics::TraceRecorder::now();
+            PointCloud<PointXYZRGB>::Ptr cloud = camera.render(scene, poses[k], frame_idx, num_threads);
+            double t_render = my_basics::TraceRecorder::now() - t0;
+
+            sensor_msgs::PointCloud2 ros_cloud;
+            pcl::toROSMsg(*cloud, ros_cloud);
+            ros_cloud.header.frame_id = cloud_frame_id;
+            ros_cloud.header.stamp = ros::Time::now();
+
+            uint64_t trace_id = my_basics::makeTraceId(loop + 1, num_sent + 1);
+            tracer.record("render", t0, t0 + t_render, trace_id, ros_cloud.header.stamp.toNSec() / 1000);
+            pubPose(pub_pose, poses[k], ros_cloud.header.stamp, trace_id); // node2 pairs them by stamp
+            pub_cloud.publish(ros_cloud);
+            printf("Virtual camera: published %dth view (pose %d), rendered in %.3f seconds\n",
+                   frame_idx + 1, k + 1, t_render);
+            ros::spinOnce();
+            rate.sleep();
+
+            // -- Next pose
+            visited[k] = true, num_sent++;
+            if (flag_use_nbv)
+                k = askNextBestView(client_nbv, poses, visited, num_sent);
+            else
+                k = k + 1 < (int)poses.size() ? k + 1 : -1;
+        }
+    }
+
+    if (flag_trace)
+        tracer.write(file_folder + "trace_camera.json");
+    ROS_INFO("Virtual camera stops");
+    return 0;
+}
+
+void initAllROSParams()
+{
+    {
+        ros::NodeHandle nh;
+        NH_GET_PARAM("topic_n1_to_n2", topic_n1_to_n2)
+        NH_GET_PARAM("topic_name_rgbd_cloud", topic_name_rgbd_cloud)
+        NH_GET_PARAM("file_folder", file_folder)
+        NH_GET_PARAM("file_folder_config", file_folder_config)
+        NH_GET_PARAM("file_name_T_baxter_to_chess", file_name_T_baxter_to_chess)
+        NH_GET_PARAM("num_goalposes", num_goalposes)
+        NH_GET_PARAM("flag_continuous_scan", flag_continuous_scan)
+        NH_GET_PARAM("continuous_pose_rate", continuous_pose_rate)
+        NH_GET_PARAM("flag_use_nbv", flag_use_nbv)
+        NH_GET_PARAM("nbv_service_name", nbv_service_name)
+        NH_GET_PARAM("flag_trace", flag_trace)
+    }
+    {
+        ros::NodeHandle nh("~");
+
+        // -- Camera
+        double fx, fy, cx, cy, min_depth, max_depth;
+        NH_GET_PARAM("width", intrinsics.width)
+        NH_GET_PARAM("height", intrinsics.height)
+        NH_GET_PARAM("fx", fx)
+        NH_GET_PARAM("fy", fy)
+        NH_GET_PARAM("cx", cx)
+        NH_GET_PARAM("cy", cy)
+        NH_GET_PARAM("min_depth", min_depth)
+        NH_GET_PARAM("max_depth", max_depth)
+        intrinsics.fx = fx, intrinsics.fy = fy, intrinsics.cx = cx, intrinsics.cy = cy;
+        intrinsics.min_depth = min_depth, intrinsics.max_depth = max_depth;
+
+        double sigma_const, sigma_quadratic, dropout_ratio;
+        int seed;
+        NH_GET_PARAM("noise_sigma_const", sigma_const)
+        NH_GET_PARAM("noise_sigma_quadratic", sigma_quadratic)
+        NH_GET_PARAM("noise_dropout_ratio", dropout_ratio)
+        NH_GET_PARAM("noise_seed", seed)
+        noise.sigma_const = sigma_const, noise.sigma_quadratic = sigma_quadratic;
+        noise.dropout_ratio = dropout_ratio, noise.seed = seed;
+
+        NH_GET_PARAM("cloud_frame_id", cloud_frame_id)
+        NH_GET_PARAM("num_threads", num_threads)
+
+        // -- Poses
+        NH_GET_PARAM("file_camera_pose", file_camera_pose)
+        NH_GET_PARAM("ring_radius", ring_radius)
+        NH_GET_PARAM("ring_height", ring_height)
+        NH_GET_PARAM("publish_rate", publish_rate)
+        NH_GET_PARAM("num_loops", num_loops)
+        NH_GET_PARAM("sweep_seconds", sweep_seconds)
+
+        // -- Scene
+        NH_GET_PARAM("file_object_mesh", file_object_mesh)
+        NH_GET_PARAM("chessboard_rows", chessboard_rows)
+        NH_GET_PARAM("chessboard_cols", chessboard_cols)
+        NH_GET_PARAM("chessboard_square_size", chessboard_square_size)
+    }
+}
@@ -75,6 +75,10 @@ class MyBaxter(object):
         # print "quaternion:", q_A_to_B
         return T_A_to_B
 
+    def getFramePoseStamped(self, frame_name): # return 4x4 transformation matrix, and its time stamp in tf
+        stamp = self.tf_listener.getLatestCommonTime('/base', frame_name)
+        return self.getFramePose(frame_name), stamp
+
     def getCameraPose(self): # return 4x4 transformation matrix
         return self.getFramePose('/'+self.limb_name+'_hand_camera')
 
@@ -113,6 +117,15 @@ class MyBaxter(object):
             
             return
 
+    def sweepThroughJointAngles(self, list_goal_angles, time_cost_each=3.0):
+        # One trajectory through all goals, without stopping at each of them
+        self.traj.clear()
+        self.traj.add_point(self.getJointAngles(), 0.0)
+        for i, goal_angles in enumerate(list_goal_angles):
+            self.traj.add_point(goal_angles, time_cost_each*(i+1))
+        self.traj.start()
+        self.traj.wait(time_cost_each*len(list_goal_angles) + 5.0)
+
     def computeIK(self, pos, orientation=None):
         print("Computing IK:\n")
         print(pos)
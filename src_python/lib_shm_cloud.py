@@ -0,0 +1,59 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+'''
+Read a cloud from the shared-memory ring written by node2 (my_pcl::CloudShmRingWriter),
+given a scan3d_by_baxter/CloudSlot message received from the descriptor topic.
+
+The layout must match include/my_pcl/pcl_shm_ring.h:
+    [ring header, 64 bytes] + num_slots * [slot header, 64 bytes][points, 32 bytes each]
+'''
+
+import open3d
+import numpy as np
+import mmap, struct
+
+SHM_RING_MAGIC = 0x53434e52
+SHM_RING_VERSION = 1
+HEADER_SIZE = 64
+SLOT_HEADER_SIZE = 64
+POINT_SIZE = 32 # sizeof(pcl::PointXYZRGB)
+
+class ShmCloudReader(object):
+    def __init__(self, shm_name):
+        # shm_open("/name") is backed by the file /dev/shm/name on Linux
+        f = open("/dev/shm/" + shm_name.lstrip("/"), "rb")
+        self.buf = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        f.close()
+        magic, version, self.num_slots, self.slot_capacity, point_size, self.slot_stride = \
+            struct.unpack_from("<IIIIQQ", self.buf, 0)
+        if magic != SHM_RING_MAGIC or version != SHM_RING_VERSION or point_size != POINT_SIZE:
+            raise RuntimeError("Shared memory " + shm_name + " is not a compatible cloud ring")
+
+    def _getSlotSeq(self, slot):
+        return struct.unpack_from("<Q", self.buf, HEADER_SIZE + slot * self.slot_stride)[0]
+
+    def read(self, slot_msg):
+        ''' Copy the cloud out as an open3d cloud. Return None if the slot was overwritten,
+            or if the descriptor doesn't fit this ring (e.g. node2 has recreated it with other sizes). '''
+        num_points = slot_msg.width * slot_msg.height
+        if slot_msg.slot >= self.num_slots or num_points > self.slot_capacity:
+            return None
+        if self._getSlotSeq(slot_msg.slot) != slot_msg.seq:
+            return None
+        offset = HEADER_SIZE + slot_msg.slot * self.slot_stride + SLOT_HEADER_SIZE
+        raw = np.frombuffer(self.buf, dtype=np.float32,
+                            count=num_points * POINT_SIZE // 4, offset=offset)
+        raw = raw.reshape(num_points, POINT_SIZE // 4).copy()
+        if self._getSlotSeq(slot_msg.slot) != slot_msg.seq: # overwritten while copying
+            return None
+
+        xyz = raw[:, 0:3]
+        rgb = raw[:, 4].view(np.uint32)
+        colors = np.c_[(rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff] / 255.0
+        valid = np.isfinite(xyz).all(axis=1)
+
+        open3d_cloud = open3d.PointCloud()
+        open3d_cloud.points = open3d.Vector3dVector(xyz[valid].astype(np.float64))
+        open3d_cloud.colors = open3d.Vector3dVector(colors[valid])
+        return open3d_cloud
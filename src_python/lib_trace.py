@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+'''
+Trace points of the views, for the python nodes.
+The same format as the C++ my_basics::TraceRecorder (include/my_basics/trace.h):
+    a Chrome trace JSON of complete events with args {scan, view, stamp_us}.
+Merge the files of all nodes by src_python/merge_traces.py.
+'''
+
+import os, time, json, threading
+
+def makeTraceId(scan, view):
+    ''' scan and view start from 1. 0 means unknown. '''
+    return (int(scan) << 32) | int(view)
+
+def getTraceScan(trace_id):
+    return int(trace_id) >> 32
+
+def getTraceView(trace_id):
+    return int(trace_id) & 0xffffffff
+
+def getStampMicroseconds(stamp):
+    ''' The stamp of a cloud in microseconds, as pcl and node2 round it. '''
+    return stamp.to_nsec() // 1000
+
+class TraceRecorder(object):
+    def __init__(self, process_name, enabled=True, max_events=1000000):
+        self.process_name = process_name
+        self.enabled = enabled
+        self.max_events = max_events
+        self.events = []
+        self.tids = {}
+        self.lock = threading.Lock()
+
+    def record(self, name, t_begin, t_end, trace_id=0, stamp_us=0):
+        ''' A span of the current thread. Times are time.time() '''
+        if not self.enabled:
+            return
+        with self.lock:
+            if len(self.events) >= self.max_events:
+                return
+            tid = self.tids.setdefault(threading.current_thread().ident, len(self.tids))
+            self.events.append((name, t_begin, t_end, trace_id, stamp_us, tid))
+
+    def scope(self, name, trace_id=0, stamp_us=0):
+        ''' Record a span of a "with" block '''
+        return _TraceScope(self, name, trace_id, stamp_us)
+
+    def write(self, filename):
+        pid = os.getpid()
+        with self.lock:
+            events = [{"ph": "M", "name": "process_name", "pid": pid, "args": {"name": self.process_name}}]
+            for name, t_begin, t_end, trace_id, stamp_us, tid in self.events:
+                events.append({"ph": "X", "cat": "view", "name": name, "pid": pid, "tid": tid,
+                               "ts": t_begin * 1e6, "dur": (t_end - t_begin) * 1e6,
+                               "args": {"scan": getTraceScan(trace_id), "view": getTraceView(trace_id),
+                                        "stamp_us": stamp_us}})
+        with open(filename, "w") as f:
+            json.dump({"traceEvents": events}, f)
+
+class _TraceScope(object):
+    def __init__(self, recorder, name, trace_id, stamp_us):
+        self.recorder, self.name, self.trace_id, self.stamp_us = recorder, name, trace_id, stamp_us
+
+    def __enter__(self):
+        self.t_begin = time.time()
+        return self
+
+    def __exit__(self, *args):
+        self.recorder.record(self.name, self.t_begin, time.time(), self.trace_id, self.stamp_us)
+        return False
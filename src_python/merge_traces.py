@@ -0,0 +1,101 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+'''
+Merge the trace files of the nodes (trace_<node>.json, see include/my_basics/trace.h and lib_trace.py)
+into one Chrome trace, and print the critical path of each view.
+
+Events that only know the stamp of their cloud (e.g. node3, which receives a PointCloud2) get the
+trace ID (scan, view) of the node2 events of the same stamp. The events of a view are then chained
+by flow arrows in time order, so chrome://tracing (or ui.perfetto.dev) shows its path across the nodes.
+
+Example of usage:
+$ python src_python/merge_traces.py data/data/
+$ python src_python/merge_traces.py data/data/trace_node1.json data/data/trace_node2.json merged.json
+'''
+
+import sys, os, glob, json
+from collections import defaultdict
+
+def loadEvents(filenames):
+    events, process_names = [], {}
+    for filename in filenames:
+        with open(filename) as f:
+            for e in json.load(f)["traceEvents"]:
+                if e["ph"] == "M" and e["name"] == "process_name":
+                    process_names[e["pid"]] = e["args"]["name"]
+                events.append(e)
+    return events, process_names
+
+def assignTraceIdsByStamp(spans):
+    ''' Give the (scan, view) of a stamp to the events of the same stamp without one '''
+    view_of_stamp = {}
+    for e in spans:
+        a = e["args"]
+        if a["view"] > 0 and a["stamp_us"] > 0:
+            view_of_stamp[a["stamp_us"]] = (a["scan"], a["view"])
+    for e in spans:
+        a = e["args"]
+        if a["view"] == 0 and a["stamp_us"] in view_of_stamp:
+            a["scan"], a["view"] = view_of_stamp[a["stamp_us"]]
+
+def addFlows(views):
+    ''' Flow events linking the spans of each view in time order '''
+    flows = []
+    for (scan, view), spans in views.items():
+        for k, e in enumerate(spans):
+            ph = "s" if k == 0 else ("f" if k == len(spans) - 1 else "t")
+            flow = {"ph": ph, "cat": "view", "name": "view", "id": "{}.{}".format(scan, view),
+                    "pid": e["pid"], "tid": e["tid"], "ts": e["ts"]}
+            if ph != "s":
+                flow["bp"] = "e" # bind to the enclosing span
+            flows.append(flow)
+    return flows
+
+def printCriticalPaths(views, process_names):
+    ''' For each view: the spans in time order, and the wait before each of them '''
+    stage_time, stage_wait, stage_cnt = defaultdict(float), defaultdict(float), defaultdict(int)
+    for (scan, view) in sorted(views.keys()):
+        spans = views[(scan, view)]
+        t0 = spans[0]["ts"]
+        t_end = max(e["ts"] + e["dur"] for e in spans)
+        print("\nScan {} view {}: {:.1f} ms in total".format(scan, view, (t_end - t0) / 1e3))
+        reached = t0 # the end of the spans so far
+        for e in spans:
+            stage = process_names.get(e["pid"], str(e["pid"])) + "/" + e["name"]
+            wait = max(0.0, e["ts"] - reached)
+            reached = max(reached, e["ts"] + e["dur"])
+            print("    {:<32s} wait {:9.1f} ms, run {:9.1f} ms".format(stage, wait / 1e3, e["dur"] / 1e3))
+            stage_time[stage] += e["dur"]
+            stage_wait[stage] += wait
+            stage_cnt[stage] += 1
+    print("\nMean over the views:")
+    for stage in sorted(stage_cnt.keys(), key=lambda s: -stage_time[s] - stage_wait[s]):
+        n = stage_cnt[stage]
+        print("    {:<32s} wait {:9.1f} ms, run {:9.1f} ms ({} views)".format(
+            stage, stage_wait[stage] / n / 1e3, stage_time[stage] / n / 1e3, n))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Please input the folder of the trace files, or the trace files and the output file.")
+        sys.exit()
+    if os.path.isdir(sys.argv[1]):
+        folder = sys.argv[1]
+        filenames = sorted(f for f in glob.glob(os.path.join(folder, "trace_*.json"))
+                           if not f.endswith("trace_merged.json"))
+        output = os.path.join(folder, "trace_merged.json")
+    else:
+        filenames, output = sys.argv[1:-1], sys.argv[-1]
+
+    events, process_names = loadEvents(filenames)
+    spans = [e for e in events if e["ph"] == "X"]
+    assignTraceIdsByStamp(spans)
+    views = defaultdict(list)
+    for e in sorted(spans, key=lambda e: e["ts"]):
+        if e["args"]["view"] > 0:
+            views[(e["args"]["scan"], e["args"]["view"])].append(e)
+
+    with open(output, "w") as f:
+        json.dump({"traceEvents": events + addFlows(views)}, f)
+    printCriticalPaths(views, process_names)
+    print("\nMerged {} files into {}".format(len(filenames), output))
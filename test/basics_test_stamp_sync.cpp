@@ -0,0 +1,57 @@
+/*
+Test of my_basics::StampSync (pairing of poses and clouds by stamp) with both queue policies.
+
+A stop-and-shoot sequence: the camera keeps publishing clouds while the arm moves and no pose is queued,
+then the next pose comes. The stale clouds must not block the queue: the pose must be matched
+with the first cloud after it.
+
+Example of usage:
+$ bin/basics_test_stamp_sync
+The exit code is 0 if all pass.
+*/
+
+#include <iostream>
+#include <stdio.h>
+#include <string>
+#include "my_basics/stamp_sync.h"
+
+using namespace std;
+using namespace my_basics;
+
+bool testStopAndShoot(QueueFullPolicy policy)
+{
+    const double tolerance = 0.05;
+    StampSync<int, int> sync(tolerance, 10, 3, policy);
+    int pose, cloud;
+    double stamp_pose, stamp_cloud;
+    bool ok = true;
+
+    // -- The first view
+    sync.pushFirst(0.0, 1);
+    sync.pushSecond(0.01, 101);
+    sync.pushSecond(0.1, 102); // the next cloud decides the match
+    ok &= sync.pop(pose, cloud, stamp_pose, stamp_cloud) && pose == 1 && cloud == 101;
+
+    // -- The arm moves: clouds without any pose, more than the queue holds
+    for (int i = 1; i <= 4; i++)
+        sync.pushSecond(i, 200 + i);
+    ok &= !sync.pop(pose, cloud, stamp_pose, stamp_cloud);
+
+    // -- The second view
+    sync.pushFirst(5.0, 2);
+    ok &= sync.getNumSeconds() == 0; // all older than 5.0 - tolerance
+    sync.pushSecond(5.01, 301);
+    sync.pushSecond(5.1, 302);
+    ok &= sync.pop(pose, cloud, stamp_pose, stamp_cloud) && pose == 2 && cloud == 301;
+
+    printf("%-12s %s (dropped %d poses, %d clouds)\n", policy == DROP_OLDEST ? "drop_oldest" : "drop_newest",
+           ok ? "OK" : "FAILED", sync.getNumDroppedFirst(), sync.getNumDroppedSecond());
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool ok = testStopAndShoot(DROP_OLDEST);
+    ok &= testStopAndShoot(DROP_NEWEST);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+Test functions in "my_pcl/pcl_archive.h":
+    pack a recorded scan (camera_pose.txt, src_xx.pcd, segmented_xx.pcd) into one archive,
+    then read it back through mmap and compare with the pcd files.
+
+Example of usage:
+$ bin/pcl_test_archive data/data/ 9
+
+This also converts old datasets: the result is written to data/data/scan_session.scan
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include "my_basics/basics.h"
+#include "my_pcl/pcl_io.h"
+#include "my_pcl/pcl_archive.h"
+
+using namespace pcl;
+using namespace my_pcl;
+typedef pcl::PointXYZRGB PointT;
+typedef pcl::PointCloud<PointT> PointCloudT;
+
+// Read the poses written by n1_move_baxter.py: a "xxth pose:" line followed by 4 rows.
+vector<vector<vector<float>>> readCameraPoses(const string &filename)
+{
+    vector<vector<vector<float>>> poses;
+    ifstream fin(filename);
+    assert(fin.is_open());
+    string line;
+    while (getline(fin, line))
+    {
+        if (line.find("pose") == string::npos)
+            continue;
+        vector<vector<float>> T(4, vector<float>(4, 0));
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                fin >> T[i][j];
+        poses.push_back(T);
+    }
+    return poses;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc - 1 != 2)
+    {
+        cout << "my ERROR: please input the data folder and the number of views." << endl;
+        assert(0);
+    }
+    string folder = argv[1];
+    int num_views = atoi(argv[2]);
+    string archive_name = folder + "scan_session.scan";
+    vector<vector<vector<float>>> poses = readCameraPoses(folder + "camera_pose.txt");
+    assert((int)poses.size() >= num_views);
+
+    // -- Read pcd files, and write them into the archive
+    vector<PointCloudT::Ptr> clouds_src, clouds_segmented;
+    {
+        ScanArchiveWriter writer(archive_name, num_views);
+        for (int i = 1; i <= num_views; i++)
+        {
+            string suffix = my_basics::int2str(i, 2) + ".pcd";
+            clouds_src.push_back(read_point_cloud(folder + "src_" + suffix));
+            clouds_segmented.push_back(read_point_cloud(folder + "segmented_" + suffix));
+            bool res = writer.appendFrame(poses[i - 1], clouds_src.back(), clouds_segmented.back());
+            assert(res);
+        }
+    }
+
+    // -- Read back and compare
+    auto t0 = std::chrono::steady_clock::now();
+    ScanArchiveReader reader(archive_name);
+    assert(reader.isOpen() && reader.getNumFrames() == num_views);
+    double sum = 0; // touch every point, so that the timing includes page faults
+    for (int i = 0; i < num_views; i++)
+    {
+        const ScanArchiveFrame &frame = reader.getFrame(i);
+        const PointT *src = reader.getCloudSrcPoints(i);
+        for (uint32_t k = 0; k < frame.src_width * frame.src_height; k++)
+            sum += src[k].z;
+    }
+    double t_read = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    for (int i = 0; i < num_views; i++)
+    {
+        vector<vector<float>> T;
+        PointCloudT::Ptr cloud_src, cloud_segmented;
+        reader.readFrame(i, T, cloud_src, cloud_segmented);
+        assert(cloud_src->points.size() == clouds_src[i]->points.size());
+        assert(cloud_segmented->points.size() == clouds_segmented[i]->points.size());
+        for (size_t k = 0; k < cloud_src->points.size(); k++)
+            assert(memcmp(&cloud_src->points[k], &clouds_src[i]->points[k], 3 * sizeof(float)) == 0);
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                assert(T[r][c] == poses[i][r][c]);
+        printf("Frame %d: %d src points, %d segmented points. OK.\n",
+               i + 1, (int)cloud_src->points.size(), (int)cloud_segmented->points.size());
+    }
+    printf("\nWrote %s. Mapped and scanned all %d frames in %.3f ms (checksum %.1f).\n",
+           archive_name.c_str(), num_views, t_read * 1000, sum);
+    return (0);
+}
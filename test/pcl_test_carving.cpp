@@ -0,0 +1,123 @@
+/*
+Test of my_pcl::FreeSpaceCarving on a synthetic scan, with the pose errors that the multi-view refinement corrects.
+
+A box on a table is seen by 8 virtual depth cameras around it. The arm pose of each view is off
+by a few millimeters and a degree, so the views are misplaced; the refinement's corrections move them back.
+The refined cloud (the true surface) plus random floating points around the box is carved
+by the corrected poses: most floating points must be removed, and almost all surface points kept.
+The carving by the arm poses is printed for comparison.
+
+Example of usage:
+$ bin/pcl_test_carving
+The exit code is 0 if all pass.
+*/
+
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include "my_pcl/pcl_carving.h"
+#include "my_pcl/pcl_virtual_camera.h"
+
+using namespace std;
+using namespace my_pcl;
+
+const uint32_t COLOR_FLOATING = 0x00ff00; // no surface of the scene has this color
+
+// Points of cloud, and of the floating ones, that are kept
+void countKept(const PointCloud<PointXYZRGB> &cloud, int &num_surface, int &num_floating)
+{
+    num_surface = num_floating = 0;
+    for (const PointXYZRGB &p : cloud.points)
+        if ((p.rgba & 0x00ffffff) == COLOR_FLOATING)
+            num_floating++;
+        else
+            num_surface++;
+}
+
+int main(int argc, char **argv)
+{
+    // -- Scene: a box on the table, around the origin
+    VirtualScene scene;
+    Eigen::Matrix4f T_box = Eigen::Matrix4f::Identity();
+    T_box(2, 3) = 0.06;
+    scene.addBox(T_box, 0.08, 0.06, 0.12, 200, 40, 40);
+    scene.addRectangle(Eigen::Matrix4f::Identity(), 1.2, 1.0, 150, 120, 90);
+    scene.build();
+    DepthNoise noise;
+    noise.sigma_const = 0.0005, noise.sigma_quadratic = 0.002;
+    VirtualDepthCamera camera(CameraIntrinsics(), noise);
+
+    // -- Views: the raw cloud by the arm pose goes to the carving, the true one to the refined cloud
+    const int num_views = 8;
+    FreeSpaceCarving carving(0.003, 0.01, 1);
+    FreeSpaceCarving::Corrections corrections(num_views);
+    PointCloud<PointXYZRGB> cloud_refined;
+    for (int k = 0; k < num_views; k++)
+    {
+        double a = 2 * M_PI * k / num_views;
+        Eigen::Matrix4f T_cam = VirtualDepthCamera::lookAt(Eigen::Vector3f(0.45 * cos(a), 0.45 * sin(a), 0.45),
+                                                           Eigen::Vector3f(0, 0, 0.05));
+        PointCloud<PointXYZRGB>::Ptr cloud = camera.render(scene, T_cam, k, 0);
+
+        // The error of the arm pose, and its correction X, such that T_cam = X * T_arm
+        Eigen::Affine3f X(Eigen::AngleAxisf((k % 2 ? 1 : -1) * M_PI / 180, Eigen::Vector3f(sin(a), -cos(a), 0)));
+        X.translation() = Eigen::Vector3f(0.005 * cos(3 * a), 0.005 * sin(3 * a), 0.003);
+        corrections[k] = X.matrix();
+        Eigen::Matrix4f T_arm = corrections[k].inverse() * T_cam;
+
+        // The table and the surroundings of the box, like node2's raw cloud in the chessboard frame
+        PointCloud<PointXYZRGB> cloud_arm, cloud_true;
+        for (const PointXYZRGB &p : cloud->points)
+        {
+            if (!std::isfinite(p.x))
+                continue;
+            Eigen::Vector3f q(p.x, p.y, p.z), q_true = T_cam.block<3, 3>(0, 0) * q + T_cam.block<3, 1>(0, 3);
+            if (fabs(q_true.x()) > 0.12 || fabs(q_true.y()) > 0.12 || q_true.z() < -0.01)
+                continue;
+            Eigen::Vector3f q_arm = T_arm.block<3, 3>(0, 0) * q + T_arm.block<3, 1>(0, 3);
+            PointXYZRGB r = p;
+            r.x = q_arm.x(), r.y = q_arm.y(), r.z = q_arm.z();
+            cloud_arm.points.push_back(r);
+            r.x = q_true.x(), r.y = q_true.y(), r.z = q_true.z();
+            cloud_true.points.push_back(r);
+        }
+        carving.addView(cloud_arm, T_arm);
+        cloud_refined += cloud_true;
+    }
+    const int num_surface = cloud_refined.points.size();
+
+    // -- Floating points around the box, outside of it
+    srand(1);
+    int num_floating = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        PointXYZRGB p;
+        p.x = (rand() / (float)RAND_MAX - 0.5) * 0.24;
+        p.y = (rand() / (float)RAND_MAX - 0.5) * 0.24;
+        p.z = 0.01 + rand() / (float)RAND_MAX * 0.2;
+        if (fabs(p.x) < 0.05 && fabs(p.y) < 0.04 && p.z < 0.13)
+            continue;
+        p.rgba = 0xff000000 | COLOR_FLOATING;
+        cloud_refined.points.push_back(p);
+        num_floating++;
+    }
+    cloud_refined.width = cloud_refined.points.size(), cloud_refined.height = 1;
+
+    // -- Carve
+    int kept_surface, kept_floating, kept_surface_arm, kept_floating_arm;
+    countKept(*carving.carve(cloud_refined, corrections), kept_surface, kept_floating);
+    countKept(*carving.carve(cloud_refined), kept_surface_arm, kept_floating_arm);
+    double ratio_surface = (double)kept_surface / num_surface;
+    double ratio_removed = 1 - (double)kept_floating / num_floating;
+    printf("By the corrected poses: kept %d of %d surface points (%.2f%%), removed %d of %d floating points (%.1f%%)\n",
+           kept_surface, num_surface, 100 * ratio_surface, num_floating - kept_floating, num_floating,
+           100 * ratio_removed);
+    printf("By the arm poses:       kept %d of %d surface points (%.2f%%), removed %d of %d floating points (%.1f%%)\n",
+           kept_surface_arm, num_surface, 100.0 * kept_surface_arm / num_surface, num_floating - kept_floating_arm,
+           num_floating, 100.0 * (num_floating - kept_floating_arm) / num_floating);
+
+    bool ok = ratio_surface >= 0.999 && ratio_removed >= 0.85;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*
+Test of the kernels of my_pcl::CompactCloud against PCL, and of node2's compact path (see pcl_segment_view.h).
+
+The scene is three cubes of points on a 1 mm lattice (16^3, 12^3 and 8^3 points), 10 cm apart, on a table.
+The lattice is shifted by 0.25 mm from the 4 mm voxels, so no point is on a voxel boundary, and the result is known:
+    voxel grid of 4 mm:  4^3 + 3^3 + 2^3 voxels, each the centroid of 4^3 points.
+    clustering:          3 clusters of the sizes of the cubes, largest first.
+Both are checked on CompactCloud, on PCL (filtByVoxelGrid, divideIntoClusters), and through
+filtViewByVoxelGrid and segmentView with and without flag_use_compact_cloud.
+
+Example of usage:
+$ bin/pcl_test_compact
+The exit code is 0 if all pass.
+*/
+
+#include <iostream>
+#include <stdio.h>
+#include <cmath>
+#include "my_pcl/pcl_compact.h"
+#include "my_pcl/pcl_filters.h"
+#include "my_pcl/pcl_advanced.h"
+#include "my_pcl/pcl_segment_view.h"
+
+using namespace std;
+using namespace my_pcl;
+
+const float SPACING = 0.001, SHIFT = 0.00025, GRID_SIZE = 0.004;
+const int CUBE_SIZES[3] = {16, 12, 8}; // points per side
+const float CUBE_Z = 0.048;            // above the table, on a voxel boundary
+
+bool check(bool ok, const char *name)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+    return ok;
+}
+
+// Sizes of the clusters, largest first
+vector<int> getClusterSizes(const vector<PointIndices> &clusters)
+{
+    vector<int> sizes;
+    for (const PointIndices &cluster : clusters)
+        sizes.push_back(cluster.indices.size());
+    return sizes;
+}
+
+vector<int> getCloudSizes(const vector<PointCloud<PointXYZRGB>::Ptr> &clouds)
+{
+    vector<int> sizes;
+    for (const PointCloud<PointXYZRGB>::Ptr &cloud : clouds)
+        sizes.push_back(cloud->points.size());
+    return sizes;
+}
+
+// Whether each point is within tolerance of the centroid of a voxel of the lattice
+bool isAtVoxelCentroids(const PointCloud<PointXYZRGB> &cloud, float tolerance)
+{
+    for (const PointXYZRGB &p : cloud.points)
+    {
+        const float v[3] = {p.x, p.y, p.z};
+        for (int i = 0; i < 3; i++)
+        {
+            // The centroid of 4 lattice points is at 1.5 spacing + SHIFT from the voxel's corner
+            float offset = v[i] - std::floor(v[i] / GRID_SIZE) * GRID_SIZE;
+            if (std::abs(offset - (1.5 * SPACING + SHIFT)) > tolerance)
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    // -- Scene: the cubes, and a table at z=0 for segmentView
+    PointCloud<PointXYZRGB>::Ptr cubes(new PointCloud<PointXYZRGB>), scene(new PointCloud<PointXYZRGB>);
+    int num_voxels = 0;
+    vector<int> sizes_expected;
+    for (int k = 0; k < 3; k++)
+    {
+        const int n = CUBE_SIZES[k];
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                for (int l = 0; l < n; l++)
+                {
+                    PointXYZRGB p;
+                    p.x = k * 0.1 + SHIFT + i * SPACING;
+                    p.y = SHIFT + j * SPACING;
+                    p.z = CUBE_Z + SHIFT + l * SPACING;
+                    p.rgba = 0xff000000 | (80 * k << 16) | 0x4020;
+                    cubes->points.push_back(p);
+                }
+        num_voxels += (n / 4) * (n / 4) * (n / 4);
+        sizes_expected.push_back(n * n * n);
+    }
+    cubes->width = cubes->points.size(), cubes->height = 1;
+    *scene = *cubes;
+    for (float x = -0.1; x < 0.35; x += 0.005)
+        for (float y = -0.1; y < 0.1; y += 0.005)
+        {
+            PointXYZRGB p;
+            p.x = x, p.y = y, p.z = 0;
+            p.rgba = 0xff808080;
+            scene->points.push_back(p);
+        }
+    scene->width = scene->points.size(), scene->height = 1;
+    const float resolution = 0.0001;
+    bool ok = true;
+
+    // -- Voxel grid
+    CompactCloud compact(resolution);
+    compact.fromPCL(*cubes);
+    compact.voxelGrid(GRID_SIZE, GRID_SIZE, GRID_SIZE);
+    PointCloud<PointXYZRGB>::Ptr voxels_compact = compact.toPCL();
+    PointCloud<PointXYZRGB>::Ptr voxels_pcl = filtByVoxelGrid(cubes, GRID_SIZE, GRID_SIZE, GRID_SIZE);
+    printf("Voxel grid: %d expected, CompactCloud %d, PCL %d\n", num_voxels, (int)voxels_compact->points.size(),
+           (int)voxels_pcl->points.size());
+    ok &= check((int)voxels_compact->points.size() == num_voxels && isAtVoxelCentroids(*voxels_compact, 2 * resolution),
+                "CompactCloud::voxelGrid");
+    ok &= check((int)voxels_pcl->points.size() == num_voxels && isAtVoxelCentroids(*voxels_pcl, 2 * resolution),
+                "filtByVoxelGrid");
+
+    // -- Clustering
+    compact.fromPCL(*cubes);
+    vector<int> sizes_compact = getClusterSizes(compact.euclideanClusters(0.02, 100, 10000));
+    vector<int> sizes_pcl = getClusterSizes(divideIntoClusters(cubes, 0.02, 100, 10000));
+    ok &= check(sizes_compact == sizes_expected, "CompactCloud::euclideanClusters");
+    ok &= check(sizes_pcl == sizes_expected, "divideIntoClusters");
+
+    // -- node2's path, with and without the compact cloud
+    ViewSegmentationParams params;
+    params.x_grid_size = params.y_grid_size = params.z_grid_size = GRID_SIZE;
+    params.voxel_point_budget = 0;
+    params.flag_do_clustering = params.flag_multi_object = true;
+    params.min_cluster_size = 100, params.max_cluster_size = 10000;
+    params.flag_use_spatial_index = false;
+    for (int use_compact = 0; use_compact <= 1; use_compact++)
+    {
+        params.flag_use_compact_cloud = use_compact;
+        int point_budget = 0;
+        float grid_size = 0;
+        int num_filtered = filtViewByVoxelGrid(cubes, params, point_budget, grid_size)->points.size();
+        SegmentedView res;
+        segmentView(scene, params, res);
+        vector<int> sizes = getCloudSizes(res.cloud_objects);
+        printf("flag_use_compact_cloud %d: %d voxels, %d table points, %d objects\n", use_compact, num_filtered,
+               res.num_table_points, (int)sizes.size());
+        ok &= check(num_filtered == num_voxels, use_compact ? "filtViewByVoxelGrid, compact" : "filtViewByVoxelGrid");
+        ok &= check(sizes == sizes_expected, use_compact ? "segmentView, compact" : "segmentView");
+    }
+
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
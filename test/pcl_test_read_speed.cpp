@@ -0,0 +1,82 @@
+/*
+Test the fast pcd loader in "my_pcl/pcl_io.h" (readPCDFast) against pcl::io::loadPCDFile.
+The input cloud is saved in both ascii and binary format, then each file is loaded by both loaders.
+Throughput is printed for each format, and the loaded points are compared.
+
+Example of usage:
+$ bin/pcl_test_read_speed data/data/src_01.pcd
+
+*/
+
+#include <iostream>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <pcl/io/pcd_io.h>
+#include "my_pcl/pcl_io.h"
+
+using namespace pcl;
+using namespace my_pcl;
+typedef pcl::PointXYZRGB PointT;
+typedef pcl::PointCloud<PointT> PointCloudT;
+
+double getFileSizeMB(const string &filename)
+{
+    ifstream fin(filename, ios::binary | ios::ate);
+    return fin.tellg() / 1e6;
+}
+
+// Same xyz (or both NaN) and same color.
+bool isSamePoint(const PointT &a, const PointT &b)
+{
+    if (std::isnan(a.x) || std::isnan(b.x))
+        return std::isnan(a.x) && std::isnan(b.x);
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+void compareLoaders(const string &filename, const string &format)
+{
+    PointCloudT cloud_pcl, cloud_fast;
+
+    auto t0 = std::chrono::steady_clock::now();
+    io::loadPCDFile<PointT>(filename, cloud_pcl);
+    auto t1 = std::chrono::steady_clock::now();
+    readPCDFast(filename, cloud_fast);
+    auto t2 = std::chrono::steady_clock::now();
+
+    double mb = getFileSizeMB(filename);
+    double t_pcl = std::chrono::duration<double>(t1 - t0).count();
+    double t_fast = std::chrono::duration<double>(t2 - t1).count();
+    printf("%-6s %7.1f MB | pcl: %8.1f ms, %7.1f MB/s | fast: %8.1f ms, %7.1f MB/s | speedup x%.1f\n",
+           format.c_str(), mb, t_pcl * 1000, mb / t_pcl, t_fast * 1000, mb / t_fast, t_pcl / t_fast);
+
+    assert(cloud_pcl.points.size() == cloud_fast.points.size());
+    int num_diff = 0;
+    for (size_t i = 0; i < cloud_pcl.points.size(); i++)
+        num_diff += !isSamePoint(cloud_pcl.points[i], cloud_fast.points[i]);
+    if (num_diff > 0)
+        cout << "my ERROR: " << num_diff << " points are different between the two loaders." << endl;
+    assert(num_diff == 0);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc - 1 != 1)
+    {
+        cout << "my ERROR: please input an argument of the point cloud file name." << endl;
+        assert(0);
+    }
+    PointCloudT::Ptr cloud(new PointCloudT);
+    io::loadPCDFile<PointT>(argv[1], *cloud);
+
+    string f_ascii = "tmp_read_speed_ascii.pcd", f_binary = "tmp_read_speed_binary.pcd";
+    io::savePCDFileASCII(f_ascii, *cloud);
+    io::savePCDFileBinary(f_binary, *cloud);
+    cout << endl;
+    compareLoaders(f_ascii, "ascii");
+    compareLoaders(f_binary, "binary");
+    remove(f_ascii.c_str());
+    remove(f_binary.c_str());
+    return (0);
+}
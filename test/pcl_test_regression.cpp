@@ -0,0 +1,326 @@
+/*
+Regression test of node2's pipeline on a recorded scan: it must stay as accurate and as fast as a golden run.
+
+The views of a scan archive (written by node2 with flag_write_archive) are processed by the same functions as node2
+(see pcl_segment_view.h): voxel grid, rotate to the chessboard frame and crop, remove the table, clustering,
+then multi-view refinement. The params are node2's, with the values of launch/main_3d_scanner.launch by default.
+An optional params file ("name value" per line, node2's param names) selects other paths, e.g.
+    voxel_point_budget 60000              (budget search)  flag_use_compact_cloud 1     (crop on the int16 cloud)
+    flag_detect_table_by_histogram 1      (z histogram)    flag_use_spatial_index 1     (one index for all stages)
+    flag_do_clustering 1                  (keep the largest cluster)
+The params are recorded with the golden run, and "check" refuses a golden run of other params.
+PCL's RANSAC runs from a fixed seed, and the pose graph sorts its edges. The budget voxel grid searches its
+grid size for a limited time, so its output may vary with the load; use a fixed grid for exact comparisons.
+The pipeline is run twice to check the determinism.
+
+"record" writes the golden outputs to the golden folder:
+    golden_segmented_xx.pcd, golden_refined.pcd, golden_metrics.txt (params, table inliers, corrections, stage timings).
+"check" runs again and compares with them (see pcl_metrics.h):
+    quality: Chamfer / 95th percentile / Hausdorff distance of each segmented view and of the refined cloud,
+             number of table inliers of each view, and the error of the correction of each view.
+    timing:  the fastest of num_repeats runs of each stage, against the golden one of the same machine.
+             When built with -DPROFILE_MEMORY=ON, also the allocated bytes of each stage (see memory_profiler.h).
+The exit code is 0 if all pass, 1 on a quality regression, 2 on a timing (or memory) regression, 3 on both.
+
+Example of usage:
+$ bin/pcl_test_regression data/data/scan_session.scan data/golden/ record
+$ bin/pcl_test_regression data/data/scan_session.scan data/golden/ check
+
+Other paths, each with its own golden folder (see the params files):
+$ bin/pcl_test_regression data/data/scan_session.scan data/golden_objects/ record 3 1.2 config/regression_objects.txt
+$ bin/pcl_test_regression data/data/scan_session.scan data/golden_fast/ record 3 1.2 config/regression_fast.txt
+
+Optional: the 4th argument is the number of repeats (default 3),
+the 5th is the allowed time ratio to the golden run (default 1.2), and the 6th is the params file.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include "my_basics/basics.h"
+#include "my_basics/memory_profiler.h"
+#include "my_pcl/pcl_io.h"
+#include "my_pcl/pcl_segment_view.h"
+#include "my_pcl/pcl_archive.h"
+#include "my_pcl/pcl_registration.h"
+#include "my_pcl/pcl_metrics.h"
+
+using namespace pcl;
+using namespace my_pcl;
+typedef pcl::PointXYZRGB PointT;
+typedef pcl::PointCloud<PointT> PointCloudT;
+
+// -- Params of the pipeline that are not in ViewSegmentationParams, the same as launch/main_3d_scanner.launch
+const CropBox crop_box = {-0.25, 0.25, -0.25, 0.25, -0.05, 0.35}; // x/y_range_radius, z_range_low/up
+const float refine_merge_voxel_size = 0.002;
+
+// -- Tolerances of the check
+const float metric_max_distance = 0.05;                 // distances are clamped to this
+const double tol_chamfer = 0.001, tol_p95 = 0.005, tol_hausdorff = 0.02; // meters
+const double tol_inlier_ratio = 0.05;                   // relative change of the number of table inliers
+const double tol_rot_degrees = 0.2, tol_trans = 0.002;  // error of the corrections
+const double time_slack = 0.002;                        // seconds, so that tiny stages don't fail by noise
+const double memory_ratio = 1.2, memory_slack = 1e6;    // allowed bytes allocated by a stage: golden * ratio + slack
+
+const int NUM_STAGES = 5;
+const char *STAGE_NAMES[NUM_STAGES] = {"voxel_grid", "rotate_and_crop", "segment", "add_views", "refine"};
+
+struct RunResult
+{
+    vector<PointCloudT::Ptr> clouds_segmented;
+    vector<int> plane_inliers;
+    vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> corrections;
+    PointCloudT::Ptr cloud_refined;
+    double seconds[NUM_STAGES];
+    my_basics::MemoryStageStats memory[NUM_STAGES]; // allocations of each stage
+};
+
+// Time a stage, and count its allocations
+class StageTimer
+{
+public:
+    StageTimer(double &seconds, int stage)
+        : seconds_(seconds), memory_stage_(my_basics::getMemoryStage(STAGE_NAMES[stage])),
+          t0_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count(); }
+
+private:
+    double &seconds_;
+    my_basics::MemoryStage memory_stage_;
+    std::chrono::steady_clock::time_point t0_;
+};
+
+RunResult runPipeline(const ScanArchiveReader &reader, const float T_chess_to_baxter[4][4],
+                      const ViewSegmentationParams &params)
+{
+    RunResult res;
+    for (int k = 0; k < NUM_STAGES; k++)
+        res.seconds[k] = 0;
+    my_basics::resetMemoryStats();
+    MultiViewRegistration multiview_register;
+    int point_budget = -1;
+    float voxel_grid_size = -1; // the budget search's state, kept between views like node2
+    for (int i = 0; i < reader.getNumFrames(); i++)
+    {
+        vector<vector<float>> T_baxter_to_depthcam;
+        PointCloudT::Ptr cloud_src, cloud_unused;
+        reader.readFrame(i, T_baxter_to_depthcam, cloud_src, cloud_unused);
+
+        PointCloudT::Ptr cloud;
+        {
+            StageTimer timer(res.seconds[0], 0);
+            cloud = filtViewByVoxelGrid(cloud_src, params, point_budget, voxel_grid_size);
+        }
+        {
+            StageTimer timer(res.seconds[1], 1);
+            for (PointT &p : cloud->points)
+                my_basics::preTranslatePoint(T_baxter_to_depthcam, p.x, p.y, p.z);
+            cloud = cropViewInChessFrame(*cloud, T_chess_to_baxter, crop_box, params);
+        }
+        {
+            StageTimer timer(res.seconds[2], 2);
+            SegmentedView view;
+            segmentView(cloud, params, view);
+            res.plane_inliers.push_back(view.num_table_points);
+            cloud = view.cloud_segmented;
+        }
+        res.clouds_segmented.push_back(cloud);
+        {
+            StageTimer timer(res.seconds[3], 3);
+            float cam_x = T_baxter_to_depthcam[0][3], cam_y = T_baxter_to_depthcam[1][3],
+                  cam_z = T_baxter_to_depthcam[2][3];
+            my_basics::preTranslatePoint(T_chess_to_baxter, cam_x, cam_y, cam_z);
+            multiview_register.addView(cloud, Eigen::Vector3f(cam_x, cam_y, cam_z));
+        }
+    }
+    {
+        StageTimer timer(res.seconds[4], 4); // includes waiting for the ICP jobs queued by addView
+        multiview_register.refine();
+        res.cloud_refined = multiview_register.getMergedCloud(refine_merge_voxel_size);
+    }
+    for (int i = 0; i < multiview_register.getNumViews(); i++)
+        res.corrections.push_back(multiview_register.getCorrection(i));
+    for (int k = 0; k < NUM_STAGES; k++)
+        res.memory[k] = my_basics::getMemoryStageStats(my_basics::getMemoryStage(STAGE_NAMES[k]));
+    return res;
+}
+
+// -- golden_metrics.txt: one "name values..." per line
+void writeMetrics(const string &filename, const RunResult &res, const ViewSegmentationParams &params)
+{
+    ofstream fout(filename);
+    assert(fout.is_open());
+    fout.precision(9);
+    for (const pair<string, double> &param : getViewSegmentationParams(params))
+        fout << "param_" << param.first << " " << param.second << endl;
+    fout << "num_frames " << res.clouds_segmented.size() << endl;
+    for (size_t i = 0; i < res.plane_inliers.size(); i++)
+        fout << "plane_inliers_" << i << " " << res.plane_inliers[i] << endl;
+    for (size_t i = 0; i < res.corrections.size(); i++)
+    {
+        fout << "correction_" << i;
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                fout << " " << res.corrections[i](r, c);
+        fout << endl;
+    }
+    for (int k = 0; k < NUM_STAGES; k++)
+        fout << "seconds_" << STAGE_NAMES[k] << " " << res.seconds[k] << endl;
+    if (my_basics::isMemoryProfilingEnabled())
+        for (int k = 0; k < NUM_STAGES; k++)
+            fout << "memory_" << STAGE_NAMES[k] << " " << res.memory[k].num_allocs << " " << res.memory[k].bytes
+                 << endl;
+}
+
+map<string, vector<double>> readMetrics(const string &filename)
+{
+    map<string, vector<double>> metrics;
+    ifstream fin(filename);
+    assert(fin.is_open()); // no golden run. Run with "record" first.
+    string line;
+    while (getline(fin, line))
+    {
+        istringstream iss(line);
+        string name;
+        double val;
+        if (!(iss >> name))
+            continue;
+        while (iss >> val)
+            metrics[name].push_back(val);
+    }
+    return metrics;
+}
+
+bool checkCloud(const string &name, const PointCloudT &cloud, const PointCloudT &golden)
+{
+    CloudDistance d = compareClouds(cloud, golden, metric_max_distance);
+    bool ok = d.chamfer <= tol_chamfer && d.p95 <= tol_p95 && d.hausdorff <= tol_hausdorff;
+    printf("%-22s %7d vs %7d points, chamfer %.5f, p95 %.5f, hausdorff %.5f m  %s\n", name.c_str(),
+           d.size_a, d.size_b, d.chamfer, d.p95, d.hausdorff, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc - 1 < 3 || (string(argv[3]) != "record" && string(argv[3]) != "check"))
+    {
+        cout << "my ERROR: please input the scan archive, the golden folder, and \"record\" or \"check\"." << endl;
+        assert(0);
+    }
+    const string archive_name = argv[1], golden_folder = argv[2];
+    const bool is_record = string(argv[3]) == "record";
+    const int num_repeats = argc - 1 >= 4 ? atoi(argv[4]) : 3;
+    const double max_time_ratio = argc - 1 >= 5 ? atof(argv[5]) : 1.2;
+    assert(num_repeats >= 2);
+    ViewSegmentationParams params;
+    if (argc - 1 >= 6 && !readViewSegmentationParams(argv[6], params))
+        return 1;
+
+    ScanArchiveReader reader(archive_name);
+    assert(reader.isOpen() && reader.getNumFrames() > 0);
+    float T_baxter_to_chess[4][4], T_chess_to_baxter[4][4];
+    {
+        ifstream fin("config/T_baxter_to_chess.txt"); // run from the package folder
+        assert(fin.is_open());
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                fin >> T_baxter_to_chess[i][j];
+        my_basics::inv(T_baxter_to_chess, T_chess_to_baxter);
+    }
+
+    // -- Run num_repeats times. Keep the outputs of the first run, and the fastest time of each stage.
+    RunResult res = runPipeline(reader, T_chess_to_baxter, params);
+    for (int r = 1; r < num_repeats; r++)
+    {
+        RunResult again = runPipeline(reader, T_chess_to_baxter, params);
+        for (int k = 0; k < NUM_STAGES; k++)
+            res.seconds[k] = min(res.seconds[k], again.seconds[k]);
+        if (r > 1)
+            continue;
+        // Determinism
+        CloudDistance d = compareClouds(*res.cloud_refined, *again.cloud_refined, metric_max_distance);
+        if (again.plane_inliers != res.plane_inliers || d.hausdorff > 1e-6)
+            cout << "my WARNING: two runs gave different outputs. The golden comparison will be noisy." << endl;
+    }
+
+    if (is_record)
+    {
+        for (size_t i = 0; i < res.clouds_segmented.size(); i++)
+            write_point_cloud(golden_folder + "golden_segmented_" + my_basics::int2str(i + 1, 2) + ".pcd",
+                              res.clouds_segmented[i]);
+        write_point_cloud(golden_folder + "golden_refined.pcd", res.cloud_refined);
+        writeMetrics(golden_folder + "golden_metrics.txt", res, params);
+        printf("Recorded the golden run of %d frames into %s\n", (int)res.clouds_segmented.size(),
+               golden_folder.c_str());
+        return (0);
+    }
+
+    // -- Quality
+    map<string, vector<double>> golden = readMetrics(golden_folder + "golden_metrics.txt");
+    assert((int)golden["num_frames"][0] == (int)res.clouds_segmented.size());
+    for (const pair<string, double> &param : getViewSegmentationParams(params))
+    {
+        const vector<double> &v = golden["param_" + param.first];
+        if (v.empty() || std::abs(v[0] - param.second) > 1e-6 * max(1.0, std::abs(param.second)))
+        {
+            cout << "my ERROR: the golden run has other params (" << param.first << "). Record it again." << endl;
+            return 1;
+        }
+    }
+    bool quality_ok = true;
+    for (size_t i = 0; i < res.clouds_segmented.size(); i++)
+    {
+        string idx = my_basics::int2str(i + 1, 2);
+        PointCloudT::Ptr cloud_golden = read_point_cloud(golden_folder + "golden_segmented_" + idx + ".pcd");
+        quality_ok &= checkCloud("segmented_" + idx, *res.clouds_segmented[i], *cloud_golden);
+
+        int inliers_golden = golden["plane_inliers_" + to_string(i)][0];
+        bool inliers_ok = std::abs(res.plane_inliers[i] - inliers_golden) <= tol_inlier_ratio * inliers_golden;
+        printf("%-22s %7d vs %7d  %s\n", ("plane_inliers_" + idx).c_str(), res.plane_inliers[i], inliers_golden,
+               inliers_ok ? "OK" : "FAILED");
+        quality_ok &= inliers_ok;
+
+        const vector<double> &v = golden["correction_" + to_string(i)];
+        assert(v.size() == 16);
+        Eigen::Matrix4f T_golden;
+        for (int k = 0; k < 16; k++)
+            T_golden(k / 4, k % 4) = v[k];
+        double rot_degrees, trans;
+        computePoseError(T_golden, res.corrections[i], rot_degrees, trans);
+        bool pose_ok = rot_degrees <= tol_rot_degrees && trans <= tol_trans;
+        printf("%-22s %.4f degrees, %.5f m  %s\n", ("correction_" + idx).c_str(), rot_degrees, trans,
+               pose_ok ? "OK" : "FAILED");
+        quality_ok &= pose_ok;
+    }
+    PointCloudT::Ptr refined_golden = read_point_cloud(golden_folder + "golden_refined.pcd");
+    quality_ok &= checkCloud("refined", *res.cloud_refined, *refined_golden);
+
+    // -- Timing
+    bool timing_ok = true;
+    for (int k = 0; k < NUM_STAGES; k++)
+    {
+        double t_golden = golden[string("seconds_") + STAGE_NAMES[k]][0];
+        bool ok = res.seconds[k] <= t_golden * max_time_ratio + time_slack;
+        printf("%-22s %8.2f vs %8.2f ms  %s\n", STAGE_NAMES[k], res.seconds[k] * 1000, t_golden * 1000,
+               ok ? "OK" : "FAILED");
+        timing_ok &= ok;
+    }
+    if (my_basics::isMemoryProfilingEnabled() && golden.count(string("memory_") + STAGE_NAMES[0]))
+        for (int k = 0; k < NUM_STAGES; k++)
+        {
+            const vector<double> &v = golden[string("memory_") + STAGE_NAMES[k]];
+            bool ok = res.memory[k].bytes <= v[1] * memory_ratio + memory_slack;
+            printf("%-22s %8llu allocs, %8.2f MB vs %8.0f allocs, %8.2f MB  %s\n", STAGE_NAMES[k],
+                   (unsigned long long)res.memory[k].num_allocs, res.memory[k].bytes / 1e6, v[0], v[1] / 1e6,
+                   ok ? "OK" : "FAILED");
+            timing_ok &= ok;
+        }
+
+    printf("\nQuality: %s. Timing: %s.\n", quality_ok ? "OK" : "REGRESSION", timing_ok ? "OK" : "REGRESSION");
+    return (quality_ok ? 0 : 1) + (timing_ok ? 0 : 2);
+}
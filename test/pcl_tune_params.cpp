@@ -0,0 +1,240 @@
+/*
+Offline auto-tuner of node2's filter and segmentation params on a recorded scan:
+find the fastest params whose segmented views stay within a tolerance of a reference.
+
+The views of a scan archive (written by node2 with flag_write_archive) are segmented by node2's functions
+(see pcl_segment_view.h): voxel grid, rotate to the chessboard frame, crop, remove the table (histogram or RANSAC).
+The params that are not tuned have the launch file's values.
+The reference is the output of the params of launch/main_3d_scanner.launch,
+or the golden_segmented_xx.pcd of pcl_test_regression if a golden folder is given.
+
+Search: coordinate descent. Each param in turn is set to the fastest of its candidates that pass,
+with the others fixed, until a round changes nothing. A setting passes if the mean Chamfer distance
+of the views to the reference is <= max_chamfer, and the 95th percentile of each view is <= max_p95 (see pcl_metrics.h).
+The time of a setting is the fastest of num_repeats runs over all views.
+
+The best params are printed as lines of the launch file, and as a dynparam command to apply them to a running node2
+(see cfg/Node2.cfg). The grid size is fixed, so voxel_point_budget is set to 0.
+
+Example of usage:
+$ bin/pcl_tune_params data/data/scan_session.scan
+$ bin/pcl_tune_params data/data/scan_session.scan 0.001 0.005 3 data/golden/
+
+Optional: max_chamfer (default 0.001 m), max_p95 (default 0.005 m), num_repeats (default 3), golden folder.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include "my_basics/basics.h"
+#include "my_pcl/pcl_io.h"
+#include "my_pcl/pcl_segment_view.h"
+#include "my_pcl/pcl_archive.h"
+#include "my_pcl/pcl_metrics.h"
+
+using namespace pcl;
+using namespace my_pcl;
+typedef pcl::PointXYZRGB PointT;
+typedef pcl::PointCloud<PointT> PointCloudT;
+
+// -- Fixed params of the pipeline, the same as launch/main_3d_scanner.launch (and ViewSegmentationParams' defaults)
+const CropBox crop_box = {-0.25, 0.25, -0.25, 0.25, -0.05, 0.35}; // x/y_range_radius, z_range_low/up
+const float metric_max_distance = 0.05; // distances are clamped to this
+
+// -- Tuned params: their names in node2, and candidates. The first candidate is the launch file's value.
+enum
+{
+    GRID_SIZE,
+    PLANE_DISTANCE_THRESHOLD_0,
+    PLANE_DISTANCE_THRESHOLD,
+    PLANE_MAX_ITERATIONS,
+    FLAG_DETECT_TABLE_BY_HISTOGRAM,
+    NUM_PARAMS
+};
+const char *PARAM_NAMES[NUM_PARAMS] = {"grid_size", "plane_distance_threshold_0", "plane_distance_threshold",
+                                       "plane_max_iterations", "flag_detect_table_by_histogram"};
+const vector<vector<double>> CANDIDATES = {
+    {0.002, 0.003, 0.004, 0.005, 0.006, 0.008, 0.01},
+    {0.05, 0.02, 0.03, 0.04, 0.08},
+    {0.02, 0.01, 0.015, 0.025, 0.03},
+    {100, 10, 25, 50, 200},
+    {0, 1},
+};
+typedef vector<double> Params; // one value per param
+
+struct View
+{
+    vector<vector<float>> T_baxter_to_depthcam;
+    PointCloudT::Ptr cloud_src;
+};
+
+struct Evaluation
+{
+    double seconds; // all views
+    double chamfer, p95; // mean Chamfer distance of the views, and the largest 95th percentile
+    bool pass;
+};
+
+PointCloudT::Ptr segmentViewByParams(const View &view, const Params &params, const float T_chess_to_baxter[4][4])
+{
+    ViewSegmentationParams seg_params;
+    seg_params.x_grid_size = seg_params.y_grid_size = seg_params.z_grid_size = params[GRID_SIZE];
+    seg_params.voxel_point_budget = 0;
+    seg_params.plane_distance_threshold_0 = params[PLANE_DISTANCE_THRESHOLD_0];
+    seg_params.plane_distance_threshold = params[PLANE_DISTANCE_THRESHOLD];
+    seg_params.plane_max_iterations = params[PLANE_MAX_ITERATIONS];
+    seg_params.flag_detect_table_by_histogram = params[FLAG_DETECT_TABLE_BY_HISTOGRAM] != 0;
+
+    int point_budget = -1;
+    float grid_size = -1;
+    PointCloudT::Ptr cloud = filtViewByVoxelGrid(view.cloud_src, seg_params, point_budget, grid_size);
+    for (PointT &p : cloud->points)
+        my_basics::preTranslatePoint(view.T_baxter_to_depthcam, p.x, p.y, p.z);
+    cloud = cropViewInChessFrame(*cloud, T_chess_to_baxter, crop_box, seg_params);
+    SegmentedView res;
+    segmentView(cloud, seg_params, res);
+    return res.cloud_segmented;
+}
+
+// Segment all views num_repeats times. Keep the outputs of the last run, and the fastest time.
+double segmentViews(const vector<View> &views, const Params &params, const float T_chess_to_baxter[4][4],
+                    int num_repeats, vector<PointCloudT::Ptr> &clouds_segmented)
+{
+    double best_seconds = 1e9;
+    for (int r = 0; r < num_repeats; r++)
+    {
+        clouds_segmented.clear();
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        for (const View &view : views)
+            clouds_segmented.push_back(segmentViewByParams(view, params, T_chess_to_baxter));
+        best_seconds = min(best_seconds,
+                           std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best_seconds;
+}
+
+string paramsToString(const Params &params)
+{
+    string s;
+    char buf[64];
+    for (int k = 0; k < NUM_PARAMS; k++)
+    {
+        snprintf(buf, sizeof(buf), "%s%s=%g", k ? ", " : "", PARAM_NAMES[k], params[k]);
+        s += buf;
+    }
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc - 1 < 1)
+    {
+        cout << "my ERROR: please input the scan archive." << endl;
+        assert(0);
+    }
+    const string archive_name = argv[1];
+    const double max_chamfer = argc - 1 >= 2 ? atof(argv[2]) : 0.001;
+    const double max_p95 = argc - 1 >= 3 ? atof(argv[3]) : 0.005;
+    const int num_repeats = argc - 1 >= 4 ? atoi(argv[4]) : 3;
+    const string golden_folder = argc - 1 >= 5 ? argv[5] : "";
+    assert(num_repeats >= 1);
+
+    // -- Read all views, so that the reading is not timed
+    ScanArchiveReader reader(archive_name);
+    assert(reader.isOpen() && reader.getNumFrames() > 0);
+    vector<View> views(reader.getNumFrames());
+    for (int i = 0; i < reader.getNumFrames(); i++)
+    {
+        PointCloudT::Ptr cloud_unused;
+        reader.readFrame(i, views[i].T_baxter_to_depthcam, views[i].cloud_src, cloud_unused);
+    }
+    float T_baxter_to_chess[4][4], T_chess_to_baxter[4][4];
+    {
+        ifstream fin("config/T_baxter_to_chess.txt"); // run from the package folder
+        assert(fin.is_open());
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                fin >> T_baxter_to_chess[i][j];
+        my_basics::inv(T_baxter_to_chess, T_chess_to_baxter);
+    }
+
+    // -- Reference
+    Params params_launch(NUM_PARAMS);
+    for (int k = 0; k < NUM_PARAMS; k++)
+        params_launch[k] = CANDIDATES[k][0];
+    vector<PointCloudT::Ptr> clouds_reference;
+    double seconds_launch = segmentViews(views, params_launch, T_chess_to_baxter, num_repeats, clouds_reference);
+    if (!golden_folder.empty())
+        for (size_t i = 0; i < views.size(); i++)
+            clouds_reference[i] = read_point_cloud(
+                golden_folder + "golden_segmented_" + my_basics::int2str(i + 1, 2) + ".pcd");
+    printf("%d views. Launch params: %.2f ms per view\n", (int)views.size(), seconds_launch * 1000 / views.size());
+
+    // -- Coordinate descent. Settings are evaluated once.
+    map<Params, Evaluation> evaluations;
+    auto evaluate = [&](const Params &params) -> const Evaluation & {
+        map<Params, Evaluation>::iterator it = evaluations.find(params);
+        if (it != evaluations.end())
+            return it->second;
+        vector<PointCloudT::Ptr> clouds_segmented;
+        Evaluation e;
+        e.seconds = segmentViews(views, params, T_chess_to_baxter, num_repeats, clouds_segmented);
+        e.chamfer = e.p95 = 0;
+        for (size_t i = 0; i < views.size(); i++)
+        {
+            CloudDistance d = compareClouds(*clouds_segmented[i], *clouds_reference[i], metric_max_distance);
+            e.chamfer += d.chamfer / views.size();
+            e.p95 = max(e.p95, d.p95);
+        }
+        e.pass = e.chamfer <= max_chamfer && e.p95 <= max_p95;
+        printf("%8.2f ms per view, chamfer %.5f, p95 %.5f m  %-6s %s\n", e.seconds * 1000 / views.size(),
+               e.chamfer, e.p95, e.pass ? "OK" : "FAILED", paramsToString(params).c_str());
+        return evaluations[params] = e;
+    };
+
+    Params best = params_launch;
+    if (!evaluate(best).pass)
+        cout << "my WARNING: the launch params are out of the tolerance of the golden run. Start from them anyway."
+             << endl;
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int k = 0; k < NUM_PARAMS; k++)
+            for (double val : CANDIDATES[k])
+            {
+                Params params = best;
+                params[k] = val;
+                const Evaluation &e = evaluate(params);
+                if (e.pass && e.seconds < evaluations[best].seconds)
+                    best = params, changed = true;
+            }
+    }
+
+    // -- Output
+    const Evaluation &e = evaluations[best];
+    printf("\nBest of %d settings: %.2f ms per view (launch params %.2f ms), chamfer %.5f, p95 %.5f m\n",
+           (int)evaluations.size(), e.seconds * 1000 / views.size(), seconds_launch * 1000 / views.size(),
+           e.chamfer, e.p95);
+    printf("\nIn launch/main_3d_scanner.launch (node2):\n");
+    for (const char *axis : {"x", "y", "z"})
+        printf("    <param name=\"%s_grid_size\" type=\"double\" value=\"%g\" />\n", axis, best[GRID_SIZE]);
+    printf("    <param name=\"voxel_point_budget\" type=\"int\" value=\"0\" />\n");
+    printf("    <param name=\"plane_distance_threshold_0\" type=\"double\" value=\"%g\" />\n",
+           best[PLANE_DISTANCE_THRESHOLD_0]);
+    printf("    <param name=\"plane_distance_threshold\" type=\"double\" value=\"%g\" />\n",
+           best[PLANE_DISTANCE_THRESHOLD]);
+    printf("    <param name=\"plane_max_iterations\" type=\"int\" value=\"%d\" />\n", (int)best[PLANE_MAX_ITERATIONS]);
+    printf("    <param name=\"flag_detect_table_by_histogram\" type=\"bool\" value=\"%s\" />\n",
+           best[FLAG_DETECT_TABLE_BY_HISTOGRAM] ? "true" : "false");
+    printf("\nOr on a running node2:\n$ rosrun dynamic_reconfigure dynparam set /node2 \"{x_grid_size: %g, "
+           "y_grid_size: %g, z_grid_size: %g, voxel_point_budget: 0, plane_distance_threshold_0: %g, "
+           "plane_distance_threshold: %g, plane_max_iterations: %d, flag_detect_table_by_histogram: %s}\"\n",
+           best[GRID_SIZE], best[GRID_SIZE], best[GRID_SIZE], best[PLANE_DISTANCE_THRESHOLD_0],
+           best[PLANE_DISTANCE_THRESHOLD], (int)best[PLANE_MAX_ITERATIONS],
+           best[FLAG_DETECT_TABLE_BY_HISTOGRAM] ? "true" : "false");
+    return (0);
+}
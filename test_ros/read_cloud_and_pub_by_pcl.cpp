@@ -1,5 +1,22 @@
+/*
+Publish point clouds read from file. Also used as a load generator for node2.
+
+Modes (private param "~mode"):
+    single: publish one pcd file (file_folder + file_name) at "~rate" Hz. (Default)
+    rate:   replay a scan session archive (pose + cloud_src of each frame) at "~rate" Hz.
+    ack:    replay the archive, and send the next frame as soon as node2's output of the previous one
+            arrives (or "~ack_timeout" seconds passed).
+
+Each replayed cloud is stamped with the time it is sent. node2 copies the stamp of the source cloud
+to its outputs, so the latency of a frame is (time of receiving node2's output - stamp).
+A frame whose output does not arrive in "~ack_timeout" seconds is counted as dropped.
+Every "~report_period" seconds, the send/receive rates, drops, and latency are printed.
+*/
+
 #include <iostream>
 #include <string>
+#include <map>
+#include <algorithm>
 
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
@@ -9,16 +26,78 @@
 #include <pcl/common/common_headers.h>
 
 #include "my_pcl/pcl_io.h"
+#include "my_pcl/pcl_archive.h"
+#include "scan3d_by_baxter/T4x4.h"
+#include "scan3d_by_baxter/CloudSlot.h"
 
 using namespace std;
 
-// Main
+// ------------------------------------- Statistics -------------------------------------
+
+struct LoadStats
+{
+    int sent = 0, received = 0, dropped = 0, unmatched = 0;
+    vector<double> latencies; // seconds
+
+    void print(const string &title, double period) const
+    {
+        vector<double> l = latencies;
+        sort(l.begin(), l.end());
+        double mean = 0;
+        for (double v : l)
+            mean += v / l.size();
+        printf("%s: sent %d (%.2f fps), received %d (%.2f fps), dropped %d, unmatched %d\n",
+               title.c_str(), sent, sent / period, received, received / period, dropped, unmatched);
+        if (!l.empty())
+            printf("    latency (ms): mean %.1f, p50 %.1f, p95 %.1f, max %.1f\n", mean * 1000,
+                   l[l.size() / 2] * 1000, l[min(l.size() - 1, l.size() * 95 / 100)] * 1000, l.back() * 1000);
+    }
+};
+
+LoadStats stats_window, stats_total;
+map<ros::Time, ros::Time> frames_in_flight; // stamp --> when it was sent
+
+void onOutputOfNode2(const ros::Time &stamp)
+{
+    map<ros::Time, ros::Time>::iterator it = frames_in_flight.find(stamp);
+    if (it == frames_in_flight.end())
+    {
+        // Dropped earlier by timeout, or node2 output for a frame not sent by this node
+        stats_window.unmatched++, stats_total.unmatched++;
+        return;
+    }
+    double latency = (ros::Time::now() - stamp).toSec();
+    frames_in_flight.erase(it);
+    stats_window.received++, stats_total.received++;
+    stats_window.latencies.push_back(latency);
+    stats_total.latencies.push_back(latency);
+}
+void subCallbackCloudSlot(const scan3d_by_baxter::CloudSlot::ConstPtr &msg) { onOutputOfNode2(msg->header.stamp); }
+void subCallbackCloud(const sensor_msgs::PointCloud2::ConstPtr &msg) { onOutputOfNode2(msg->header.stamp); }
+
+void checkTimeout(double ack_timeout)
+{
+    ros::Time t_now = ros::Time::now();
+    for (map<ros::Time, ros::Time>::iterator it = frames_in_flight.begin(); it != frames_in_flight.end();)
+    {
+        if ((t_now - it->second).toSec() > ack_timeout)
+        {
+            stats_window.dropped++, stats_total.dropped++;
+            it = frames_in_flight.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+// ------------------------------------- Main -------------------------------------
+
 int main(int argc, char **argv)
 {
     // Init node
     string node_name = "read_cloud_and_pub_by_pcl";
     ros::init(argc, argv, node_name);
-    ros::NodeHandle nh;
+    ros::NodeHandle nh, nh_private("~");
 
     // Settings
     string ros_cloud_frame_id = "base";
@@ -27,39 +106,145 @@ int main(int argc, char **argv)
         topic_name_rgbd_cloud = "/camera/depth/color/points";
     if (!nh.getParam("file_folder", file_folder))
         assert(0);
-    if (!nh.getParam("file_name", file_name))
-        assert(0);
-    // { // These two are not working?!?!?!?! why
-    //     nh.param<string>("file_folder", file_folder);
-    //     nh.param("file_name", file_name);
-    // }
+    string mode = nh_private.param<string>("mode", "single");
+    double rate = nh_private.param<double>("rate", 2.0);
+    double ack_timeout = nh_private.param<double>("ack_timeout", 5.0);
+    double report_period = nh_private.param<double>("report_period", 2.0);
+    int num_frames = nh_private.param<int>("num_frames", -1); // -1: each frame of the archive once
+    assert(mode == "single" || mode == "rate" || mode == "ack");
 
     // Publisher
     ros::Publisher pub = nh.advertise<sensor_msgs::PointCloud2>(topic_name_rgbd_cloud, 1);
 
-    // Read file
-    string filename_whole = file_folder + file_name;
-    ROS_INFO(("Read point cloud from: " + filename_whole).c_str());
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud = my_pcl::read_point_cloud(filename_whole);
+    // -- The old behavior: one file at a fixed rate
+    if (mode == "single")
+    {
+        if (!nh.getParam("file_name", file_name))
+            assert(0);
+        // { // These two are not working?!?!?!?! why
+        //     nh.param<string>("file_folder", file_folder);
+        //     nh.param("file_name", file_name);
+        // }
+
+        // Read file
+        string filename_whole = file_folder + file_name;
+        ROS_INFO(("Read point cloud from: " + filename_whole).c_str());
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud = my_pcl::read_point_cloud(filename_whole);
+
+        // Convert file
+        sensor_msgs::PointCloud2 ros_cloud;
+        pcl::toROSMsg(*pcl_cloud, ros_cloud);
+        ros_cloud.header.frame_id = ros_cloud_frame_id;
+
+        // Publish
+        ros::Rate loop_rate(rate);
+        int cnt = 0;
+        while (ros::ok())
+        {
+            pub.publish(ros_cloud);
+            ROS_INFO("Publish %dth cloud.\n", cnt++);
+            loop_rate.sleep();
+        }
+        ROS_INFO("This node stops: read_cloud_and_pub_by_pcl");
+        return 0;
+    }
+
+    // -- Load generator: read the session, and convert all frames before the timing starts
+    string file_name_archive, topic_n1_to_n2;
+    if (!nh.getParam("file_name_archive", file_name_archive))
+        assert(0);
+    if (!nh.getParam("topic_n1_to_n2", topic_n1_to_n2))
+        assert(0);
+    my_pcl::ScanArchiveReader archive(file_folder + file_name_archive);
+    assert(archive.isOpen() && archive.getNumFrames() > 0);
+    vector<sensor_msgs::PointCloud2> ros_clouds(archive.getNumFrames());
+    vector<scan3d_by_baxter::T4x4> poses(archive.getNumFrames());
+    for (int i = 0; i < archive.getNumFrames(); i++)
+    {
+        vector<vector<float>> T;
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_src, cloud_segmented;
+        archive.readFrame(i, T, cloud_src, cloud_segmented);
+        pcl::toROSMsg(*cloud_src, ros_clouds[i]);
+        ros_clouds[i].header.frame_id = ros_cloud_frame_id;
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                poses[i].TransformationMatrix.push_back(T[r][c]);
+    }
+    if (num_frames < 0)
+        num_frames = archive.getNumFrames();
+    ROS_INFO("Load generator: %d frames in the archive, send %d frames, mode %s\n",
+             archive.getNumFrames(), num_frames, mode.c_str());
 
-    // Convert file
-    sensor_msgs::PointCloud2 ros_cloud;
-    pcl::toROSMsg(*pcl_cloud, ros_cloud);
-    ros_cloud.header.frame_id = ros_cloud_frame_id;
+    // Pose and cloud carry the same stamp, which node2 uses to pair them.
+    ros::Publisher pub_pose = nh.advertise<scan3d_by_baxter::T4x4>(topic_n1_to_n2, 10);
 
-    // Publish
-    ros::Rate loop_rate(2);
-    int cnt = 0;
+    // Output of node2 to measure. The shm descriptors are tiny, and subscribing to them does not make node2
+    // serialize the whole cloud.
+    bool measure_shm_topic = nh_private.param<bool>("measure_shm_topic", true);
+    ros::Subscriber sub_output;
+    string topic_output;
+    if (measure_shm_topic)
+    {
+        nh.getParam("topic_n2_to_n3_shm", topic_output);
+        sub_output = nh.subscribe(topic_output, 100, subCallbackCloudSlot);
+    }
+    else
+    {
+        nh.getParam("topic_n2_to_n3", topic_output);
+        sub_output = nh.subscribe(topic_output, 100, subCallbackCloud);
+    }
+
+    // Wait for node2
+    while (ros::ok() && (pub.getNumSubscribers() == 0 || pub_pose.getNumSubscribers() == 0))
+        ros::Duration(0.1).sleep();
+    ROS_INFO("Load generator: start. Measure the output on %s\n", topic_output.c_str());
+
+    ros::Time t_start = ros::Time::now(), t_last_report = t_start, t_next_send = t_start;
+    int cnt_sent = 0;
     while (ros::ok())
     {
-        pub.publish(ros_cloud);
-        ROS_INFO("Publish %dth cloud.\n", cnt++);
-        loop_rate.sleep();
-        // // ros::spinOnce();
+        ros::spinOnce();
+        checkTimeout(ack_timeout);
+        ros::Time t_now = ros::Time::now();
+
+        // Send
+        bool ready = (mode == "rate") ? t_now >= t_next_send : frames_in_flight.empty();
+        if (cnt_sent < num_frames && ready)
+        {
+            int i = cnt_sent % archive.getNumFrames();
+            // node2 gets the stamp back from the pcl header, which is in microseconds
+            ros::Time stamp;
+            stamp.fromNSec(t_now.toNSec() / 1000 * 1000);
+            ros_clouds[i].header.stamp = stamp;
+            poses[i].header.stamp = stamp; // node2 pairs them by stamp
+            pub_pose.publish(poses[i]);
+            pub.publish(ros_clouds[i]);
+            frames_in_flight[stamp] = t_now;
+            stats_window.sent++, stats_total.sent++;
+            cnt_sent++;
+            t_next_send = t_next_send + ros::Duration(1.0 / rate);
+        }
+
+        // Report
+        if ((t_now - t_last_report).toSec() >= report_period)
+        {
+            stats_window.print("Load generator (last " + to_string((int)report_period) + "s)",
+                               (t_now - t_last_report).toSec());
+            printf("    in flight: %d\n", (int)frames_in_flight.size());
+            stats_window = LoadStats();
+            t_last_report = t_now;
+        }
+
+        if (cnt_sent >= num_frames && frames_in_flight.empty())
+            break;
+        ros::Duration(0.001).sleep();
     }
 
+    // Summary
+    stats_total.print("Load generator (total)", (ros::Time::now() - t_start).toSec());
+
     // Return
-    ROS_INFO("This node stops: read_cloud_and_pub_by_pcl"); 
+    ROS_INFO("This node stops: read_cloud_and_pub_by_pcl");
     // ROS_INFO(("This node stops: " + node_name).c_str()); // This generates annoying warning.
     return 0;
 }
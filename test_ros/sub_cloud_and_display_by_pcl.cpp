@@ -8,22 +8,20 @@
 
 #include <pcl/point_types.h>
 #include <pcl/common/common_headers.h>
-#include <pcl/visualization/pcl_visualizer.h>
+
+#include "my_pcl/pcl_visualization.h"
 
 using namespace std;
 
-// Init viewer
-boost::shared_ptr<pcl::visualization::PCLVisualizer>
-initPointCloudRGBViewer(pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloud,
-                        const string &viewer_name = "viewer_name", const string &cloud_name = "cloud_name");
+// Viewer: renders in its own thread
+boost::shared_ptr<my_pcl::AsyncCloudViewer> viewer;
 
-// Set subscriber
-pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-bool flag_receive_cloud = false;
-void subscriber_callback(const sensor_msgs::PointCloud2 &ros_cloud)
+// Set subscriber. Runs in the spinner's thread: decode into a new cloud, and hand it to the viewer.
+void subscriber_callback(const sensor_msgs::PointCloud2::ConstPtr &ros_cloud)
 {
-  flag_receive_cloud = true;
-  pcl::fromROSMsg(ros_cloud, *pcl_cloud);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr pcl_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+  pcl::fromROSMsg(*ros_cloud, *pcl_cloud);
+  viewer->setCloud(pcl_cloud);
   ROS_INFO("Subscribed a point cloud from ros topic.");
 }
 
@@ -39,54 +37,30 @@ int main(int argc, char **argv)
   string topic_name_rgbd_cloud;
   string viewer_name = "viewer_name";
   string viewer_cloud_name = "cloud_name";
+  int point_budget;
   if (!nh.getParam("topic_name_rgbd_cloud", topic_name_rgbd_cloud))
     topic_name_rgbd_cloud = "/camera/depth/color/points";
-
-  // Subscriber
-  ros::Subscriber sub = nh.subscribe(topic_name_rgbd_cloud, 1, subscriber_callback); // 1 is queue size
+  if (!ros::NodeHandle("~").getParam("point_budget", point_budget))
+    point_budget = 300000;
 
   // Init viewer
-  boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer =
-      initPointCloudRGBViewer(pcl_cloud, viewer_name, viewer_cloud_name);
+  viewer.reset(new my_pcl::AsyncCloudViewer(viewer_name, viewer_cloud_name, point_budget));
+  viewer->start();
 
-  // Loop, subscribe ros_cloud, and view
-  while (ros::ok() && !viewer->wasStopped())
-  {
-    if (flag_receive_cloud)
-    {
-      flag_receive_cloud = false;
-      viewer->updatePointCloud(pcl_cloud, viewer_cloud_name);
-    }
-    viewer->spinOnce(10);
-    ros::spinOnce(); // In python, sub is running in different thread. In C++, same thread. So need this.
-  }
+  // Subscriber. Only the newest cloud matters, so queue size is 1.
+  ros::Subscriber sub = nh.subscribe(topic_name_rgbd_cloud, 1, subscriber_callback);
+  ros::AsyncSpinner spinner(1); // decoding runs in this thread, not in the render thread
+  spinner.start();
+
+  // Wait until the window is closed
+  while (ros::ok() && viewer->isRunning())
+    ros::Duration(0.05).sleep();
 
   // Return
+  spinner.stop();
+  viewer->stop();
+  printf("Received %d clouds, rendered %d.\n", viewer->getNumReceived(), viewer->getNumRendered());
   ROS_INFO("This node stops: sub_cloud_and_display_by_pcl");
   // ROS_INFO(("This node stops: " + node_name).c_str()); // This generates annoying warning.
   return 0;
 }
-
-// Init viewer
-boost::shared_ptr<pcl::visualization::PCLVisualizer>
-initPointCloudRGBViewer(pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloud,
-                        const string &viewer_name, const string &cloud_name)
-{
-  boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer(
-      new pcl::visualization::PCLVisualizer(viewer_name));
-
-  // Add a RGB point cloud
-  const int POINT_SIZE = 3;
-  pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGB> color_setting(cloud);
-  viewer->addPointCloud<pcl::PointXYZRGB>(cloud, color_setting, cloud_name);
-  viewer->setPointCloudRenderingProperties(
-      pcl::visualization::PCL_VISUALIZER_POINT_SIZE, POINT_SIZE, cloud_name);
-
-  // Add Coordinate system
-  viewer->addCoordinateSystem(1.0, "world frame");
-
-  // Other properties
-  viewer->setBackgroundColor(0, 0, 0);
-  viewer->initCameraParameters();
-  return (viewer);
-}
\ No newline at end of file